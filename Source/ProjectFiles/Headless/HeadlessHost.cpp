@@ -0,0 +1,369 @@
+#include "HeadlessHost.h"
+
+#include <filesystem>
+
+namespace Headless {
+
+	World& GetWorld() {
+		static World world;
+		return world;
+	}
+
+	// The mod frees host memory with HeapFree, so allocate it the matching way.
+	static void* HostAllocate(size_t Size) {
+#ifdef _WIN32
+		return HeapAlloc(GetProcessHeap(), 0, Size ? Size : 1);
+#else
+		return malloc(Size ? Size : 1);
+#endif
+	}
+
+	static int64_t FloorDivide(int64_t Value, int64_t Divisor) {
+		return (Value >= 0) ? Value / Divisor : -((-Value + Divisor - 1) / Divisor);
+	}
+
+	uint64_t World::GetSectionKey(const CoordinateInBlocks& At) {
+		uint64_t x = uint64_t(FloorDivide(At.X, ChunkSize)) & 0x1FFFFFF;
+		uint64_t y = uint64_t(FloorDivide(At.Y, ChunkSize)) & 0x1FFFFFF;
+		uint64_t z = uint64_t(At.Z / ChunkSize) & 0x3FFF;
+		return (x << 39) | (y << 14) | z;
+	}
+
+	uint64_t World::GetChunkKey(const CoordinateInBlocks& At) {
+		return GetSectionKey(CoordinateInBlocks(At.X, At.Y, 0));
+	}
+
+	size_t World::GetSectionIndex(const CoordinateInBlocks& At) {
+		int64_t x = At.X - FloorDivide(At.X, ChunkSize) * ChunkSize;
+		int64_t y = At.Y - FloorDivide(At.Y, ChunkSize) * ChunkSize;
+		int64_t z = At.Z % ChunkSize;
+		return size_t(x + ChunkSize * (y + ChunkSize * z));
+	}
+
+	bool World::IsLoaded(const CoordinateInBlocks& At) const {
+		if (At.Z < 0 || At.Z >= WorldHeight) return false;
+
+		CoordinateInBlocks player = CoordinateInBlocks(playerLocation);
+		int64_t chunkDistanceX = FloorDivide(At.X, ChunkSize) - FloorDivide(player.X, ChunkSize);
+		int64_t chunkDistanceY = FloorDivide(At.Y, ChunkSize) - FloorDivide(player.Y, ChunkSize);
+		int64_t chunkRadius = loadedRadius / ChunkSize;
+
+		return chunkDistanceX * chunkDistanceX + chunkDistanceY * chunkDistanceY <= chunkRadius * chunkRadius;
+	}
+
+	BlockInfo World::GetGeneratedBlock(const CoordinateInBlocks& At) const {
+		if (At.Z < groundHeight - 1) return BlockInfo(EBlockType::Stone);
+		if (At.Z == groundHeight - 1) return BlockInfo(EBlockType::Grass);
+		return BlockInfo(EBlockType::Air);
+	}
+
+	BlockInfo World::GetBlock(const CoordinateInBlocks& At) const {
+		if (!IsLoaded(At)) return BlockInfo(EBlockType::Invalid);
+
+		auto section = sections.find(GetSectionKey(At));
+		if (section == sections.end()) return GetGeneratedBlock(At);
+		return section->second->blocks[GetSectionIndex(At)];
+	}
+
+	bool World::SetBlock(const CoordinateInBlocks& At, const BlockInfo& Type, BlockInfo& Replaced) {
+		if (!IsLoaded(At) || Type.Type == EBlockType::Invalid) {
+			Replaced = BlockInfo(EBlockType::Invalid);
+			return false;
+		}
+
+		std::unique_ptr<Section>& section = sections[GetSectionKey(At)];
+		if (!section) {
+			section = std::make_unique<Section>();
+			CoordinateInBlocks origin = CoordinateInBlocks(
+				FloorDivide(At.X, ChunkSize) * ChunkSize, FloorDivide(At.Y, ChunkSize) * ChunkSize, int16_t(At.Z / ChunkSize * ChunkSize));
+			for (int64_t i = 0; i < ChunkSize * ChunkSize * ChunkSize; i++) {
+				section->blocks[i] = GetGeneratedBlock(origin + CoordinateInBlocks(i % ChunkSize, (i / ChunkSize) % ChunkSize, int16_t(i / (ChunkSize * ChunkSize))));
+			}
+		}
+
+		BlockInfo& block = section->blocks[GetSectionIndex(At)];
+		Replaced = block;
+		block = Type;
+		dirtyChunks.insert(GetChunkKey(At));
+		return true;
+	}
+
+	size_t World::RebuildDirtyChunks() {
+		size_t rebuilt = dirtyChunks.size();
+		counters.chunkRebuilds += rebuilt;
+		dirtyChunks.clear();
+		return rebuilt;
+	}
+
+	void World::SetPlayerBlockLocation(const CoordinateInBlocks& At) {
+		playerLocation = CoordinateInCentimeters(At);
+	}
+
+	size_t World::GetLiveHintCount() const {
+		return liveHints.size();
+	}
+
+	size_t World::GetAllocatedSections() const {
+		return sections.size();
+	}
+
+	void World::Reset() {
+		sections.clear();
+		dirtyChunks.clear();
+		counters = HostCounters();
+		hintLog.clear();
+		liveHints.clear();
+		inventory.clear();
+		savedData.clear();
+		savedStrings.clear();
+		sharedMemory.clear();
+		worldName = L"HeadlessWorld";
+		viewDirection = DirectionVectorInCentimeters(1, 0, 0);
+
+		std::error_code error;
+		std::filesystem::remove_all(std::filesystem::path(GetHostFolder()), error);
+	}
+
+	wString GetHostFolder() {
+		return (std::filesystem::temp_directory_path() / L"CyubePainterHeadless").wstring();
+	}
+
+	/************************************************************
+		Host functions
+	*************************************************************/
+
+	static void HostLog(const wchar_t* String) {
+		fprintf(stderr, "[Log] %ls\n", String);
+	}
+
+	static BlockInfo HostGetBlock(const CoordinateInBlocks& At) {
+		World& world = GetWorld();
+		world.counters.getBlockCalls++;
+		return world.GetBlock(At);
+	}
+
+	static bool HostSetBlock(const CoordinateInBlocks& At, const BlockInfo& BlockType, BlockInfo& OutReplacedType) {
+		World& world = GetWorld();
+		world.counters.setBlockCalls++;
+		return world.SetBlock(At, BlockType, OutReplacedType);
+	}
+
+	static void HostSpawnHintText(const CoordinateInCentimeters& /*At*/, const wchar_t* Text, float /*DurationInSeconds*/, float /*SizeMultiplier*/, float /*SizeMultiplierVertical*/) {
+		World& world = GetWorld();
+		world.counters.hintTexts++;
+		world.hintLog.push_back(Text);
+	}
+
+	static void* HostSpawnHintTextAdvanced(const CoordinateInCentimeters& /*At*/, const wchar_t* Text, float /*DurationInSeconds*/, float /*SizeMultiplier*/, float /*SizeMultiplierVertical*/, float /*FontSizeMultiplier*/) {
+		World& world = GetWorld();
+		world.counters.hintTexts++;
+		world.hintLog.push_back(Text);
+
+		std::unique_ptr<World::HintText> hint = std::make_unique<World::HintText>();
+		hint->text = Text;
+		void* handle = hint.get();
+		world.liveHints.emplace(handle, std::move(hint));
+		return handle;
+	}
+
+	static void HostDestroyHintText(void*& Handle) {
+		GetWorld().liveHints.erase(Handle);
+		Handle = nullptr;
+	}
+
+	static CoordinateInCentimeters HostGetPlayerLocation() {
+		return GetWorld().playerLocation;
+	}
+
+	static bool HostSetPlayerLocation(const CoordinateInCentimeters& To) {
+		GetWorld().playerLocation = To;
+		return true;
+	}
+
+	static CoordinateInCentimeters HostGetPlayerLocationHead() {
+		return GetWorld().playerLocation + CoordinateInCentimeters(0, 0, 170);
+	}
+
+	static DirectionVectorInCentimeters HostGetPlayerViewDirection() {
+		return GetWorld().viewDirection;
+	}
+
+	static CoordinateInCentimeters HostGetHandLocation(bool LeftHand) {
+		return GetWorld().playerLocation + CoordinateInCentimeters(0, LeftHand ? -30 : 30, 120);
+	}
+
+	static void HostSpawnBlockItem(const CoordinateInCentimeters& /*At*/, const BlockInfo& /*Type*/) {}
+
+	static void HostAddToInventory(const BlockInfo& Type, uint32_t Amount) {
+		GetWorld().counters.inventoryCalls++;
+		GetWorld().inventory[uint64_t(Type.Type) | (uint64_t(Type.CustomBlockID) << 16)] += Amount;
+	}
+
+	static void HostRemoveFromInventory(const BlockInfo& Type, uint32_t Amount) {
+		GetWorld().counters.inventoryCalls++;
+		GetWorld().inventory[uint64_t(Type.Type) | (uint64_t(Type.CustomBlockID) << 16)] -= Amount;
+	}
+
+	static const wchar_t* HostGetWorldName() {
+		return GetWorld().worldName.c_str();
+	}
+
+	static uint32_t HostGetWorldSeed() {
+		return 1;
+	}
+
+	static float timeOfDay = 1200;
+
+	static float HostGetTimeOfDay() {
+		return timeOfDay;
+	}
+
+	static void HostSetTimeOfDay(float NewTime) {
+		timeOfDay = NewTime;
+	}
+
+	static void HostPlayHapticFeedbackOnHand(bool /*LeftHand*/, float /*DurationSeconds*/, float /*Frequency*/, float /*Amplitude*/) {}
+
+	static float playerHealth = 1;
+
+	static float HostGetPlayerHealth() {
+		return playerHealth;
+	}
+
+	static float HostSetPlayerHealth(float NewHealth, bool Offset) {
+		playerHealth = Offset ? playerHealth + NewHealth : NewHealth;
+		return playerHealth;
+	}
+
+	static void HostSpawnBPModActor(const CoordinateInCentimeters& /*At*/, const wchar_t* /*ModName*/, const wchar_t* /*ActorName*/) {}
+
+	static void HostSaveModDataString(const wchar_t* ModName, const wchar_t* StringIn) {
+		GetWorld().savedStrings[ModName] = StringIn;
+	}
+
+	static bool HostLoadModDataString(const wchar_t* ModName, wchar_t*& StringOut) {
+		World& world = GetWorld();
+		auto saved = world.savedStrings.find(ModName);
+		if (saved == world.savedStrings.end()) return false;
+
+		size_t bytes = (saved->second.size() + 1) * sizeof(wchar_t);
+		StringOut = static_cast<wchar_t*>(HostAllocate(bytes));
+		memcpy(StringOut, saved->second.c_str(), bytes);
+		return true;
+	}
+
+	static void HostSaveModData(const wchar_t* ModName, uint8_t* Data, uint64_t ArraySize) {
+		GetWorld().savedData[ModName] = std::vector<uint8_t>(Data, Data + ArraySize);
+	}
+
+	static uint8_t* HostLoadModData(const wchar_t* ModName, uint64_t* ArraySizeOut) {
+		World& world = GetWorld();
+		auto saved = world.savedData.find(ModName);
+		if (saved == world.savedData.end()) {
+			*ArraySizeOut = 0;
+			return nullptr;
+		}
+
+		uint8_t* data = static_cast<uint8_t*>(HostAllocate(saved->second.size()));
+		memcpy(data, saved->second.data(), saved->second.size());
+		*ArraySizeOut = saved->second.size();
+		return data;
+	}
+
+	static void CopyPathOut(const std::filesystem::path& Path, wchar_t* PathOut) {
+		wString path = Path.wstring() + L"/";
+		size_t length = std::min<size_t>(path.size(), 999);
+		wmemcpy(PathOut, path.c_str(), length);
+		PathOut[length] = L'\0';
+	}
+
+	static void HostGetThisModSaveFolderPath(const wchar_t* ModName, wchar_t* PathOut) {
+		CopyPathOut(std::filesystem::path(GetHostFolder()) / GetWorld().worldName / ModName, PathOut);
+	}
+
+	static void HostGetThisModGlobalSaveFolderPath(const wchar_t* ModName, wchar_t* PathOut) {
+		CopyPathOut(std::filesystem::path(GetHostFolder()) / L"Global" / ModName, PathOut);
+	}
+
+	static GameVersion HostGetGameVersionNumber() {
+		return GameVersion{ 0, 51, false };
+	}
+
+	// Everything runs on one thread here, so waiting for a key that doesn't exist just creates it.
+	static SharedMemoryHandleC HostGetSharedMemoryPointer(const wchar_t* Key, bool CreateIfNotExist, bool WaitUntilExist) {
+		World& world = GetWorld();
+		auto found = world.sharedMemory.find(Key);
+		if (found == world.sharedMemory.end()) {
+			if (!CreateIfNotExist && !WaitUntilExist) {
+				return SharedMemoryHandleC{ nullptr, nullptr, false };
+			}
+			std::unique_ptr<World::SharedMemory> memory = std::make_unique<World::SharedMemory>();
+			memory->key = Key;
+			found = world.sharedMemory.emplace(Key, std::move(memory)).first;
+		}
+
+		World::SharedMemory& memory = *found->second;
+		memory.lock.lock();
+		return SharedMemoryHandleC{ &memory.pointer, memory.key.data(), true };
+	}
+
+	static void HostReleaseSharedMemoryPointer(SharedMemoryHandleC& Handle) {
+		World& world = GetWorld();
+		auto found = world.sharedMemory.find(Handle.Key);
+		if (found != world.sharedMemory.end()) {
+			found->second->lock.unlock();
+		}
+	}
+
+	void InstallHost() {
+		using namespace InternalFunctions;
+
+		I_Log = HostLog;
+
+		I_GetBlock = HostGetBlock;
+		I_SetBlock = HostSetBlock;
+
+		I_SpawnHintText = HostSpawnHintText;
+		I_SpawnHintTextAdvanced = HostSpawnHintTextAdvanced;
+		I_DestroyHintText = HostDestroyHintText;
+
+		I_GetPlayerLocation = HostGetPlayerLocation;
+		I_SetPlayerLocation = HostSetPlayerLocation;
+		I_GetPlayerLocationHead = HostGetPlayerLocationHead;
+		I_GetPlayerViewDirection = HostGetPlayerViewDirection;
+
+		I_GetHandLocation = HostGetHandLocation;
+		I_GetIndexFingerTipLocation = HostGetHandLocation;
+
+		I_SpawnBlockItem = HostSpawnBlockItem;
+
+		I_AddToInventory = HostAddToInventory;
+		I_RemoveFromInventory = HostRemoveFromInventory;
+
+		I_GetWorldName = HostGetWorldName;
+		I_GetWorldSeed = HostGetWorldSeed;
+
+		I_GetTimeOfDay = HostGetTimeOfDay;
+		I_SetTimeOfDay = HostSetTimeOfDay;
+
+		I_PlayHapticFeedbackOnHand = HostPlayHapticFeedbackOnHand;
+
+		I_GetPlayerHealth = HostGetPlayerHealth;
+		I_SetPlayerHealth = HostSetPlayerHealth;
+
+		I_SpawnBPModActor = HostSpawnBPModActor;
+
+		I_SaveModDataString = HostSaveModDataString;
+		I_LoadModDataString = HostLoadModDataString;
+		I_SaveModData = HostSaveModData;
+		I_LoadModData = HostLoadModData;
+
+		I_GetThisModSaveFolderPath = HostGetThisModSaveFolderPath;
+		I_GetThisModGlobalSaveFolderPath = HostGetThisModGlobalSaveFolderPath;
+
+		I_GetGameVersionNumber = HostGetGameVersionNumber;
+
+		I_GetSharedMemoryPointer = HostGetSharedMemoryPointer;
+		I_ReleaseSharedMemoryPointer = HostReleaseSharedMemoryPointer;
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "HeadlessWin32.h"
+#include "GameAPI.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+/************************************************************
+	A stand-in for the cyubeVR host process. It keeps an in-memory chunked world and implements the
+	InternalFunctions::I_* pointers against it, so Mod.cpp can run, be checked and be profiled outside the game.
+
+	Like the game, only chunks within loadedRadius blocks of the player are loaded. GetBlock returns
+	EBlockType::Invalid anywhere else, and SetBlock there fails.
+*************************************************************/
+
+namespace Headless {
+
+	constexpr int64_t ChunkSize = 32;
+	constexpr int16_t WorldHeight = 800;
+
+	struct HostCounters {
+		uint64_t getBlockCalls = 0;
+		uint64_t setBlockCalls = 0;
+		uint64_t hintTexts = 0;
+		uint64_t inventoryCalls = 0;
+		// Chunk meshes the game would have rebuilt, one per chunk written during a tick.
+		uint64_t chunkRebuilds = 0;
+	};
+
+	class World {
+	public:
+		// Blocks below groundHeight are stone, topped with one layer of grass. Everything above is air.
+		int16_t groundHeight = 32;
+		int64_t loadedRadius = 600;
+
+		CoordinateInCentimeters playerLocation = CoordinateInCentimeters(0, 0, 3200);
+		DirectionVectorInCentimeters viewDirection = DirectionVectorInCentimeters(1, 0, 0);
+		wString worldName = L"HeadlessWorld";
+
+		HostCounters counters;
+		std::vector<wString> hintLog;
+		std::map<uint64_t, int64_t> inventory;
+
+		BlockInfo GetBlock(const CoordinateInBlocks& At) const;
+		bool SetBlock(const CoordinateInBlocks& At, const BlockInfo& Type, BlockInfo& Replaced);
+
+		bool IsLoaded(const CoordinateInBlocks& At) const;
+		BlockInfo GetGeneratedBlock(const CoordinateInBlocks& At) const;
+
+		void SetPlayerBlockLocation(const CoordinateInBlocks& At);
+
+		// Ends a tick: every chunk written since the last call counts as one mesh rebuild. Returns how many.
+		size_t RebuildDirtyChunks();
+
+		size_t GetLiveHintCount() const;
+		size_t GetAllocatedSections() const;
+
+		// Drops every edit, saved value and hint, but keeps the settings above.
+		void Reset();
+
+		std::map<wString, std::vector<uint8_t>> savedData;
+		std::map<wString, wString> savedStrings;
+
+		struct HintText {
+			wString text;
+		};
+		std::unordered_map<void*, std::unique_ptr<HintText>> liveHints;
+
+		struct SharedMemory {
+			wString key;
+			void* pointer = nullptr;
+			std::recursive_mutex lock;
+		};
+		std::map<wString, std::unique_ptr<SharedMemory>> sharedMemory;
+
+	private:
+		// Edited space is stored in 32x32x32 sections that are only allocated on first write.
+		struct Section {
+			BlockInfo blocks[ChunkSize * ChunkSize * ChunkSize];
+		};
+		std::unordered_map<uint64_t, std::unique_ptr<Section>> sections;
+		std::unordered_set<uint64_t> dirtyChunks;
+
+		static uint64_t GetSectionKey(const CoordinateInBlocks& At);
+		static size_t GetSectionIndex(const CoordinateInBlocks& At);
+		// Chunks span the full world height, so this is the section key with z dropped.
+		static uint64_t GetChunkKey(const CoordinateInBlocks& At);
+	};
+
+	World& GetWorld();
+
+	// Points every InternalFunctions::I_* entry at the headless world.
+	void InstallHost();
+
+	// Folder the headless host uses for save paths, cleared by Reset.
+	wString GetHostFolder();
+}
@@ -0,0 +1,1720 @@
+// The headless counterpart of Internals.cpp. Mod.cpp is built into this translation unit the same way, while
+// GameAPI.cpp is compiled on its own. The host functions come from HeadlessHost.cpp, and a driver replaces the game.
+//
+//	CyubePainterHeadless check				Runs the correctness scenarios. Exits non-zero when one fails.
+//	CyubePainterHeadless profile [Size]		Times each operation on a Size x Size x Size/4 region.
+
+#include "HeadlessWin32.h"
+#include "HeadlessHost.h"
+
+#include "Mod.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using namespace Headless;
+
+/************************************************************
+	Driver helpers
+*************************************************************/
+
+static int failedChecks = 0;
+
+#define CHECK(Condition)																\
+	if (!(Condition)) {																	\
+		failedChecks++;																	\
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #Condition);	\
+	}
+
+struct TickStats {
+	int ticks = 0;
+	double maxTickMilliseconds = 0;
+	double totalMilliseconds = 0;
+	size_t maxLiveHints = 0;
+	size_t maxChunkRebuilds = 0;
+};
+
+// Places a block the way a player would, including the event the game raises for the mod's own blocks.
+void PlaceBlock(CoordinateInBlocks At, BlockInfo Type) {
+	BlockInfo replaced;
+	GetWorld().SetBlock(At, Type, replaced);
+	if (Type.CustomBlockID != 0) {
+		Event_BlockPlaced(At, Type.CustomBlockID, false);
+	}
+	Event_AnyBlockPlaced(At, Type, false);
+}
+
+void HitBlock(CoordinateInBlocks At, wString ToolName) {
+	BlockInfo block = GetWorld().GetBlock(At);
+	if (block.CustomBlockID != 0) {
+		Event_BlockHitByTool(At, block.CustomBlockID, ToolName, CoordinateInCentimeters(At), false);
+	}
+	Event_AnyBlockHitByTool(At, block, ToolName, CoordinateInCentimeters(At), false);
+}
+
+TickStats RunUntilIdle() {
+	TickStats stats;
+	World& world = GetWorld();
+
+	while (!jobExecutor.IsIdle()) {
+		auto start = std::chrono::steady_clock::now();
+		Event_Tick();
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		stats.ticks++;
+		stats.totalMilliseconds += milliseconds;
+		stats.maxTickMilliseconds = std::max(stats.maxTickMilliseconds, milliseconds);
+		stats.maxLiveHints = std::max(stats.maxLiveHints, world.GetLiveHintCount());
+		stats.maxChunkRebuilds = std::max(stats.maxChunkRebuilds, world.RebuildDirtyChunks());
+	}
+	return stats;
+}
+
+bool BoxIs(CoordinateInBlocks Corner1, CoordinateInBlocks Corner2, BlockInfo Expected) {
+	CoordinateInBlocks start = GetSmallVector(Corner1, Corner2);
+	CoordinateInBlocks end = GetLargeVector(Corner1, Corner2);
+	for (int16_t z = start.Z; z <= end.Z; z++) {
+		for (int64_t y = start.Y; y <= end.Y; y++) {
+			for (int64_t x = start.X; x <= end.X; x++) {
+				if (!SameBlock(GetWorld().GetBlock(CoordinateInBlocks(x, y, z)), Expected)) return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool BoxIsGenerated(CoordinateInBlocks Corner1, CoordinateInBlocks Corner2) {
+	CoordinateInBlocks start = GetSmallVector(Corner1, Corner2);
+	CoordinateInBlocks end = GetLargeVector(Corner1, Corner2);
+	for (int16_t z = start.Z; z <= end.Z; z++) {
+		for (int64_t y = start.Y; y <= end.Y; y++) {
+			for (int64_t x = start.X; x <= end.X; x++) {
+				CoordinateInBlocks at = CoordinateInBlocks(x, y, z);
+				if (!SameBlock(GetWorld().GetBlock(at), GetWorld().GetGeneratedBlock(at))) return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Starts every scenario from an untouched world and an empty mod session.
+void ResetSession() {
+	while (!jobExecutor.IsIdle()) {
+		Event_Tick();
+	}
+	clipboardSave.Finish();
+	GetWorld().Reset();
+	// The library outlives worlds in game, but its folder goes away with the host's.
+	schematicLibrary = SchematicLibrary();
+	selectedSchematic = -1;
+	Event_OnLoad(true);
+}
+
+// Ticks until the background clipboard save has reached SaveModData.
+bool WaitForClipboardSave() {
+	for (int i = 0; i < 10000; i++) {
+		Event_Tick();
+		if (!clipboardSave.IsBusy() && clipboardVersion == savedClipboardVersion) return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+// A palette strip near the origin: Paint block with its target on top, and a Mask block with the given column.
+CoordinateInBlocks SetUpPalette(BlockInfo Target, std::vector<BlockInfo> MaskColumn) {
+	CoordinateInBlocks paintAt = CoordinateInBlocks(-20, -20, 40);
+	PlaceBlock(paintAt, BlockInfo(PaintBlock));
+	PlaceBlock(GetBlockAbove(paintAt), Target);
+
+	// Placed bottom up, the way a player stacks them.
+	CoordinateInBlocks maskAt = CoordinateInBlocks(-20, -24, 40);
+	PlaceBlock(maskAt, BlockInfo(MaskBlock));
+	for (size_t i = 0; i < MaskColumn.size(); i++) {
+		PlaceBlock(maskAt + CoordinateInBlocks(0, 0, int16_t(i + 1)), MaskColumn[i]);
+	}
+	return paintAt;
+}
+
+void SetMarkers(CoordinateInBlocks Corner1, CoordinateInBlocks Corner2) {
+	PlaceBlock(Corner1, BlockInfo(Marker1Block));
+	PlaceBlock(Corner2, BlockInfo(Marker2Block));
+}
+
+/************************************************************
+	Correctness scenarios
+*************************************************************/
+
+void CheckPaintUndoRedo() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	SetMarkers(CoordinateInBlocks(0, 0, 20), CoordinateInBlocks(40, 30, 45));
+
+	HitBlock(paintAt, L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(1, 0, 20), CoordinateInBlocks(40, 30, 44), EBlockType::Sand));
+	CHECK(undoHistory.size() == 1);
+
+	PlaceBlock(paintAt + CoordinateInBlocks(3, 0, 0), BlockInfo(UndoBlock));
+	HitBlock(paintAt + CoordinateInBlocks(3, 0, 0), L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(40, 30, 44)));
+	CHECK(undoHistory.empty() && redoHistory.size() == 1);
+
+	PlaceBlock(paintAt + CoordinateInBlocks(3, 0, 2), BlockInfo(RedoBlock));
+	HitBlock(paintAt + CoordinateInBlocks(3, 0, 2), L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(40, 30, 44), EBlockType::Sand));
+	CHECK(undoHistory.size() == 1 && redoHistory.empty());
+}
+
+void CheckMaskedPaint() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Dirt, { BlockInfo(EBlockType::Stone) });
+	SetMarkers(CoordinateInBlocks(0, 0, 25), CoordinateInBlocks(20, 20, 35));
+
+	HitBlock(paintAt, L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 25), CoordinateInBlocks(19, 19, 30), EBlockType::Dirt));
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 31), CoordinateInBlocks(19, 19, 31), EBlockType::Grass));
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 32), CoordinateInBlocks(19, 19, 35), EBlockType::Air));
+
+	// A second Mask block in the column turns it into an exclude mask.
+	ResetSession();
+	paintAt = SetUpPalette(EBlockType::Sand, { BlockInfo(AirFilter), BlockInfo(MaskBlock) });
+	SetMarkers(CoordinateInBlocks(0, 0, 25), CoordinateInBlocks(20, 20, 35));
+	HitBlock(paintAt, L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 25), CoordinateInBlocks(19, 19, 31), EBlockType::Sand));
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 32), CoordinateInBlocks(19, 19, 35), EBlockType::Air));
+	CHECK(maskCord == CoordinateInBlocks(-20, -24, 40));
+
+	// Taking the stacked Mask block off again keeps the palette's Mask block and makes the mask include air.
+	CoordinateInBlocks stackedAt = CoordinateInBlocks(-20, -24, 42);
+	BlockInfo removed;
+	GetWorld().SetBlock(stackedAt, EBlockType::Air, removed);
+	Event_BlockDestroyed(stackedAt, MaskBlock, false);
+	CHECK(maskCord == CoordinateInBlocks(-20, -24, 40) && GetPaletteMask().IsActive() && !GetPaletteMask().inverted);
+
+	// A Mask block placed anywhere else still moves the palette's mask there.
+	PlaceBlock(CoordinateInBlocks(-30, -24, 40), BlockInfo(MaskBlock));
+	CHECK(maskCord == CoordinateInBlocks(-30, -24, 40));
+}
+
+void CheckCutPasteRotate() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+
+	// An L shape on the ground: a 6 long arm along +X and a 3 long arm along +Y.
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 32);
+	for (int64_t x = 0; x < 6; x++) PlaceBlock(origin + CoordinateInBlocks(x, 0, 0), EBlockType::WoodPlank);
+	for (int64_t y = 1; y < 3; y++) PlaceBlock(origin + CoordinateInBlocks(0, y, 0), EBlockType::Wallstone);
+	SetMarkers(origin + CoordinateInBlocks(0, 0, 1), origin + CoordinateInBlocks(5, 2, 1));
+
+	// The markers sit on top; the selection covers the L and the marker layer.
+	marker1Cord = origin;
+	marker2Cord = origin + CoordinateInBlocks(5, 2, 0);
+	PlaceBlock(paintAt + CoordinateInBlocks(4, 0, 2), BlockInfo(CutBlock));
+	HitBlock(paintAt + CoordinateInBlocks(4, 0, 2), L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIs(origin, origin + CoordinateInBlocks(5, 2, 0), EBlockType::Air));
+	CHECK(clipboard.sizeX == 6 && clipboard.sizeY == 3 && clipboard.sizeZ == 1);
+
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(200, 100, 32);
+	Event_BlockHitByTool(pasteAt, PasteBlock, L"T_Stick", CoordinateInCentimeters(pasteAt), false);
+	RunUntilIdle();
+	CHECK(BoxIs(pasteAt, pasteAt + CoordinateInBlocks(5, 0, 0), EBlockType::WoodPlank));
+	CHECK(BoxIs(pasteAt + CoordinateInBlocks(0, 1, 0), pasteAt + CoordinateInBlocks(0, 2, 0), EBlockType::Wallstone));
+	CHECK(BoxIs(pasteAt + CoordinateInBlocks(1, 1, 0), pasteAt + CoordinateInBlocks(5, 2, 0), EBlockType::Air));
+
+	// Clockwise maps (x, y) to (y, width - 1 - x): the X arm ends up along +Y at x = 0.
+	PlaceBlock(paintAt + CoordinateInBlocks(5, 0, 0), BlockInfo(Rotate90CWBlock));
+	HitBlock(paintAt + CoordinateInBlocks(5, 0, 0), L"T_Stick");
+	CoordinateInBlocks rotatedAt = CoordinateInBlocks(300, 100, 32);
+	Event_BlockHitByTool(rotatedAt, PasteBlock, L"T_Stick", CoordinateInCentimeters(rotatedAt), false);
+	RunUntilIdle();
+	CHECK(clipboard.GetOrientedSize() == (std::array<int64_t, 3>{ 3, 6, 1 }));
+	CHECK(BoxIs(rotatedAt, rotatedAt + CoordinateInBlocks(0, 5, 0), EBlockType::WoodPlank));
+	CHECK(BoxIs(rotatedAt + CoordinateInBlocks(1, 5, 0), rotatedAt + CoordinateInBlocks(2, 5, 0), EBlockType::Wallstone));
+
+	// Undo the rotated paste, the plain paste and the cut, newest first.
+	PlaceBlock(paintAt + CoordinateInBlocks(3, 0, 0), BlockInfo(UndoBlock));
+	for (int i = 0; i < 3; i++) {
+		HitBlock(paintAt + CoordinateInBlocks(3, 0, 0), L"T_Stick");
+	}
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(rotatedAt, rotatedAt + CoordinateInBlocks(2, 5, 0)));
+	CHECK(BoxIsGenerated(pasteAt, pasteAt + CoordinateInBlocks(5, 2, 0)));
+	CHECK(BoxIs(origin, origin + CoordinateInBlocks(5, 0, 0), EBlockType::WoodPlank));
+	CHECK(BoxIs(origin + CoordinateInBlocks(0, 1, 0), origin + CoordinateInBlocks(0, 2, 0), EBlockType::Wallstone));
+}
+
+void CheckLoadedRadius() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	SetMarkers(CoordinateInBlocks(0, 0, 20), CoordinateInBlocks(10, 10, 30));
+
+	// Marker 2 is only recorded; outside the loaded radius the world can't be read.
+	marker2Cord = CoordinateInBlocks(5000, 0, 30);
+	CHECK(!GetBlock(marker2Cord).IsValid());
+
+	HitBlock(paintAt, L"T_Stick");
+	RunUntilIdle();
+	CHECK(undoHistory.empty());
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(9, 9, 30)));
+}
+
+void CheckTimeSlicing() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	SetMarkers(CoordinateInBlocks(0, 0, 20), CoordinateInBlocks(199, 199, 60));
+
+	HitBlock(paintAt, L"T_Stick");
+	CHECK(!jobExecutor.IsIdle());
+	TickStats stats = RunUntilIdle();
+
+	CHECK(stats.ticks > 1);
+	CHECK(stats.maxLiveHints <= 1);
+	CHECK(GetWorld().GetLiveHintCount() == 0);
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(199, 199, 59), EBlockType::Sand));
+}
+
+void CheckTiledTraversal() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	CoordinateInBlocks corner1 = CoordinateInBlocks(-40, -40, 20);
+	CoordinateInBlocks corner2 = CoordinateInBlocks(60, 50, 30);
+	SetMarkers(corner1, corner2);
+
+	// With a small batch the first tick only reaches the chunk the player stands in, the box's far corner.
+	CoordinateInBlocks playerAt = CoordinateInBlocks(55, 45, 40);
+	GetWorld().SetPlayerBlockLocation(playerAt);
+	int64_t maxBlocksPerTick = jobExecutor.maxBlocksPerTick;
+	jobExecutor.maxBlocksPerTick = 1000;
+
+	HitBlock(paintAt, L"T_Stick");
+	Event_Tick();
+	CHECK(BoxIs(CoordinateInBlocks(32, 32, 20), CoordinateInBlocks(59, 49, 20), EBlockType::Sand));
+	CHECK(BoxIsGenerated(CoordinateInBlocks(-39, -39, 20), CoordinateInBlocks(31, 31, 30)));
+
+	jobExecutor.maxBlocksPerTick = maxBlocksPerTick;
+	GetWorld().SetPlayerBlockLocation(CoordinateInBlocks(0, 0, 64));
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(-39, -40, 20), CoordinateInBlocks(60, 50, 29), EBlockType::Sand));
+
+	// Undo entries are numbered tile by tile; a masked paint leaves them full of gaps across tile edges.
+	PlaceBlock(paintAt + CoordinateInBlocks(3, 0, 0), BlockInfo(UndoBlock));
+	HitBlock(paintAt + CoordinateInBlocks(3, 0, 0), L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(-39, -40, 20), CoordinateInBlocks(60, 50, 29)));
+
+	ResetSession();
+	paintAt = SetUpPalette(EBlockType::Dirt, { BlockInfo(EBlockType::Grass) });
+	SetMarkers(corner1, CoordinateInBlocks(60, 50, 32));
+	HitBlock(paintAt, L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(-39, -39, 31), CoordinateInBlocks(59, 49, 31), EBlockType::Dirt));
+	CHECK(BoxIs(CoordinateInBlocks(-39, -39, 21), CoordinateInBlocks(59, 49, 30), EBlockType::Stone));
+
+	PlaceBlock(paintAt + CoordinateInBlocks(3, 0, 0), BlockInfo(UndoBlock));
+	HitBlock(paintAt + CoordinateInBlocks(3, 0, 0), L"T_Stick");
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(-39, -39, 21), CoordinateInBlocks(59, 49, 31)));
+}
+
+void CheckPersistence() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 32);
+	for (int64_t x = 0; x < 6; x++) PlaceBlock(origin + CoordinateInBlocks(x, 0, 0), EBlockType::WoodPlank);
+	for (int64_t y = 1; y < 3; y++) PlaceBlock(origin + CoordinateInBlocks(0, y, 0), EBlockType::Wallstone);
+	marker1Cord = origin;
+	marker2Cord = origin + CoordinateInBlocks(5, 2, 0);
+	CopyRegion(paintAt);
+	RunUntilIdle();
+	CHECK(WaitForClipboardSave());
+	CHECK(GetWorld().savedData.count(ClipboardSaveName) == 1);
+
+	SetMarkers(CoordinateInBlocks(0, 0, 20), CoordinateInBlocks(10, 10, 25));
+	PaintArea(paintAt, false);
+	RunUntilIdle();
+	CHECK(undoHistory.size() == 1);
+
+	// Leave the world and load it again.
+	Event_OnExit();
+	Event_OnLoad(false);
+	CHECK(marker1Cord == CoordinateInBlocks(0, 0, 20) && marker2Cord == CoordinateInBlocks(10, 10, 25));
+	CHECK(paintCord == paintAt);
+	CHECK(clipboard.empty() && undoHistory.empty());
+
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(200, 100, 32);
+	PasteClipboard(pasteAt, false);
+	RunUntilIdle();
+	CHECK(clipboard.sizeX == 6 && clipboard.sizeY == 3 && clipboard.sizeZ == 1);
+	CHECK(BoxIs(pasteAt, pasteAt + CoordinateInBlocks(5, 0, 0), EBlockType::WoodPlank));
+	CHECK(BoxIs(pasteAt + CoordinateInBlocks(0, 1, 0), pasteAt + CoordinateInBlocks(0, 2, 0), EBlockType::Wallstone));
+
+	// The paste is the newest entry; below it is the paint from before the reload.
+	CHECK(undoHistory.size() == 2);
+	UndoLastOperation(paintAt);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(pasteAt, pasteAt + CoordinateInBlocks(5, 2, 0)));
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(9, 9, 25)));
+
+	// A damaged save is dropped instead of restored.
+	Event_OnExit();
+	std::vector<uint8_t>& savedClipboard = GetWorld().savedData[ClipboardSaveName];
+	savedClipboard.resize(savedClipboard.size() - 1);
+	Event_OnLoad(false);
+	PasteClipboard(pasteAt, false);
+	RunUntilIdle();
+	CHECK(clipboard.empty());
+	CHECK(LoadModData(L"NothingSavedHere").empty());
+}
+
+void CheckSchematicLibrary() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 32);
+	for (int64_t x = 0; x < 6; x++) PlaceBlock(origin + CoordinateInBlocks(x, 0, 0), EBlockType::WoodPlank);
+	for (int64_t y = 1; y < 3; y++) PlaceBlock(origin + CoordinateInBlocks(0, y, 0), EBlockType::Wallstone);
+	marker1Cord = origin;
+	marker2Cord = origin + CoordinateInBlocks(5, 2, 0);
+	CopyRegion(paintAt);
+
+	// Saved behind the copy, then a second schematic that holds only planks.
+	CoordinateInBlocks copyAt = paintAt + CoordinateInBlocks(4, 0, 0);
+	Event_BlockHitByTool(copyAt, CopyBlock, L"T_Arrow", CoordinateInCentimeters(copyAt), false);
+	RunUntilIdle();
+	marker2Cord = origin + CoordinateInBlocks(5, 0, 0);
+	CopyRegion(paintAt);
+	Event_BlockHitByTool(copyAt, CopyBlock, L"T_Arrow", CoordinateInCentimeters(copyAt), false);
+	RunUntilIdle();
+	CHECK(schematicLibrary.GetEntries().size() == 2);
+
+	// Another world sees both from the index alone, and can search them by block.
+	Event_OnExit();
+	GetWorld().worldName = L"OtherWorld";
+	schematicLibrary = SchematicLibrary();
+	selectedSchematic = -1;
+	Event_OnLoad(true);
+	SchematicLibrary& library = GetSchematicLibrary();
+	CHECK(library.GetEntries().size() == 2);
+	CHECK(library.FindContaining(EBlockType::WoodPlank).size() == 2);
+	CHECK(library.FindContaining(EBlockType::Wallstone).size() == 1);
+	CHECK(library.FindByName(L"#2").size() == 1);
+	const SchematicInfo& first = library.GetEntries()[0];
+	CHECK(first.sizeX == 6 && first.sizeY == 3 && first.sizeZ == 1);
+	CHECK(first.histogram.size() == 3 && SameBlock(first.histogram[0].first, EBlockType::Air) && first.histogram[0].second == 10);
+
+	// Wallstone on top of the paste block picks the L, and the axe pastes it straight from the mapping.
+	CoordinateInBlocks pasteBlockAt = CoordinateInBlocks(-20, -30, 40);
+	PlaceBlock(pasteBlockAt, BlockInfo(PasteBlock));
+	PlaceBlock(GetBlockAbove(pasteBlockAt), EBlockType::Wallstone);
+	HitBlock(pasteBlockAt, L"T_Pickaxe_Stone");
+	CHECK(selectedSchematic == 0);
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(200, 100, 32);
+	Event_BlockHitByTool(pasteAt, PasteBlock, L"T_Axe_Stone", CoordinateInCentimeters(pasteAt), false);
+	RunUntilIdle();
+	CHECK(BoxIs(pasteAt, pasteAt + CoordinateInBlocks(5, 0, 0), EBlockType::WoodPlank));
+	CHECK(BoxIs(pasteAt + CoordinateInBlocks(0, 1, 0), pasteAt + CoordinateInBlocks(0, 2, 0), EBlockType::Wallstone));
+	CHECK(BoxIs(pasteAt + CoordinateInBlocks(1, 1, 0), pasteAt + CoordinateInBlocks(5, 2, 0), EBlockType::Air));
+	CHECK(clipboard.empty());
+
+	// A record whose data never made it to disk is dropped when the index is read.
+	Event_OnExit();
+	std::filesystem::path folder = std::filesystem::path(GetThisModGlobalSaveFolderPath(L"CyubePainter")) / L"Schematics";
+	std::filesystem::resize_file(folder / L"Schematics.dat", std::filesystem::file_size(folder / L"Schematics.dat") - 1);
+	SchematicLibrary damaged;
+	damaged.Open(folder);
+	CHECK(damaged.GetEntries().size() == 1);
+}
+
+void CheckOrientation() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+
+	// Every turn and mirror composes back to the identity when undone, and each of the 48 is reachable.
+	std::vector<Orientation> steps = { Orientation::QuarterTurn(0, true), Orientation::QuarterTurn(1, true), Orientation::QuarterTurn(2, true),
+		Orientation::Mirror(0), Orientation::Mirror(1), Orientation::Mirror(2) };
+	std::vector<uint8_t> reached(Orientation::Count, 0);
+	std::vector<Orientation> frontier = { Orientation() };
+	reached[0] = 1;
+	while (!frontier.empty()) {
+		Orientation current = frontier.back();
+		frontier.pop_back();
+		for (Orientation step : steps) {
+			Orientation next = current.Then(step);
+			if (!reached[next.id]) {
+				reached[next.id] = 1;
+				frontier.push_back(next);
+			}
+		}
+	}
+	CHECK(std::count(reached.begin(), reached.end(), 1) == Orientation::Count);
+	CHECK(Orientation::QuarterTurn(2, true).Then(Orientation::QuarterTurn(2, false)).IsIdentity());
+	CHECK(Orientation::QuarterTurn(0, true).Then(Orientation::QuarterTurn(0, true)).Then(Orientation::QuarterTurn(0, true)).Then(Orientation::QuarterTurn(0, true)).IsIdentity());
+
+	// A 3 x 2 x 2 block with a distinct block in every voxel, and a torch facing +X.
+	const EBlockType types[12] = { EBlockType::WoodPlank, EBlockType::Wallstone, EBlockType::Sand, EBlockType::Stone, EBlockType::Dirt,
+		EBlockType::TreeWood, EBlockType::TreeWoodBright, EBlockType::WoodPlankBright, EBlockType::StoneMined, EBlockType::Ore_Coal,
+		EBlockType::Ore_Iron, EBlockType::GlassBlock };
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 40);
+	for (int i = 0; i < 12; i++) {
+		PlaceBlock(origin + CoordinateInBlocks(i % 3, (i / 3) % 2, int16_t(i / 6)), types[i]);
+	}
+	PlaceBlock(origin + CoordinateInBlocks(2, 1, 1), BlockInfo(EBlockType::Torch, ERotation::Forward));
+	marker1Cord = origin;
+	marker2Cord = origin + CoordinateInBlocks(2, 1, 1);
+	CopyRegion(paintAt);
+	RunUntilIdle();
+
+	// Turn around X, mirror along Y, turn clockwise seen from above; the clipboard itself is left alone.
+	std::vector<uint8_t> storedIndices = clipboard.indices;
+	Orientation applied[3] = { Orientation::QuarterTurn(0, true), Orientation::Mirror(1), Orientation::QuarterTurn(2, false) };
+	for (Orientation transform : applied) {
+		OrientClipboard(transform);
+	}
+	CHECK(clipboard.indices == storedIndices);
+	CHECK(clipboard.GetOrientedSize() == (std::array<int64_t, 3>{ 2, 3, 2 }));
+
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(200, 100, 40);
+	PasteClipboard(pasteAt, false);
+	RunUntilIdle();
+
+	// Moves every source voxel through the same steps one at a time.
+	bool matches = true;
+	for (int64_t z = 0; z < 2; z++) {
+		for (int64_t y = 0; y < 2; y++) {
+			for (int64_t x = 0; x < 3; x++) {
+				int64_t point[3] = { x, y, z };
+				int64_t size[3] = { 3, 2, 2 };
+				for (Orientation transform : applied) {
+					int64_t moved[3];
+					int64_t movedSize[3];
+					for (int axis = 0; axis < 3; axis++) {
+						int source = transform.GetSourceAxis(axis);
+						moved[axis] = transform.IsFlipped(axis) ? size[source] - 1 - point[source] : point[source];
+						movedSize[axis] = size[source];
+					}
+					std::copy(moved, moved + 3, point);
+					std::copy(movedSize, movedSize + 3, size);
+				}
+				BlockInfo expected = GetWorld().GetBlock(origin + CoordinateInBlocks(x, y, int16_t(z)));
+				BlockInfo pasted = GetWorld().GetBlock(pasteAt + CoordinateInBlocks(point[0], point[1], int16_t(point[2])));
+				if (pasted.Type != expected.Type || pasted.CustomBlockID != expected.CustomBlockID) matches = false;
+			}
+		}
+	}
+	CHECK(matches);
+
+	// The turn around X and the mirror along Y leave a torch facing +X as it is; the clockwise turn takes it to -Y.
+	CHECK(clipboard.orientation.Apply(ERotation::Forward) == ERotation::Left);
+	CHECK(Orientation::Mirror(0).Apply(ERotation::Forward) == ERotation::Backward);
+	CHECK(Orientation::QuarterTurn(0, true).Apply(ERotation::Up) == ERotation::Left);
+	bool torchTurned = false;
+	for (int64_t i = 0; i < 12; i++) {
+		BlockInfo pasted = GetWorld().GetBlock(pasteAt + CoordinateInBlocks(i % 2, (i / 2) % 3, int16_t(i / 6)));
+		if (pasted.Type == EBlockType::Torch) torchTurned = pasted.Rotation == ERotation::Left;
+	}
+	CHECK(torchTurned);
+
+	// The orientation is saved with the clipboard.
+	CHECK(WaitForClipboardSave());
+	Event_OnExit();
+	Event_OnLoad(false);
+	RestoreClipboard();
+	CHECK(clipboard.orientation == applied[0].Then(applied[1]).Then(applied[2]));
+}
+
+void CheckStackArea() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	CoordinateInBlocks copyAt = paintAt + CoordinateInBlocks(4, 0, 0);
+	PlaceBlock(copyAt, BlockInfo(CopyBlock));
+
+	// A plank and a wallstone side by side, up in the air.
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 40);
+	PlaceBlock(origin, EBlockType::WoodPlank);
+	PlaceBlock(origin + CoordinateInBlocks(1, 0, 0), EBlockType::Wallstone);
+	marker1Cord = origin;
+	marker2Cord = origin + CoordinateInBlocks(1, 0, 0);
+
+	// Three sand on the Copy block: three copies along the view, which looks down +X.
+	for (int16_t z = 1; z <= 3; z++) PlaceBlock(copyAt + CoordinateInBlocks(0, 0, z), EBlockType::Sand);
+	HitBlock(copyAt, L"T_Pickaxe_Stone");
+	RunUntilIdle();
+	bool rowMatches = true;
+	for (int64_t x = 0; x < 8; x++) {
+		rowMatches = rowMatches && SameBlock(GetWorld().GetBlock(origin + CoordinateInBlocks(x, 0, 0)), (x % 2 == 0) ? EBlockType::WoodPlank : EBlockType::Wallstone);
+	}
+	CHECK(rowMatches);
+	CHECK(SameBlock(GetWorld().GetBlock(origin + CoordinateInBlocks(8, 0, 0)), EBlockType::Air));
+	CHECK(undoHistory.size() == 1);
+
+	// Two sand and a stone, looking down -Y: two copies along -Y, one along +X, filling a 2 x 3 grid of copies.
+	undoHistory.clear();
+	GetWorld().viewDirection = DirectionVectorInCentimeters(0.2f, -0.9f, -0.3f);
+	PlaceBlock(copyAt + CoordinateInBlocks(0, 0, 3), EBlockType::Stone);
+	HitBlock(copyAt, L"T_Pickaxe_Stone");
+	RunUntilIdle();
+	bool gridMatches = true;
+	for (int64_t y = -2; y <= 0; y++) {
+		for (int64_t x = 0; x < 4; x++) {
+			gridMatches = gridMatches && SameBlock(GetWorld().GetBlock(origin + CoordinateInBlocks(x, y, 0)), (x % 2 == 0) ? EBlockType::WoodPlank : EBlockType::Wallstone);
+		}
+	}
+	CHECK(gridMatches);
+	CHECK(BoxIs(origin + CoordinateInBlocks(0, -3, 0), origin + CoordinateInBlocks(3, -3, 0), EBlockType::Air));
+
+	// The whole grid is one undo entry, no larger than the blocks it replaced.
+	CHECK(undoHistory.size() == 1 && undoHistory.entries.front().blockCount == 8);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIs(origin + CoordinateInBlocks(0, -2, 0), origin + CoordinateInBlocks(3, -1, 0), EBlockType::Air));
+	CHECK(SameBlock(GetWorld().GetBlock(origin + CoordinateInBlocks(2, 0, 0)), EBlockType::WoodPlank));
+
+	// The shovel only reports.
+	uint64_t setBlockCalls = GetWorld().counters.setBlockCalls;
+	HitBlock(copyAt, L"T_Shovel_Stone");
+	RunUntilIdle();
+	CHECK(GetWorld().counters.setBlockCalls == setBlockCalls);
+}
+
+// The shape tests written out per voxel, which the row solve has to agree with exactly.
+bool InShape(ShapeKind Kind, int64_t SizeX, int64_t SizeY, int64_t SizeZ, int64_t X, int64_t Y, int64_t Z) {
+	if (X < 0 || Y < 0 || Z < 0 || X >= SizeX || Y >= SizeY || Z >= SizeZ) return false;
+	int64_t dx = 2 * X - (SizeX - 1);
+	int64_t dy = 2 * Y - (SizeY - 1);
+	int64_t dz = 2 * Z - (SizeZ - 1);
+	int64_t rx2 = SizeX * SizeX;
+	int64_t ry2 = SizeY * SizeY;
+	int64_t rz2 = SizeZ * SizeZ;
+	switch (Kind) {
+	case ShapeKind::Ellipsoid:
+		return dx * dx * ry2 * rz2 + dy * dy * rx2 * rz2 + dz * dz * rx2 * ry2 <= rx2 * ry2 * rz2;
+	case ShapeKind::Cylinder:
+		return dx * dx * ry2 + dy * dy * rx2 <= rx2 * ry2;
+	case ShapeKind::Cone: {
+		int64_t p = 2 * (SizeZ - 1 - Z) + 1;
+		int64_t q = 2 * SizeZ - 1;
+		return (dx * dx * ry2 + dy * dy * rx2) * q * q <= p * p * rx2 * ry2;
+	}
+	default:
+		return true;
+	}
+}
+
+bool InShell(ShapeKind Kind, int64_t SizeX, int64_t SizeY, int64_t SizeZ, int64_t X, int64_t Y, int64_t Z) {
+	if (!InShape(Kind, SizeX, SizeY, SizeZ, X, Y, Z)) return false;
+	const int64_t faces[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	for (const auto& face : faces) {
+		if (!InShape(Kind, SizeX, SizeY, SizeZ, X + face[0], Y + face[1], Z + face[2])) return true;
+	}
+	return false;
+}
+
+bool TableMatches(const ShapeSpanTable& Table) {
+	for (int64_t z = 0; z < Table.sizeZ; z++) {
+		for (int64_t y = 0; y < Table.sizeY; y++) {
+			const ShapeRow& row = Table.GetRow(y, z);
+			for (int64_t x = 0; x < Table.sizeX; x++) {
+				bool inTable = false;
+				for (uint8_t i = 0; i < row.count; i++) {
+					inTable = inTable || (x >= row.start[i] && x <= row.end[i]);
+				}
+				bool expected = Table.hollow ? InShell(Table.kind, Table.sizeX, Table.sizeY, Table.sizeZ, x, y, z) : InShape(Table.kind, Table.sizeX, Table.sizeY, Table.sizeZ, x, y, z);
+				if (inTable != expected) return false;
+			}
+		}
+	}
+	return true;
+}
+
+void CheckShapes() {
+	ResetSession();
+
+	const ShapeKind kinds[4] = { ShapeKind::Box, ShapeKind::Ellipsoid, ShapeKind::Cylinder, ShapeKind::Cone };
+	const int64_t sizes[4][3] = { { 9, 9, 9 }, { 9, 7, 5 }, { 1, 6, 4 }, { 16, 11, 13 } };
+	bool allMatch = true;
+	for (ShapeKind kind : kinds) {
+		for (const auto& size : sizes) {
+			for (bool hollow : { false, true }) {
+				allMatch = allMatch && TableMatches(ShapeSpanTable(kind, size[0], size[1], size[2], hollow));
+			}
+		}
+	}
+	CHECK(allMatch);
+	CHECK(ShapeSpanTable::IntegerSqrt(0) == 0 && ShapeSpanTable::IntegerSqrt(99) == 9 && ShapeSpanTable::IntegerSqrt((uint64_t(1) << 62) - 1) == (uint64_t(1) << 31) - 1);
+
+	// A hollow sphere painted with the arrow, in the air so every voxel starts out as air.
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	PlaceBlock(paintAt + CoordinateInBlocks(0, 0, 2), BlockInfo(AirFilter));
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 40);
+	marker1Cord = origin + CoordinateInBlocks(10, 10, 10);
+	marker2Cord = origin;
+	HitBlock(paintAt, L"T_Arrow");
+	RunUntilIdle();
+
+	bool worldMatches = true;
+	int64_t shellBlocks = 0;
+	for (int64_t z = 0; z < 11; z++) {
+		for (int64_t y = 0; y < 11; y++) {
+			for (int64_t x = 0; x < 11; x++) {
+				bool expected = InShell(ShapeKind::Ellipsoid, 11, 11, 11, x, y, z);
+				shellBlocks += expected ? 1 : 0;
+				BlockInfo block = GetWorld().GetBlock(origin + CoordinateInBlocks(x, y, int16_t(z)));
+				worldMatches = worldMatches && SameBlock(block, expected ? EBlockType::Sand : EBlockType::Air);
+			}
+		}
+	}
+	CHECK(worldMatches);
+	CHECK(undoHistory.size() == 1 && undoHistory.entries.front().blockCount == shellBlocks);
+
+	// Painting the same shape elsewhere reuses its table.
+	std::shared_ptr<ShapeTask> first = shapeSpanCache.Get(ShapeKind::Ellipsoid, 11, 11, 11, true, workerPool);
+	marker1Cord = origin + CoordinateInBlocks(40, 0, 0);
+	marker2Cord = origin + CoordinateInBlocks(50, 10, 10);
+	HitBlock(paintAt, L"T_Arrow");
+	RunUntilIdle();
+	CHECK(shapeSpanCache.Get(ShapeKind::Ellipsoid, 11, 11, 11, true, workerPool) == first);
+
+	UndoLastOperation(paintAt);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIs(origin, origin + CoordinateInBlocks(50, 10, 10), EBlockType::Air));
+}
+
+// The box and radius queries as they were written before the lazy ranges, voxel by voxel.
+std::vector<CoordinateInBlocks> GetReferenceCoordinates(CoordinateInBlocks At, CoordinateInBlocks Extent, int32_t Radius) {
+	std::vector<CoordinateInBlocks> coordinates;
+	for (int64_t x = -Extent.X; x < Extent.X; x++) {
+		for (int64_t y = -Extent.Y; y < Extent.Y; y++) {
+			for (int64_t z = -Extent.Z; z < Extent.Z; z++) {
+				CoordinateInBlocks offset = CoordinateInBlocks(x, y, int16_t(z));
+				if (At.Z + z < 0 || At.Z + z > 800) continue;
+				if (Radius > 0 && offset.GetLength() > Radius) continue;
+				coordinates.push_back(At + offset);
+			}
+		}
+	}
+	return coordinates;
+}
+
+void CheckCoordinateRanges() {
+	const CoordinateInBlocks centers[3] = { CoordinateInBlocks(10, -20, 400), CoordinateInBlocks(-5, 5, 2), CoordinateInBlocks(0, 0, 798) };
+	bool boxesMatch = true;
+	bool radiiMatch = true;
+	for (CoordinateInBlocks center : centers) {
+		CoordinateInBlocks extent = CoordinateInBlocks(3, 5, 4);
+		boxesMatch = boxesMatch && GetAllCoordinatesInBox(center, extent) == GetReferenceCoordinates(center, extent, 0);
+
+		for (int32_t radius : { 1, 2, 7 }) {
+			std::vector<CoordinateInBlocks> expected = GetReferenceCoordinates(center, CoordinateInBlocks(radius, radius, int16_t(radius)), radius);
+			CoordinateRange range = CoordinatesInRadius(center, radius);
+			std::vector<CoordinateInBlocks> iterated(range.begin(), range.end());
+			std::vector<CoordinateInBlocks> visited;
+			ForEachCoordinateInRadius(center, radius, [&visited](CoordinateInBlocks at) { visited.push_back(at); });
+			radiiMatch = radiiMatch && iterated == expected && visited == expected && range.size() == expected.size()
+				&& GetAllCoordinatesInRadius(center, radius) == expected;
+		}
+	}
+	CHECK(boxesMatch);
+	CHECK(radiiMatch);
+	CHECK(GetAllCoordinatesInBox(centers[0], CoordinateInBlocks(0, 4, 4)).empty());
+	CHECK(CoordinatesInRadius(centers[0], 0).begin() == CoordinatesInRadius(centers[0], 0).end());
+
+	// A large query counts and visits without storing anything.
+	size_t visited = 0;
+	ForEachCoordinateInBox(CoordinateInBlocks(0, 0, 400), CoordinateInBlocks(100, 100, 100), [&visited](CoordinateInBlocks) { visited++; });
+	CHECK(visited == size_t(200 * 200 * 200) && CoordinatesInBox(CoordinateInBlocks(0, 0, 400), CoordinateInBlocks(100, 100, 100)).size() == visited);
+}
+
+void CheckFloodFill() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+
+	// A bent line of 20 planks in the air: along +X, up, then along +Y. One more plank only touches it at an edge.
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 40);
+	for (int64_t x = 0; x < 10; x++) PlaceBlock(origin + CoordinateInBlocks(x, 0, 0), EBlockType::WoodPlank);
+	for (int16_t z = 1; z <= 5; z++) PlaceBlock(origin + CoordinateInBlocks(9, 0, z), EBlockType::WoodPlank);
+	for (int64_t y = 1; y <= 5; y++) PlaceBlock(origin + CoordinateInBlocks(9, y, 5), EBlockType::WoodPlank);
+	CoordinateInBlocks loose = origin + CoordinateInBlocks(0, 1, 1);
+	PlaceBlock(loose, EBlockType::WoodPlank);
+
+	selectionWandEnabled = true;
+	HitBlock(origin + CoordinateInBlocks(4, 0, 0), L"T_Shovel_Stone");
+	RunUntilIdle();
+	CHECK(voxelSelection != nullptr && voxelSelection->size() == 20 && !voxelSelection->Contains(loose));
+	CHECK(marker1Cord == origin && marker2Cord == origin + CoordinateInBlocks(9, 5, 5));
+
+	// Copying takes only the selected voxels; the paste leaves everything else where it lands alone.
+	CopyRegion(paintAt);
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(200, 100, 40);
+	PlaceBlock(pasteAt + CoordinateInBlocks(0, 1, 1), EBlockType::Stone);
+	PasteClipboard(pasteAt, false);
+	RunUntilIdle();
+	CHECK(BoxIs(pasteAt, pasteAt + CoordinateInBlocks(9, 0, 0), EBlockType::WoodPlank));
+	CHECK(BoxIs(pasteAt + CoordinateInBlocks(9, 1, 5), pasteAt + CoordinateInBlocks(9, 5, 5), EBlockType::WoodPlank));
+	CHECK(SameBlock(GetWorld().GetBlock(pasteAt + CoordinateInBlocks(0, 1, 1)), EBlockType::Stone));
+	CHECK(BoxIs(pasteAt + CoordinateInBlocks(0, 1, 0), pasteAt + CoordinateInBlocks(8, 5, 0), EBlockType::Air));
+
+	// Cutting clears the selection's voxels only.
+	CutRegion(paintAt, false);
+	RunUntilIdle();
+	CHECK(BoxIs(origin, origin + CoordinateInBlocks(9, 0, 0), EBlockType::Air));
+	CHECK(SameBlock(GetWorld().GetBlock(loose), EBlockType::WoodPlank));
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+
+	// Moving a marker keeps the selection; the axe on a marker clears it.
+	HitBlock(origin, L"T_Pickaxe_Stone");
+	CHECK(voxelSelection != nullptr);
+	selectionWandEnabled = false;
+	PlaceBlock(origin + CoordinateInBlocks(0, -10, 0), BlockInfo(Marker1Block));
+	HitBlock(origin + CoordinateInBlocks(0, -10, 0), L"T_Axe_Stone");
+	RunUntilIdle();
+	CHECK(voxelSelection == nullptr);
+
+	// With the exchanging wand the shovel replaces the connected planks with the paint target, as one undo entry.
+	exchangingWandEnabled = true;
+	size_t undoEntries = undoHistory.size();
+	HitBlock(origin + CoordinateInBlocks(9, 3, 5), L"T_Shovel_Stone");
+	RunUntilIdle();
+	CHECK(BoxIs(origin, origin + CoordinateInBlocks(9, 0, 0), EBlockType::Sand));
+	CHECK(BoxIs(origin + CoordinateInBlocks(9, 1, 5), origin + CoordinateInBlocks(9, 5, 5), EBlockType::Sand));
+	CHECK(SameBlock(GetWorld().GetBlock(loose), EBlockType::WoodPlank));
+	CHECK(undoHistory.size() == undoEntries + 1 && undoHistory.entries.front().blockCount == 20);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIs(origin, origin + CoordinateInBlocks(9, 0, 0), EBlockType::WoodPlank));
+	exchangingWandEnabled = false;
+
+	// With a mask, the fill goes through every block the mask accepts.
+	PlaceBlock(origin + CoordinateInBlocks(0, -1, 0), EBlockType::Wallstone);
+	PlaceBlock(origin + CoordinateInBlocks(0, -2, 0), EBlockType::Wallstone);
+	SetUpPalette(EBlockType::Sand, { EBlockType::WoodPlank, EBlockType::Wallstone });
+	FloodFill(origin, false);
+	RunUntilIdle();
+	CHECK(voxelSelection != nullptr && voxelSelection->size() == 22);
+
+	// The fill stops at its limit.
+	jobExecutor.Enqueue(std::make_unique<FloodFillJob>(origin, origin, BlockMask(), false, BlockInfo(), 7));
+	RunUntilIdle();
+	CHECK(voxelSelection != nullptr && voxelSelection->size() == 7);
+
+	// Filling a solid box reads each voxel inside it and on its faces once.
+	CoordinateInBlocks boxAt = CoordinateInBlocks(300, 100, 40);
+	BlockInfo replaced;
+	for (int16_t z = 0; z < 10; z++) {
+		for (int64_t y = 0; y < 10; y++) {
+			for (int64_t x = 0; x < 10; x++) GetWorld().SetBlock(boxAt + CoordinateInBlocks(x, y, z), EBlockType::Wallstone, replaced);
+		}
+	}
+	uint64_t readsBefore = blockCallCounters.getBlock;
+	jobExecutor.Enqueue(std::make_unique<FloodFillJob>(boxAt, boxAt, BlockMask(), false, BlockInfo(), FloodFillMaxBlocks));
+	RunUntilIdle();
+	CHECK(voxelSelection != nullptr && voxelSelection->size() == 1000);
+	CHECK(blockCallCounters.getBlock - readsBefore == 1 + 1000 + 6 * 100);
+
+	// Replacing reads each filled voxel once more as it writes it, with and without a mask.
+	readsBefore = blockCallCounters.getBlock;
+	jobExecutor.Enqueue(std::make_unique<FloodFillJob>(boxAt, boxAt, BlockMask(), true, BlockInfo(EBlockType::Sand), FloodFillMaxBlocks));
+	RunUntilIdle();
+	CHECK(BoxIs(boxAt, boxAt + CoordinateInBlocks(9, 9, 9), EBlockType::Sand));
+	CHECK(blockCallCounters.getBlock - readsBefore == 1 + 1000 + 6 * 100 + 1000);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIs(boxAt, boxAt + CoordinateInBlocks(9, 9, 9), EBlockType::Wallstone));
+
+	// A voxel the player changes after the fill read it is left as the player made it, and undo doesn't touch it.
+	jobExecutor.maxBlocksPerTick = 64;
+	std::unique_ptr<FloodFillJob> fill = std::make_unique<FloodFillJob>(boxAt, boxAt, BlockMask(), true, BlockInfo(EBlockType::Sand), FloodFillMaxBlocks);
+	FloodFillJob* running = fill.get();
+	jobExecutor.Enqueue(std::move(fill));
+	for (int i = 0; i < 3; i++) Event_Tick();
+	CHECK(running->filling && running->filled->Contains(boxAt));
+	GetWorld().SetBlock(boxAt, EBlockType::Stone, replaced);
+	jobExecutor.maxBlocksPerTick = JobMaxBlocksPerTick;
+	RunUntilIdle();
+	CHECK(SameBlock(GetWorld().GetBlock(boxAt), EBlockType::Stone) && BoxIs(boxAt + CoordinateInBlocks(1, 0, 0), boxAt + CoordinateInBlocks(9, 9, 9), EBlockType::Sand));
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(SameBlock(GetWorld().GetBlock(boxAt), EBlockType::Stone) && BoxIs(boxAt + CoordinateInBlocks(1, 0, 0), boxAt + CoordinateInBlocks(9, 9, 9), EBlockType::Wallstone));
+	GetWorld().SetBlock(boxAt, EBlockType::Wallstone, replaced);
+
+	for (int16_t z = 5; z < 10; z++) {
+		for (int64_t y = 0; y < 10; y++) {
+			for (int64_t x = 0; x < 10; x++) GetWorld().SetBlock(boxAt + CoordinateInBlocks(x, y, z), EBlockType::WoodPlank, replaced);
+		}
+	}
+	BlockMask mask = GetPaletteMask();
+	readsBefore = blockCallCounters.getBlock;
+	jobExecutor.Enqueue(std::make_unique<FloodFillJob>(boxAt, boxAt, mask, true, BlockInfo(EBlockType::Sand), FloodFillMaxBlocks));
+	RunUntilIdle();
+	CHECK(BoxIs(boxAt, boxAt + CoordinateInBlocks(9, 9, 9), EBlockType::Sand));
+	CHECK(blockCallCounters.getBlock - readsBefore == 1 + 1000 + 6 * 100 + 1000);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIs(boxAt, boxAt + CoordinateInBlocks(9, 9, 4), EBlockType::Wallstone));
+	CHECK(BoxIs(boxAt + CoordinateInBlocks(0, 0, 5), boxAt + CoordinateInBlocks(9, 9, 9), EBlockType::WoodPlank));
+
+	// The set stores bits in chunks, across negative coordinates as well.
+	VoxelSet set;
+	CoordinateInBlocks corners[3] = { CoordinateInBlocks(-1, -33, 0), CoordinateInBlocks(31, 32, 799), CoordinateInBlocks(-100000, 5000, 64) };
+	for (CoordinateInBlocks at : corners) set.Insert(at);
+	CHECK(set.size() == 3 && set.Contains(corners[0]) && set.Contains(corners[2]) && !set.Contains(CoordinateInBlocks(0, -33, 0)));
+	std::vector<CoordinateInBlocks> found;
+	for (CoordinateInBlocks corner : set.GetChunkCorners()) {
+		set.ForEachInChunk(corner, [&found](CoordinateInBlocks at) { found.push_back(at); });
+	}
+	CHECK(found.size() == 3 && found[0] == corners[0] && found[1] == corners[1] && found[2] == corners[2]);
+}
+
+void CheckReplace() {
+	ResetSession();
+	// Pairs: stone to wallstone, grass to sand, air to dirt, a Cut block to glass. The last stone has no pair.
+	SetUpPalette(EBlockType::Sand, { EBlockType::Stone, EBlockType::Wallstone, EBlockType::Grass, EBlockType::Sand,
+		BlockInfo(AirFilter), EBlockType::Dirt, BlockInfo(CutBlock), EBlockType::GlassBlock, EBlockType::Stone });
+	SetMarkers(CoordinateInBlocks(0, 0, 25), CoordinateInBlocks(20, 20, 35));
+	CoordinateInBlocks maskAt = maskCord;
+	PlaceBlock(CoordinateInBlocks(10, 10, 33), BlockInfo(CutBlock));
+	PlaceBlock(CoordinateInBlocks(11, 10, 33), EBlockType::TreeWood);
+
+	HitBlock(maskAt, L"T_Shovel_Stone");
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 25), CoordinateInBlocks(19, 19, 30), EBlockType::Stone));
+	CHECK(undoHistory.empty());
+
+	HitBlock(maskAt, L"T_Axe_Stone");
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 25), CoordinateInBlocks(19, 19, 30), EBlockType::Wallstone));
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 31), CoordinateInBlocks(19, 19, 31), EBlockType::Sand));
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 34), CoordinateInBlocks(19, 19, 35), EBlockType::Dirt));
+	CHECK(SameBlock(GetWorld().GetBlock(CoordinateInBlocks(10, 10, 33)), EBlockType::GlassBlock));
+	CHECK(SameBlock(GetWorld().GetBlock(CoordinateInBlocks(11, 10, 33)), EBlockType::TreeWood));
+	CHECK(undoHistory.size() == 1);
+
+	UndoLastOperation(maskAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 1, 25), CoordinateInBlocks(19, 19, 32)));
+	CHECK(GetWorld().GetBlock(CoordinateInBlocks(10, 10, 33)).CustomBlockID == CutBlock);
+
+	// A table with many custom rules still finds every one of them, and a later rule for a block wins.
+	ReplaceTable table;
+	for (UniqueID id = 1; id <= 1000; id++) table.Add(BlockInfo(int(id)), EBlockType::Stone);
+	table.Add(BlockInfo(500), EBlockType::Sand);
+	table.Add(EBlockType::Dirt, EBlockType::Grass);
+	CHECK(table.customTargets.count == 1000);
+	CHECK(table.Find(BlockInfo(1)) != nullptr && SameBlock(*table.Find(BlockInfo(1000)), EBlockType::Stone));
+	CHECK(SameBlock(*table.Find(BlockInfo(500)), EBlockType::Sand) && table.Find(BlockInfo(1001)) == nullptr);
+	BlockInfo row[3] = { BlockInfo(7), EBlockType::Dirt, EBlockType::Stone };
+	BlockInfo replaced[3];
+	CHECK(table.ReplaceRow(row, 3, replaced) == 3 && SameBlock(replaced[1], EBlockType::Grass));
+}
+
+void CheckInstrumentation() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	SetMarkers(CoordinateInBlocks(0, 0, 30), CoordinateInBlocks(19, 9, 39));
+	marker1Cord = CoordinateInBlocks(0, 0, 30);
+	marker2Cord = CoordinateInBlocks(19, 9, 39);
+
+	HostCounters before = GetWorld().counters;
+	PaintArea(GetBlockAbove(paintAt), false);
+	RunUntilIdle();
+	HostCounters after = GetWorld().counters;
+	CHECK(operationTracer.GetSpans().size() == 1);
+	const OperationSpan& paint = operationTracer.GetSpans().back();
+	CHECK(paint.name == L"Painting Area" && paint.visitedBlocks == 2000 && paint.changedBlocks == 2000);
+	CHECK(paint.setBlockCalls == after.setBlockCalls - before.setBlockCalls && paint.setBlockCalls == 2000);
+	// Reading the palette happens before the job starts, so it isn't part of the span. Checking the markers are loaded is.
+	CHECK(paint.getBlockCalls == 2002 && after.getBlockCalls - before.getBlockCalls > 2002);
+	CHECK(!paint.slices.empty() && paint.endMicroseconds >= paint.startMicroseconds && paint.historyBytes == undoHistory.usedBytes);
+
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(operationTracer.GetSpans().back().name == L"Undoing Operation" && operationTracer.GetSpans().back().changedBlocks == 2000);
+
+	CHECK(WriteOperationTrace());
+	std::filesystem::path tracePath = std::filesystem::path(GetThisModSaveFolderPath(L"CyubePainter")) / TraceFileName;
+	std::ifstream file(tracePath);
+	std::string trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	CHECK(trace.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+	CHECK(trace.find("\"name\":\"Painting Area\"") != std::string::npos && trace.find("\"name\":\"Undoing Operation\"") != std::string::npos);
+	CHECK(trace.find("\"ph\":\"C\"") != std::string::npos && trace.size() > 2 && trace.substr(trace.size() - 3) == "]}\n");
+
+	// A new world starts with no spans.
+	Event_OnLoad(true);
+	CHECK(operationTracer.GetSpans().empty());
+}
+
+// Drops the queued jobs and loads the world again without Event_OnExit, as if the game had crashed.
+void SimulateCrash() {
+	jobExecutor = JobExecutor(JobFrameBudgetMilliseconds, JobMaxBlocksPerTick);
+	operationJournal.Close();
+	Event_OnLoad(false);
+}
+
+void CheckJournal() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	std::filesystem::path journalPath = std::filesystem::path(GetThisModSaveFolderPath(L"CyubePainter")) / JournalFileName;
+
+	// Two paints and an undo finish; a third paint is cut off after a few batches.
+	SetMarkers(CoordinateInBlocks(0, 0, 20), CoordinateInBlocks(10, 10, 25));
+	PaintArea(paintAt, false);
+	RunUntilIdle();
+	SetMarkers(CoordinateInBlocks(20, 0, 20), CoordinateInBlocks(30, 10, 25));
+	PaintArea(paintAt, false);
+	RunUntilIdle();
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(21, 1, 20), CoordinateInBlocks(29, 9, 25)));
+
+	SetMarkers(CoordinateInBlocks(0, 40, 16), CoordinateInBlocks(63, 103, 31));
+	jobExecutor.maxBlocksPerTick = 5000;
+	PaintArea(paintAt, false);
+	for (int i = 0; i < 3; i++) Event_Tick();
+	CHECK(!jobExecutor.IsIdle() && operationJournal.HasOpenOperation());
+	operationJournal.Checkpoint();
+	CHECK(!BoxIsGenerated(CoordinateInBlocks(1, 41, 16), CoordinateInBlocks(62, 102, 31)));
+
+	// A write torn by the crash is ignored.
+	{
+		std::ofstream torn(journalPath, std::ios::binary | std::ios::app);
+		torn.write("\x40\0\0\0garbage", 11);
+	}
+	SimulateCrash();
+	CHECK(undoHistory.size() == 1 && redoHistory.size() == 1 && journalRollbackPending);
+	RunUntilIdle();
+	CHECK(!journalRollbackPending);
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 41, 16), CoordinateInBlocks(62, 102, 31)));
+	CHECK(BoxIs(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(9, 9, 25), EBlockType::Sand));
+	CHECK(OperationJournal::Read(journalPath).empty());
+
+	// The rebuilt histories were saved, so they survive another crash, and they undo and redo as before.
+	SimulateCrash();
+	RedoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(21, 1, 20), CoordinateInBlocks(29, 9, 25), EBlockType::Sand));
+	UndoLastOperation(paintAt);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(29, 9, 25)));
+
+	// Leaving the world in the middle of an operation keeps only that operation, which the next load rolls back.
+	SetMarkers(CoordinateInBlocks(0, 40, 16), CoordinateInBlocks(63, 103, 31));
+	jobExecutor.maxBlocksPerTick = 5000;
+	PaintArea(paintAt, false);
+	for (int i = 0; i < 3; i++) Event_Tick();
+	jobExecutor = JobExecutor(JobFrameBudgetMilliseconds, JobMaxBlocksPerTick);
+	Event_OnExit();
+	JournalContents left = OperationJournal::Read(journalPath);
+	CHECK(left.finished.empty() && left.unfinishedBlocks > 0);
+	Event_OnLoad(false);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 41, 16), CoordinateInBlocks(62, 102, 31)));
+	CHECK(redoHistory.size() == 2);
+
+	// An operation that finishes while a crashed one is still to be rolled back leaves that rollback in the journal.
+	SetMarkers(CoordinateInBlocks(0, 40, 16), CoordinateInBlocks(63, 103, 31));
+	jobExecutor.maxBlocksPerTick = 5000;
+	PaintArea(paintAt, false);
+	for (int i = 0; i < 3; i++) Event_Tick();
+	operationJournal.Checkpoint();
+	SimulateCrash();
+	CHECK(journalRollbackPending);
+	jobExecutor = JobExecutor(JobFrameBudgetMilliseconds, JobMaxBlocksPerTick);
+	SetMarkers(CoordinateInBlocks(100, 0, 20), CoordinateInBlocks(110, 10, 25));
+	PaintArea(paintAt, false);
+	RunUntilIdle();
+	left = OperationJournal::Read(journalPath);
+	CHECK(left.finished.size() == 1 && left.unfinishedBlocks > 0);
+	SimulateCrash();
+	RunUntilIdle();
+	CHECK(!journalRollbackPending && undoHistory.size() == 1);
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 41, 16), CoordinateInBlocks(62, 102, 31)));
+	CHECK(BoxIs(CoordinateInBlocks(101, 1, 20), CoordinateInBlocks(109, 9, 25), EBlockType::Sand));
+}
+
+void CheckHistorySpill() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	// Only the newest entry of each history stays in memory.
+	undoHistory.residentBudgetBytes = 1;
+	redoHistory.residentBudgetBytes = 1;
+	std::filesystem::path spillPath = std::filesystem::path(GetThisModSaveFolderPath(L"CyubePainter")) / UndoSpillFileName;
+
+	for (int64_t i = 0; i < 4; i++) {
+		SetMarkers(CoordinateInBlocks(i * 20, 0, 20), CoordinateInBlocks(i * 20 + 10, 10, 25));
+		PaintArea(paintAt, false);
+		RunUntilIdle();
+	}
+	CHECK(undoHistory.size() == 4 && undoHistory.GetSpilledCount() == 3 && undoHistory.spilledBytes > 0);
+	CHECK(!undoHistory.entries.back().spilled || undoHistory.entries.back().data.empty());
+	CHECK(!undoHistory.entries.front().spilled && std::filesystem::file_size(spillPath) == undoHistory.GetSpillFileBytes());
+
+	// Undoing reads the spilled entries back through the mapping, and the redo entries spill in turn.
+	for (int i = 0; i < 4; i++) UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(69, 9, 25)));
+	CHECK(undoHistory.empty() && undoHistory.spilledBytes == 0);
+	CHECK(redoHistory.size() == 4 && redoHistory.GetSpilledCount() == 3);
+	for (int i = 0; i < 4; i++) RedoLastOperation(paintAt);
+	RunUntilIdle();
+	for (int64_t i = 0; i < 4; i++) {
+		CHECK(BoxIs(CoordinateInBlocks(i * 20 + 1, 1, 20), CoordinateInBlocks(i * 20 + 9, 9, 25), EBlockType::Sand));
+	}
+
+	// Spilled entries are saved with the rest, and all but the newest spill again when the histories are loaded.
+	Event_OnExit();
+	Event_OnLoad(false);
+	for (int i = 0; i < 2; i++) UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(undoHistory.size() == 2 && undoHistory.GetSpilledCount() == 2);
+	for (int i = 0; i < 2; i++) UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(1, 1, 20), CoordinateInBlocks(69, 9, 25)));
+
+	undoHistory.residentBudgetBytes = UndoHistoryResidentBytes;
+	redoHistory.residentBudgetBytes = UndoHistoryResidentBytes;
+}
+
+// Ticks idle until the deferred write queue has been checked for loaded chunks, then runs what that queued.
+void FlushDeferred() {
+	for (int i = 0; i < DeferredCheckTicks; i++) Event_Tick();
+	RunUntilIdle();
+}
+
+void CheckDeferredWrites() {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	// Chunks -2..2 are loaded around the player, so blocks with x >= 96 are not.
+	int64_t loadedRadius = GetWorld().loadedRadius;
+	GetWorld().loadedRadius = 64;
+
+	SetMarkers(CoordinateInBlocks(0, 0, 40), CoordinateInBlocks(39, 9, 45));
+	PaintArea(paintAt, false);
+	RunUntilIdle();
+	CopyRegion(paintAt);
+	RunUntilIdle();
+
+	// The paste runs 16 blocks into loaded space and 24 past it; the rest is queued per chunk.
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(80, 0, 40);
+	PasteClipboard(pasteAt, false);
+	RunUntilIdle();
+	CHECK(BoxIs(CoordinateInBlocks(80, 1, 40), CoordinateInBlocks(95, 9, 45), EBlockType::Sand));
+	CHECK(deferredWrites.size() == 24 * 10 * 6 && deferredWrites.GetChunkCount() == 1);
+	CHECK(undoHistory.entries.front().blockCount == 16 * 10 * 6);
+	CHECK(GetWorld().hintLog.back().find(L"1440 blocks wait for their chunks to load") != wString::npos);
+
+	// Nothing is written while the chunks stay out of range.
+	FlushDeferred();
+	CHECK(deferredWrites.size() == 1440);
+
+	// The queue survives leaving and loading the world.
+	Event_OnExit();
+	Event_OnLoad(false);
+	CHECK(deferredWrites.size() == 1440);
+
+	// Walking over brings the chunks in, and the queued blocks are written as an undo entry of their own.
+	GetWorld().SetPlayerBlockLocation(CoordinateInBlocks(100, 0, 40));
+	FlushDeferred();
+	CHECK(deferredWrites.empty());
+	CHECK(BoxIs(CoordinateInBlocks(96, 1, 40), CoordinateInBlocks(119, 9, 45), EBlockType::Sand));
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(96, 0, 40), CoordinateInBlocks(119, 9, 45)));
+	CHECK(BoxIs(CoordinateInBlocks(80, 1, 40), CoordinateInBlocks(95, 9, 45), EBlockType::Sand));
+
+	// A full queue refuses the rest and says so.
+	GetWorld().SetPlayerBlockLocation(CoordinateInBlocks(0, 0, 40));
+	deferredWrites.maxBytes = 100 * sizeof(DeferredWrite);
+	PasteClipboard(pasteAt, false);
+	RunUntilIdle();
+	CHECK(deferredWrites.size() == 100);
+	CHECK(GetWorld().hintLog.back().find(L"1340 blocks were not written") != wString::npos);
+
+	// Undoing an operation takes back the writes it queued, also after a reload, and leaves the others' alone.
+	// The loaded part is Sand already, so both pastes only queued writes.
+	deferredWrites.maxBytes = DeferredWriteBudgetBytes;
+	PasteClipboard(pasteAt, false);
+	RunUntilIdle();
+	CHECK(deferredWrites.size() == 1540);
+	Event_OnExit();
+	Event_OnLoad(false);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(deferredWrites.size() == 100);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(deferredWrites.empty());
+	GetWorld().SetPlayerBlockLocation(CoordinateInBlocks(100, 0, 40));
+	FlushDeferred();
+	CHECK(BoxIsGenerated(CoordinateInBlocks(96, 0, 40), CoordinateInBlocks(119, 9, 45)));
+	CHECK(BoxIs(CoordinateInBlocks(80, 1, 40), CoordinateInBlocks(95, 9, 45), EBlockType::Sand));
+
+	GetWorld().SetPlayerBlockLocation(CoordinateInBlocks(0, 0, 40));
+	GetWorld().loadedRadius = loadedRadius;
+}
+
+void CheckWorkerPool() {
+	// The ring hands values over in order and refuses to overfill.
+	SpscQueue<int, 4> ring;
+	bool pushed = true;
+	for (int i = 0; i < 4; i++) pushed = pushed && ring.TryPush(int(i));
+	CHECK(pushed && !ring.TryPush(4));
+	int value = -1;
+	bool inOrder = true;
+	for (int i = 0; i < 4; i++) inOrder = inOrder && ring.TryPop(value) && value == i;
+	CHECK(inOrder && !ring.TryPop(value));
+
+	// Tasks only count as ready once the game thread has drained them, and tasks a worker queues get stolen.
+	CHECK(workerPool.IsRunning() && workerPool.GetThreadCount() == WorkerThreadCount);
+	std::atomic<int> ran{ 0 };
+	auto outer = workerPool.Run<int>([&ran]() {
+		for (int i = 0; i < 64; i++) {
+			workerPool.Submit([&ran]() { ran++; });
+		}
+		return 7;
+	});
+	outer->Wait();
+	while (ran.load() < 64) std::this_thread::yield();
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	workerPool.DrainCompletions();
+	CHECK(outer->IsReady() && outer->Get() == 7);
+
+	// Without threads a task runs inline.
+	workerPool.Shutdown();
+	CHECK(!workerPool.IsRunning());
+	auto inline_ = workerPool.Run<int>([]() { return 3; });
+	CHECK(inline_->IsReady() && inline_->Get() == 3);
+	workerPool.Start(WorkerThreadCount);
+
+	// A paint's undo entry is encoded on a worker, and the job only completes once it's back.
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	CoordinateInBlocks corner1 = CoordinateInBlocks(0, 300, 40);
+	CoordinateInBlocks corner2 = CoordinateInBlocks(63, 363, 55);
+	SetMarkers(corner1, corner2);
+	HitBlock(paintAt, L"T_Stick");
+	CHECK(undoHistory.empty());
+	RunUntilIdle();
+	CHECK(undoHistory.size() == 1);
+	CHECK(BoxIs(corner1 + CoordinateInBlocks(1, 1, 1), corner2 - CoordinateInBlocks(1, 1, 1), EBlockType::Sand));
+
+	// Leaving the world waits for the pool; loading starts it again.
+	Event_OnExit();
+	CHECK(!workerPool.IsRunning());
+	Event_OnLoad(false);
+	CHECK(workerPool.IsRunning());
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(corner1 + CoordinateInBlocks(1, 1, 1), corner2 - CoordinateInBlocks(1, 1, 1)));
+}
+
+// How many voxels of the box the set holds, tested one by one.
+int64_t CountInBox(const VoxelSet& Set, CoordinateInBlocks Corner1, CoordinateInBlocks Corner2) {
+	int64_t count = 0;
+	for (int16_t z = Corner1.Z; z <= Corner2.Z; z++) {
+		for (int64_t y = Corner1.Y; y <= Corner2.Y; y++) {
+			for (int64_t x = Corner1.X; x <= Corner2.X; x++) count += Set.Contains(CoordinateInBlocks(x, y, z)) ? 1 : 0;
+		}
+	}
+	return count;
+}
+
+void CheckSelections() {
+	// Boxes go in and out a chunk row at a time, across chunks and negative coordinates, and the bounds follow.
+	VoxelSet set;
+	set.InsertBox(CoordinateInBlocks(40, 5, 12), CoordinateInBlocks(-40, -3, 10));
+	CHECK(set.size() == 81 * 9 * 3 && CountInBox(set, CoordinateInBlocks(-41, -4, 9), CoordinateInBlocks(41, 6, 13)) == 81 * 9 * 3);
+	CHECK(set.GetMinCorner() == CoordinateInBlocks(-40, -3, 10) && set.GetMaxCorner() == CoordinateInBlocks(40, 5, 12));
+	VoxelSet copy = set;
+	set.EraseBox(CoordinateInBlocks(-5, -3, 10), CoordinateInBlocks(5, 5, 12));
+	CHECK(set.size() == 70 * 9 * 3 && !set.Contains(CoordinateInBlocks(0, 0, 11)) && set.Contains(CoordinateInBlocks(6, 0, 11)));
+	CHECK(copy.size() == 81 * 9 * 3 && copy.Contains(CoordinateInBlocks(0, 0, 11)));
+	set.EraseBox(CoordinateInBlocks(-40, -3, 10), CoordinateInBlocks(5, 5, 12));
+	CHECK(set.GetMinCorner() == CoordinateInBlocks(6, -3, 10) && set.GetMaxCorner() == CoordinateInBlocks(40, 5, 12));
+	CHECK(set.GetChunkCorners().size() == 4);
+
+	// Shifted copies keep their shape wherever they land in the chunk grid.
+	VoxelSet shifted;
+	shifted.InsertSet(set, CoordinateInBlocks(-17, 3, 1));
+	CHECK(shifted.size() == set.size() && shifted.Contains(CoordinateInBlocks(6 - 17, 0, 12)) && !shifted.Contains(CoordinateInBlocks(5 - 17, 0, 12)));
+
+	// An L-shaped polygon, extruded over two layers, holds its edges as well as its inside.
+	VoxelSet prism;
+	const std::vector<CoordinateInBlocks> outline = { CoordinateInBlocks(0, 0, 0), CoordinateInBlocks(10, 0, 0), CoordinateInBlocks(10, 4, 0),
+		CoordinateInBlocks(4, 4, 0), CoordinateInBlocks(4, 10, 0), CoordinateInBlocks(0, 10, 0) };
+	prism.InsertPrism(outline, 20, 21);
+	CHECK(prism.size() == 2 * (11 * 5 + 5 * 6));
+	CHECK(prism.Contains(CoordinateInBlocks(10, 4, 21)) && prism.Contains(CoordinateInBlocks(4, 10, 20)) && !prism.Contains(CoordinateInBlocks(5, 5, 20)));
+
+	// A selection of two overlapping boxes with a hole is painted as one undo entry, reading only its own voxels.
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	CoordinateInBlocks origin = CoordinateInBlocks(0, 500, 40);
+	marker1Cord = origin;
+	marker2Cord = origin + CoordinateInBlocks(39, 9, 4);
+	SelectMarkerBox(paintAt, false);
+	marker1Cord = origin + CoordinateInBlocks(0, 10, 0);
+	marker2Cord = origin + CoordinateInBlocks(9, 39, 4);
+	SelectMarkerBox(paintAt, false);
+	marker1Cord = origin + CoordinateInBlocks(2, 2, 0);
+	marker2Cord = origin + CoordinateInBlocks(3, 3, 4);
+	SelectMarkerBox(paintAt, true);
+	RunUntilIdle();
+	int64_t selected = 40 * 10 * 5 + 10 * 30 * 5 - 2 * 2 * 5;
+	CHECK(voxelSelection != nullptr && int64_t(voxelSelection->size()) == selected);
+
+	HitBlock(paintAt, L"T_Stick");
+	uint64_t readsBefore = blockCallCounters.getBlock;
+	RunUntilIdle();
+	CHECK(int64_t(blockCallCounters.getBlock - readsBefore) == selected);
+	CHECK(undoHistory.size() == 1 && undoHistory.entries.front().blockCount == selected);
+	CHECK(BoxIs(origin + CoordinateInBlocks(4, 0, 0), origin + CoordinateInBlocks(39, 9, 4), EBlockType::Sand));
+	CHECK(BoxIs(origin + CoordinateInBlocks(0, 10, 0), origin + CoordinateInBlocks(9, 39, 4), EBlockType::Sand));
+	CHECK(BoxIsGenerated(origin + CoordinateInBlocks(2, 2, 0), origin + CoordinateInBlocks(3, 3, 4)));
+	CHECK(BoxIsGenerated(origin + CoordinateInBlocks(10, 10, 0), origin + CoordinateInBlocks(39, 39, 4)));
+
+	// Stacking the selection copies only its voxels.
+	PlaceBlock(CoordinateInBlocks(-20, -30, 40), BlockInfo(CopyBlock));
+	PlaceBlock(CoordinateInBlocks(-20, -30, 41), EBlockType::Stone);
+	GetWorld().viewDirection = DirectionVectorInCentimeters(1, 0, 0);
+	HitBlock(CoordinateInBlocks(-20, -30, 40), L"T_Pickaxe_Stone");
+	RunUntilIdle();
+	CHECK(undoHistory.size() == 2 && undoHistory.entries.front().blockCount == selected);
+	CHECK(BoxIs(origin + CoordinateInBlocks(44, 0, 0), origin + CoordinateInBlocks(79, 9, 4), EBlockType::Sand));
+	CHECK(BoxIsGenerated(origin + CoordinateInBlocks(42, 2, 0), origin + CoordinateInBlocks(43, 3, 4)));
+	CHECK(BoxIsGenerated(origin + CoordinateInBlocks(50, 10, 0), origin + CoordinateInBlocks(79, 39, 4)));
+	UndoLastOperation(paintAt);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(origin, origin + CoordinateInBlocks(79, 39, 4)));
+
+	// Polygons are outlined with the selection wand's arrow and extruded between the markers' heights.
+	// The wand stays on while the Markers block is hit, which must not add the block as another corner.
+	ClearSelection(paintAt);
+	selectionWandEnabled = true;
+	CoordinateInBlocks polygonAt = CoordinateInBlocks(100, 500, 40);
+	for (const CoordinateInBlocks& corner : outline) {
+		HitBlock(polygonAt + corner, L"T_Arrow");
+	}
+	SetMarkers(polygonAt + CoordinateInBlocks(-5, -5, 0), polygonAt + CoordinateInBlocks(-5, -7, 1));
+	HitBlock(polygonAt + CoordinateInBlocks(-5, -5, 0), L"T_Arrow");
+	CHECK(selectionPolygon.empty());
+	RunUntilIdle();
+	selectionWandEnabled = false;
+	CHECK(selectionPolygon.empty() && voxelSelection != nullptr && voxelSelection->size() == prism.size());
+
+	// What the mask accepts in the marker box is selected too, and a cut only clears the selection.
+	CoordinateInBlocks planks = polygonAt + CoordinateInBlocks(20, 0, 0);
+	for (int64_t x = 0; x < 6; x++) PlaceBlock(planks + CoordinateInBlocks(x * 2, 0, 0), EBlockType::WoodPlank);
+	SetUpPalette(EBlockType::Sand, { EBlockType::WoodPlank });
+	SetMarkers(planks + CoordinateInBlocks(0, 2, 0), planks + CoordinateInBlocks(11, -1, 1));
+	HitBlock(planks + CoordinateInBlocks(0, 2, 0), L"T_Pickaxe_Stone");
+	RunUntilIdle();
+	CHECK(voxelSelection != nullptr && voxelSelection->size() == prism.size() + 6);
+	CutRegion(paintAt, false);
+	RunUntilIdle();
+	CHECK(undoHistory.entries.front().blockCount == 6);
+	CHECK(BoxIs(planks, planks + CoordinateInBlocks(11, 0, 0), EBlockType::Air));
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(SameBlock(GetWorld().GetBlock(planks + CoordinateInBlocks(10, 0, 0)), EBlockType::WoodPlank));
+
+	// Taking out everything empties the selection, and the marker box is used again.
+	SetMarkers(planks + CoordinateInBlocks(0, 2, 0), planks + CoordinateInBlocks(11, -1, 1));
+	HitBlock(planks + CoordinateInBlocks(11, -1, 1), L"T_Stick");
+	SetMarkers(polygonAt, polygonAt + CoordinateInBlocks(10, 10, 1));
+	HitBlock(polygonAt + CoordinateInBlocks(10, 10, 1), L"T_Stick");
+	RunUntilIdle();
+	CHECK(voxelSelection == nullptr);
+}
+
+void CheckSelectionAtJobStart() {
+	// Region jobs look at the selection once they start, so a paint queued behind clearing it uses the marker box.
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	CoordinateInBlocks selectedAt = CoordinateInBlocks(0, 0, 40);
+	CoordinateInBlocks boxAt = CoordinateInBlocks(10, 0, 40);
+	marker1Cord = selectedAt;
+	marker2Cord = selectedAt + CoordinateInBlocks(3, 3, 0);
+	SelectMarkerBox(paintAt, false);
+	RunUntilIdle();
+
+	ClearSelection(paintAt);
+	marker1Cord = boxAt;
+	marker2Cord = boxAt + CoordinateInBlocks(3, 3, 0);
+	PaintArea(paintAt, false);
+	RunUntilIdle();
+	CHECK(BoxIsGenerated(selectedAt, selectedAt + CoordinateInBlocks(3, 3, 0)));
+	CHECK(BoxIs(boxAt, boxAt + CoordinateInBlocks(3, 3, 0), EBlockType::Sand));
+
+	// A copy queued behind selecting a box copies only that box, not the marker box it was queued with.
+	SelectMarkerBox(paintAt, false);
+	marker1Cord = selectedAt;
+	marker2Cord = selectedAt + CoordinateInBlocks(7, 7, 0);
+	CopyRegion(paintAt);
+	RunUntilIdle();
+	CHECK(voxelSelection != nullptr && clipboard.sizeX == 4 && clipboard.sizeY == 4 && clipboard.sizeZ == 1);
+	CHECK(SameBlock(clipboard.Get(0), EBlockType::Sand));
+}
+
+void CheckInventory() {
+	ResetSession();
+	ChargeInventory = true;
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	World& world = GetWorld();
+	auto count = [&world](EBlockType type) { return world.inventory[uint64_t(type)]; };
+
+	// 300 stone, 100 grass and 200 air. The whole box is billed in one call per block.
+	marker1Cord = CoordinateInBlocks(0, 0, 28);
+	marker2Cord = CoordinateInBlocks(9, 9, 33);
+	HitBlock(paintAt, L"T_Shovel_Stone");
+	RunUntilIdle();
+	CHECK(world.inventory.empty() && world.counters.inventoryCalls == 0);
+	CHECK(world.hintLog.back().find(L"Sand x600") != wString::npos && world.hintLog.back().find(L"Stone +300 back") != wString::npos);
+
+	HitBlock(paintAt, L"T_Stick");
+	RunUntilIdle();
+	CHECK(count(EBlockType::Sand) == -600 && count(EBlockType::Stone) == 300 && count(EBlockType::Grass) == 100);
+	CHECK(count(EBlockType::Air) == 0 && world.counters.inventoryCalls == 3);
+
+	// Undoing gives it all back.
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(count(EBlockType::Sand) == 0 && count(EBlockType::Stone) == 0 && count(EBlockType::Grass) == 0);
+	CHECK(world.counters.inventoryCalls == 6);
+
+	// Redo takes the blocks again. Undo gives back exactly what was charged, also after a reload
+	// and with part of the box changed since, which the reversal then leaves alone.
+	RedoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(count(EBlockType::Sand) == -600 && count(EBlockType::Stone) == 300 && count(EBlockType::Grass) == 100);
+	CHECK(world.counters.inventoryCalls == 9);
+	Event_OnExit();
+	Event_OnLoad(false);
+	for (int64_t x = 0; x < 10; x++) SetBlock(CoordinateInBlocks(x, 0, 33), EBlockType::Air);
+	UndoLastOperation(paintAt);
+	RunUntilIdle();
+	CHECK(count(EBlockType::Sand) == 0 && count(EBlockType::Stone) == 0 && count(EBlockType::Grass) == 0);
+	CHECK(world.counters.inventoryCalls == 12);
+
+	// A cut refunds what it clears, the bill of materials lists the clipboard, and pasting it takes the blocks again.
+	PlaceBlock(paintAt + CoordinateInBlocks(4, 0, 2), BlockInfo(CutBlock));
+	HitBlock(paintAt + CoordinateInBlocks(4, 0, 2), L"T_Stick");
+	RunUntilIdle();
+	CHECK(count(EBlockType::Stone) == 300 && count(EBlockType::Grass) == 100);
+
+	PlaceBlock(paintAt + CoordinateInBlocks(6, 0, 2), BlockInfo(CopyBlock));
+	HitBlock(paintAt + CoordinateInBlocks(6, 0, 2), L"T_Axe_Stone");
+	RunUntilIdle();
+	CHECK(world.hintLog.back().find(L"Stone x300\nGrass x100") != wString::npos);
+	CHECK(count(EBlockType::Stone) == 300);
+
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(100, 100, 40);
+	Event_BlockHitByTool(pasteAt, PasteBlock, L"T_Stick", CoordinateInCentimeters(pasteAt), false);
+	RunUntilIdle();
+	CHECK(BoxIs(pasteAt, pasteAt + CoordinateInBlocks(9, 9, 2), EBlockType::Stone));
+	CHECK(count(EBlockType::Stone) == 0 && count(EBlockType::Grass) == 0 && world.counters.inventoryCalls == 16);
+
+	ChargeInventory = false;
+}
+
+void CheckSharedClipboard() {
+	ResetSession();
+	ShareClipboard = true;
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+
+	// A copy is published once the copy job is done, and readers share the one buffer.
+	CoordinateInBlocks origin = CoordinateInBlocks(100, 100, 40);
+	for (int64_t x = 0; x < 4; x++) PlaceBlock(origin + CoordinateInBlocks(x, 0, 0), EBlockType::WoodPlank);
+	PlaceBlock(origin + CoordinateInBlocks(0, 1, 0), EBlockType::Wallstone);
+	marker1Cord = origin;
+	marker2Cord = origin + CoordinateInBlocks(3, 1, 0);
+	PlaceBlock(paintAt + CoordinateInBlocks(4, 0, 2), BlockInfo(CopyBlock));
+	HitBlock(paintAt + CoordinateInBlocks(4, 0, 2), L"T_Stick");
+	RunUntilIdle();
+	CHECK(SharedClipboard::GetPublishedVersion(SharedClipboardKey) == 1);
+
+	std::shared_ptr<SharedClipboard> first = SharedClipboard::Acquire(SharedClipboardKey);
+	std::shared_ptr<SharedClipboard> again = SharedClipboard::Acquire(SharedClipboardKey);
+	CHECK(first != nullptr && again != nullptr && first->buffer == again->buffer && first->buffer->references == 3);
+	CHECK(first->view.sizeX == 4 && first->view.sizeY == 2 && first->view.sizeZ == 1);
+	CHECK(first->view.indices != clipboard.indices.data());
+	for (int64_t i = 0; i < clipboard.GetVolume(); i++) {
+		CHECK(SameBlock(first->palette[first->view.GetPaletteIndex(i)], clipboard.Get(i)));
+	}
+	again = nullptr;
+
+	// Another mod publishes a clipboard of its own. The old buffer stays readable for as long as it is held.
+	Clipboard other;
+	other.Reset(2, 2, 2);
+	for (int64_t i = 0; i < other.GetVolume(); i++) other.Set(i, EBlockType::Flagstone);
+	CHECK(SharedClipboard::Publish(SharedClipboardKey, other, &other) == 2);
+	CHECK(first->buffer->references == 1 && first->GetVersion() == 1);
+	CHECK(SameBlock(first->palette[first->view.GetPaletteIndex(0)], EBlockType::WoodPlank));
+	first = nullptr;
+
+	// Pasting takes the newest published clipboard, whoever published it.
+	CoordinateInBlocks pasteAt = CoordinateInBlocks(200, 100, 40);
+	Event_BlockHitByTool(pasteAt, PasteBlock, L"T_Stick", CoordinateInCentimeters(pasteAt), false);
+	RunUntilIdle();
+	CHECK(BoxIs(pasteAt, pasteAt + CoordinateInBlocks(1, 1, 1), EBlockType::Flagstone));
+
+	// A change to this mod's clipboard is published over it again, and pasted turned.
+	PlaceBlock(paintAt + CoordinateInBlocks(5, 0, 0), BlockInfo(Rotate90CWBlock));
+	HitBlock(paintAt + CoordinateInBlocks(5, 0, 0), L"T_Stick");
+	RunUntilIdle();
+	CHECK(SharedClipboard::GetPublishedVersion(SharedClipboardKey) == 3);
+	CoordinateInBlocks rotatedAt = CoordinateInBlocks(300, 100, 40);
+	Event_BlockHitByTool(rotatedAt, PasteBlock, L"T_Stick", CoordinateInCentimeters(rotatedAt), false);
+	RunUntilIdle();
+	CHECK(BoxIs(rotatedAt + CoordinateInBlocks(0, 0, 0), rotatedAt + CoordinateInBlocks(0, 3, 0), EBlockType::WoodPlank));
+	CHECK(BoxIs(rotatedAt + CoordinateInBlocks(1, 3, 0), rotatedAt + CoordinateInBlocks(1, 3, 0), EBlockType::Wallstone));
+
+	// Something else under the key is neither read nor replaced.
+	uint64_t foreign[8] = {};
+	void* published = nullptr;
+	{
+		ScopedSharedMemoryHandle slot = GetSharedMemoryPointer(SharedClipboardKey, false, false);
+		published = slot.Pointer;
+		slot.Pointer = foreign;
+	}
+	CHECK(SharedClipboard::Acquire(SharedClipboardKey) == nullptr && SharedClipboard::Publish(SharedClipboardKey, other, &other) == 0);
+	{
+		ScopedSharedMemoryHandle slot = GetSharedMemoryPointer(SharedClipboardKey, false, false);
+		slot.Pointer = published;
+	}
+
+	// Leaving the world takes this mod's clipboard out of the slot.
+	Event_OnExit();
+	CHECK(SharedClipboard::GetPublishedVersion(SharedClipboardKey) == 0);
+	ShareClipboard = false;
+}
+
+void CheckPasteKernels() {
+	// Palettes of each packing, with some air so skipping it matters, pasted straight and turned,
+	// against what the clipboard reads voxel by voxel.
+	const size_t paletteSizes[3] = { 6, 40, 300 };
+	const Orientation orientations[3] = { Orientation(), Orientation::Mirror(0), Orientation::QuarterTurn(2, false) };
+	for (size_t paletteSize : paletteSizes) {
+		for (const Orientation& orientation : orientations) {
+			for (bool ignoreAir : { false, true }) {
+				ResetSession();
+				clipboard.Reset(21, 7, 3);
+				for (int64_t i = 0; i < clipboard.GetVolume(); i++) {
+					size_t entry = size_t(i * 7) % paletteSize;
+					clipboard.Set(i, entry == 0 ? BlockInfo(EBlockType::Air) : BlockInfo(UniqueID(5000 + entry)));
+				}
+				clipboard.orientation = orientation;
+				CHECK(clipboard.bitsPerBlock == (paletteSize <= 16 ? 4 : (paletteSize <= 256 ? 8 : 16)));
+
+				CoordinateInBlocks pasteAt = CoordinateInBlocks(50, 50, 20);
+				jobExecutor.Enqueue(std::make_unique<PasteJob>(pasteAt, pasteAt, ignoreAir, false));
+				RunUntilIdle();
+
+				ClipboardView view(clipboard);
+				bool matches = true;
+				for (int64_t z = 0; z < view.sizeZ; z++) {
+					for (int64_t y = 0; y < view.sizeY; y++) {
+						for (int64_t x = 0; x < view.sizeX; x++) {
+							CoordinateInBlocks at = pasteAt + CoordinateInBlocks(x, y, int16_t(z));
+							BlockInfo wanted = view.GetOrientedBlock(view.GetPaletteIndex(view.GetIndex(x, y, z)));
+							if (ignoreAir && wanted.Type == EBlockType::Air) wanted = GetWorld().GetGeneratedBlock(at);
+							matches = matches && SameBlock(GetWorld().GetBlock(at), wanted);
+						}
+					}
+				}
+				CHECK(matches);
+			}
+		}
+	}
+}
+
+void CheckWandsSkipPaletteBlocks() {
+	// A shovel on the Paint block is a dry run, and neither wand may act on the block as well.
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	marker1Cord = CoordinateInBlocks(0, 0, 30);
+	marker2Cord = CoordinateInBlocks(9, 9, 33);
+	SelectMarkerBox(paintAt, false);
+	RunUntilIdle();
+	std::shared_ptr<const VoxelSet> selection = voxelSelection;
+	CHECK(selection != nullptr);
+
+	selectionWandEnabled = true;
+	HitBlock(paintAt, L"T_Shovel_Stone");
+	RunUntilIdle();
+	CHECK(voxelSelection == selection && BoxIsGenerated(CoordinateInBlocks(0, 0, 30), CoordinateInBlocks(9, 9, 33)));
+	CHECK(GetWorld().GetBlock(paintAt).CustomBlockID == PaintBlock);
+	selectionWandEnabled = false;
+
+	exchangingWandEnabled = true;
+	exchangeTarget = BlockInfo(EBlockType::Stone);
+	HitBlock(paintAt, L"T_Shovel_Stone");
+	RunUntilIdle();
+	CHECK(voxelSelection == selection && BoxIsGenerated(CoordinateInBlocks(0, 0, 30), CoordinateInBlocks(9, 9, 33)));
+	CHECK(GetWorld().GetBlock(paintAt).CustomBlockID == PaintBlock && SameBlock(GetWorld().GetBlock(GetBlockAbove(paintAt)), EBlockType::Sand));
+	exchangingWandEnabled = false;
+
+	// The pickaxe and axe actions on palette blocks still use the marker box with either wand on.
+	for (int wand = 0; wand < 2; wand++) {
+		ResetSession();
+		paintAt = SetUpPalette(EBlockType::Sand, { EBlockType::Grass, EBlockType::Wallstone });
+		CoordinateInBlocks corner1 = CoordinateInBlocks(0, 0, 28);
+		CoordinateInBlocks corner2 = CoordinateInBlocks(9, 9, 33);
+		marker1Cord = corner1;
+		marker2Cord = corner2;
+		selectionWandEnabled = wand == 0;
+		exchangingWandEnabled = wand == 1;
+		exchangeTarget = BlockInfo(EBlockType::Stone);
+
+		HitBlock(paintAt, L"T_Pickaxe_Stone");
+		RunUntilIdle();
+		CHECK(marker1Cord == corner1 && marker2Cord == corner2 && GetWorld().GetBlock(paintAt).CustomBlockID == PaintBlock);
+		CHECK(BoxIs(CoordinateInBlocks(4, 4, 31), CoordinateInBlocks(5, 5, 31), EBlockType::Sand) && BoxIsGenerated(corner1, corner1));
+		UndoLastOperation(paintAt);
+		RunUntilIdle();
+
+		HitBlock(maskCord, L"T_Axe_Stone");
+		RunUntilIdle();
+		CHECK(marker1Cord == corner1 && marker2Cord == corner2 && GetWorld().GetBlock(maskCord).CustomBlockID == MaskBlock);
+		CHECK(BoxIs(CoordinateInBlocks(0, 0, 31), CoordinateInBlocks(9, 9, 31), EBlockType::Wallstone));
+	}
+	selectionWandEnabled = false;
+	exchangingWandEnabled = false;
+}
+
+int RunChecks() {
+	CheckPaintUndoRedo();
+	CheckMaskedPaint();
+	CheckCutPasteRotate();
+	CheckLoadedRadius();
+	CheckTimeSlicing();
+	CheckTiledTraversal();
+	CheckPersistence();
+	CheckSchematicLibrary();
+	CheckOrientation();
+	CheckStackArea();
+	CheckShapes();
+	CheckCoordinateRanges();
+	CheckFloodFill();
+	CheckReplace();
+	CheckInstrumentation();
+	CheckJournal();
+	CheckHistorySpill();
+	CheckDeferredWrites();
+	CheckWorkerPool();
+	CheckSelections();
+	CheckSelectionAtJobStart();
+	CheckInventory();
+	CheckSharedClipboard();
+	CheckPasteKernels();
+	CheckWandsSkipPaletteBlocks();
+	ResetSession();
+
+	if (failedChecks > 0) {
+		fprintf(stderr, "%d checks failed\n", failedChecks);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
+
+/************************************************************
+	Profiling
+*************************************************************/
+
+void ReportOperation(const char* Name, const TickStats& Stats, const HostCounters& Before) {
+	const HostCounters& after = GetWorld().counters;
+	printf("%-10s %9.2f ms total  %4d ticks  %6.2f ms max tick  %10llu GetBlock  %10llu SetBlock  %6llu chunk rebuilds (%zu max per tick)\n",
+		Name, Stats.totalMilliseconds, Stats.ticks, Stats.maxTickMilliseconds,
+		(unsigned long long)(after.getBlockCalls - Before.getBlockCalls),
+		(unsigned long long)(after.setBlockCalls - Before.setBlockCalls),
+		(unsigned long long)(after.chunkRebuilds - Before.chunkRebuilds), Stats.maxChunkRebuilds);
+}
+
+template<typename Operation>
+void Profile(const char* Name, Operation&& Start) {
+	HostCounters before = GetWorld().counters;
+	Start();
+	TickStats stats = RunUntilIdle();
+	ReportOperation(Name, stats, before);
+}
+
+int RunProfile(int64_t Size) {
+	ResetSession();
+	CoordinateInBlocks paintAt = SetUpPalette(EBlockType::Sand, {});
+	CoordinateInBlocks corner1 = CoordinateInBlocks(0, 0, 16);
+	CoordinateInBlocks corner2 = corner1 + CoordinateInBlocks(Size - 1, Size - 1, int16_t(Size / 4 - 1));
+	SetMarkers(corner1, corner2);
+	marker1Cord = corner1;
+	marker2Cord = corner2;
+
+	printf("Region %lld x %lld x %lld (%lld blocks)\n", (long long)Size, (long long)Size, (long long)(Size / 4), (long long)(Size * Size * (Size / 4)));
+
+	Profile("paint", [&]() { PaintArea(GetBlockAbove(paintAt), false); });
+	Profile("repaint", [&]() { PaintArea(GetBlockAbove(paintAt), false); });
+	Profile("copy", [&]() { CopyRegion(GetBlockAbove(paintAt)); });
+	Profile("rotate", [&]() { QueueOrientClipboard(paintAt, Orientation::QuarterTurn(2, false), L"Rotating"); });
+	Profile("cut", [&]() { CutRegion(GetBlockAbove(paintAt), false); });
+	Profile("paste", [&]() { PasteClipboard(corner1 + CoordinateInBlocks(0, Size + 8, 0), false); });
+	Profile("undo", [&]() { UndoLastOperation(paintAt); });
+	Profile("redo", [&]() { RedoLastOperation(paintAt); });
+	Profile("sphere", [&]() { PaintArea(GetBlockAbove(paintAt), false, ShapeKind::Ellipsoid); });
+	Profile("stack", [&]() { StackArea(CoordinateInBlocks(-20, -40, 40), false); });
+	Profile("flood", [&]() { FloodFill(corner1, false); });
+
+	// A three rule replace over the whole box, after dropping the flood selection.
+	voxelSelection = nullptr;
+	marker1Cord = corner1;
+	marker2Cord = corner2;
+	const BlockInfo rules[6] = { EBlockType::Sand, EBlockType::Stone, EBlockType::Stone, EBlockType::Wallstone, EBlockType::Dirt, EBlockType::Grass };
+	for (int16_t i = 0; i < 6; i++) PlaceBlock(maskCord + CoordinateInBlocks(0, 0, i + 1), rules[i]);
+	Profile("replace", [&]() { ReplaceArea(GetBlockAbove(paintAt), false); });
+
+	// Saving on exit, loading the world, and the first paste that restores the saved clipboard.
+	auto start = std::chrono::steady_clock::now();
+	Event_OnExit();
+	double exitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	start = std::chrono::steady_clock::now();
+	Event_OnLoad(false);
+	double loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("exit       %9.2f ms (%zu KB clipboard, %zu KB history saved)\n", exitMilliseconds,
+		GetWorld().savedData[ClipboardSaveName].size() / 1024, GetWorld().savedData[HistorySaveName].size() / 1024);
+	printf("load       %9.2f ms\n", loadMilliseconds);
+	Profile("paste", [&]() { PasteClipboard(corner1 + CoordinateInBlocks(0, Size + 8, 0), false); });
+
+	ResetSession();
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	InstallHost();
+	Event_OnLoad(false);
+
+	std::string mode = (argc > 1) ? argv[1] : "check";
+	int result = 0;
+
+	if (mode == "check") {
+		result = RunChecks();
+	}
+	else if (mode == "profile") {
+		result = RunProfile((argc > 2) ? std::stoll(argv[2]) : 200);
+	}
+	else {
+		fprintf(stderr, "Usage: %s check | profile [Size]\n", argv[0]);
+		result = 2;
+	}
+
+	Event_OnExit();
+	return result;
+}
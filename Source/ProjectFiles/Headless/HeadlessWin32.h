@@ -0,0 +1,49 @@
+#pragma once
+
+/************************************************************
+	The handful of Win32 names GameAPI.cpp uses, so it compiles outside Windows.
+	Memory the headless host hands to the mod is allocated with malloc, so HeapFree maps to free.
+*************************************************************/
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include "windows.h"
+
+#else
+
+#define __forceinline inline __attribute__((always_inline))
+
+#define MAX_PATH 260
+#define GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT 0x2
+#define GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS 0x4
+
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef const wchar_t* LPCWSTR;
+
+inline HANDLE GetProcessHeap() {
+	return nullptr;
+}
+
+inline int HeapFree(HANDLE, unsigned long, void* Memory) {
+	free(Memory);
+	return 1;
+}
+
+// There is no module to look up; GameAPI.cpp then reports L"Error" as the install folder.
+inline int GetModuleHandleExW(unsigned long, LPCWSTR, HMODULE*) {
+	return 0;
+}
+
+inline unsigned long GetModuleFileNameW(HMODULE, wchar_t*, unsigned long) {
+	return 0;
+}
+
+#endif
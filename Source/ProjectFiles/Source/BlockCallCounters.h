@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+// Host block calls made through the GameAPI wrappers, for the operation traces. Only the game thread makes them.
+struct BlockCallCounters {
+	uint64_t getBlock = 0;
+	uint64_t setBlock = 0;
+};
+inline BlockCallCounters blockCallCounters;
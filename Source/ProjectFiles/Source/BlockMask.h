@@ -0,0 +1,128 @@
+#pragma once
+#include "GameAPI.h"
+
+#include <bit>
+
+/************************************************************
+	A mask compiled once per operation from the blocks stacked on the Mask block.
+	Native blocks are looked up in a bit table indexed by EBlockType, custom blocks in a flat hash set of
+	their CustomBlockIDs, so testing a voxel costs the same no matter how many blocks the mask lists.
+*************************************************************/
+
+// Open-addressing set of non-zero CustomBlockIDs. Zero marks an empty slot.
+struct CustomBlockIDSet {
+	std::vector<UniqueID> slots;
+	size_t count = 0;
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	void Insert(UniqueID id) {
+		if (id == 0 || Contains(id)) return;
+		if ((count + 1) * 2 > slots.size()) {
+			Grow();
+		}
+		InsertSlot(id);
+		count++;
+	}
+
+	bool Contains(UniqueID id) const {
+		if (slots.empty()) return false;
+
+		size_t mask = slots.size() - 1;
+		for (size_t slot = Hash(id) & mask; ; slot = (slot + 1) & mask) {
+			if (slots[slot] == id) return true;
+			if (slots[slot] == 0) return false;
+		}
+	}
+
+private:
+	static size_t Hash(UniqueID id) {
+		return size_t(id * 0x9E3779B1u);
+	}
+
+	void InsertSlot(UniqueID id) {
+		size_t mask = slots.size() - 1;
+		size_t slot = Hash(id) & mask;
+		while (slots[slot] != 0) {
+			slot = (slot + 1) & mask;
+		}
+		slots[slot] = id;
+	}
+
+	void Grow() {
+		std::vector<UniqueID> old;
+		old.swap(slots);
+		slots.assign(old.empty() ? 8 : old.size() * 2, 0);
+		for (UniqueID id : old) {
+			if (id != 0) InsertSlot(id);
+		}
+	}
+};
+
+struct BlockMask {
+	uint64_t nativeTypes[4] = { 0, 0, 0, 0 };
+	CustomBlockIDSet customBlocks;
+	// An inverted mask excludes the listed blocks instead of selecting them.
+	bool inverted = false;
+	bool hasEntries = false;
+
+	// A mask that lists nothing doesn't restrict an operation, unless it's inverted.
+	bool IsActive() const {
+		return hasEntries || inverted;
+	}
+
+	void AddNative(EBlockType type) {
+		uint8_t index = uint8_t(type);
+		nativeTypes[index >> 6] |= uint64_t(1) << (index & 63);
+		hasEntries = true;
+	}
+
+	void AddCustom(UniqueID customBlockID) {
+		customBlocks.Insert(customBlockID);
+		hasEntries = true;
+	}
+
+	bool Matches(const BlockInfo& info) const {
+		uint8_t index = uint8_t(info.Type);
+		bool listed = (info.CustomBlockID != 0)
+			? customBlocks.Contains(info.CustomBlockID)
+			: ((nativeTypes[index >> 6] >> (index & 63)) & 1) != 0;
+		return listed != inverted;
+	}
+
+	// Tests up to 64 blocks at once. Bit i of the result is set when blocks[i] passes the mask.
+	uint64_t MatchRow(const BlockInfo* blocks, size_t count) const {
+		return customBlocks.empty() ? MatchRow<true>(blocks, count) : MatchRow<false>(blocks, count);
+	}
+
+	// MatchRow for callers that pick the kind of mask once, outside their loop. NativeOnly must match customBlocks.empty().
+	template<bool NativeOnly> uint64_t MatchRow(const BlockInfo* blocks, size_t count) const {
+		uint64_t result = 0;
+		if constexpr (NativeOnly) {
+			// Native-only masks are a table lookup per block with no branches. A custom block is never listed here.
+			uint64_t flip = inverted ? 1 : 0;
+			for (size_t i = 0; i < count; i++) {
+				uint8_t index = uint8_t(blocks[i].Type);
+				uint64_t listed = (nativeTypes[index >> 6] >> (index & 63)) & uint64_t(blocks[i].CustomBlockID == 0);
+				result |= (listed ^ flip) << i;
+			}
+		}
+		else {
+			for (size_t i = 0; i < count; i++) {
+				result |= uint64_t(Matches(blocks[i])) << i;
+			}
+		}
+		return result;
+	}
+};
+
+// Calls visit(i) for every set bit of a MatchRow result, lowest first.
+template<typename Visitor>
+inline void ForEachSetBit(uint64_t bits, Visitor&& visit) {
+	while (bits != 0) {
+		visit(size_t(std::countr_zero(bits)));
+		bits &= bits - 1;
+	}
+}
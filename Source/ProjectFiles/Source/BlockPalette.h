@@ -0,0 +1,63 @@
+#pragma once
+#include "GameAPI.h"
+
+#include <unordered_map>
+
+// Packs every field of a BlockInfo into one integer, so it can be compared and hashed without the struct padding.
+inline uint64_t GetBlockKey(const BlockInfo& info) {
+	return uint64_t(info.Type) | (uint64_t(info.Rotation) << 8) | (uint64_t(info.CustomBlockID) << 16);
+}
+
+inline bool SameBlock(const BlockInfo& a, const BlockInfo& b) {
+	return GetBlockKey(a) == GetBlockKey(b);
+}
+
+// A table of unique BlockInfos that voxel storage refers to by small indices.
+struct BlockPalette {
+	std::vector<BlockInfo> entries;
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	bool empty() const {
+		return entries.empty();
+	}
+
+	const BlockInfo& operator[](size_t index) const {
+		return entries[index];
+	}
+
+	void clear() {
+		entries.clear();
+		lookup.clear();
+		lastKey = InvalidKey;
+	}
+
+	// Returns the index of info, adding it to the table if it isn't there yet.
+	uint32_t IndexOf(const BlockInfo& info) {
+		uint64_t key = GetBlockKey(info);
+		// Neighbouring voxels are usually the same block, so check the last lookup first.
+		if (key == lastKey) return lastIndex;
+
+		auto found = lookup.find(key);
+		if (found == lookup.end()) {
+			found = lookup.emplace(key, uint32_t(entries.size())).first;
+			entries.push_back(info);
+		}
+		lastKey = key;
+		lastIndex = found->second;
+		return lastIndex;
+	}
+
+	size_t GetMemoryBytes() const {
+		return entries.capacity() * sizeof(BlockInfo) + lookup.size() * (sizeof(uint64_t) + sizeof(uint32_t) + 2 * sizeof(void*));
+	}
+
+private:
+	static constexpr uint64_t InvalidKey = ~uint64_t(0);
+
+	std::unordered_map<uint64_t, uint32_t> lookup;
+	uint64_t lastKey = InvalidKey;
+	uint32_t lastIndex = 0;
+};
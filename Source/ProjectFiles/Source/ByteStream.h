@@ -0,0 +1,156 @@
+#pragma once
+#include "GameAPI.h"
+
+#include <cstring>
+
+/************************************************************
+	Little-endian binary writer and reader shared by the compact formats the mod stores (undo entries, saves).
+	Integers that are usually small are written as LEB128 varints.
+*************************************************************/
+
+struct ByteWriter {
+	std::vector<uint8_t> bytes;
+
+	size_t size() const {
+		return bytes.size();
+	}
+
+	void WriteU8(uint8_t value) {
+		bytes.push_back(value);
+	}
+
+	void WriteU16(uint16_t value) {
+		WriteRaw(&value, sizeof(value));
+	}
+
+	void WriteU32(uint32_t value) {
+		WriteRaw(&value, sizeof(value));
+	}
+
+	void WriteU64(uint64_t value) {
+		WriteRaw(&value, sizeof(value));
+	}
+
+	void WriteVarint(uint64_t value) {
+		while (value >= 0x80) {
+			bytes.push_back(uint8_t(value) | 0x80);
+			value >>= 7;
+		}
+		bytes.push_back(uint8_t(value));
+	}
+
+	// Zig-zag encodes so small negative numbers stay short too.
+	void WriteSignedVarint(int64_t value) {
+		WriteVarint((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+	}
+
+	void WriteCoordinate(const CoordinateInBlocks& at) {
+		WriteSignedVarint(at.X);
+		WriteSignedVarint(at.Y);
+		WriteSignedVarint(at.Z);
+	}
+
+	void WriteBlockInfo(const BlockInfo& info) {
+		WriteU8(uint8_t(info.Type));
+		WriteU8(uint8_t(info.Rotation));
+		WriteVarint(info.CustomBlockID);
+	}
+
+	void WriteRaw(const void* data, size_t size) {
+		const uint8_t* begin = static_cast<const uint8_t*>(data);
+		bytes.insert(bytes.end(), begin, begin + size);
+	}
+};
+
+// Reads from a byte range it does not own. Reading past the end sets failed and returns zeros.
+struct ByteReader {
+	const uint8_t* position;
+	const uint8_t* end;
+	bool failed = false;
+
+	ByteReader(const uint8_t* data, size_t size) : position(data), end(data + size) {}
+
+	bool AtEnd() const {
+		return position >= end;
+	}
+
+	size_t GetRemaining() const {
+		return size_t(end - position);
+	}
+
+	uint8_t ReadU8() {
+		if (position >= end) {
+			failed = true;
+			return 0;
+		}
+		return *position++;
+	}
+
+	uint16_t ReadU16() {
+		uint16_t value = 0;
+		ReadRaw(&value, sizeof(value));
+		return value;
+	}
+
+	uint32_t ReadU32() {
+		uint32_t value = 0;
+		ReadRaw(&value, sizeof(value));
+		return value;
+	}
+
+	uint64_t ReadU64() {
+		uint64_t value = 0;
+		ReadRaw(&value, sizeof(value));
+		return value;
+	}
+
+	uint64_t ReadVarint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t byte = ReadU8();
+			value |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) break;
+		}
+		return value;
+	}
+
+	int64_t ReadSignedVarint() {
+		uint64_t value = ReadVarint();
+		return int64_t(value >> 1) ^ -int64_t(value & 1);
+	}
+
+	CoordinateInBlocks ReadCoordinate() {
+		int64_t x = ReadSignedVarint();
+		int64_t y = ReadSignedVarint();
+		int16_t z = int16_t(ReadSignedVarint());
+		return CoordinateInBlocks(x, y, z);
+	}
+
+	BlockInfo ReadBlockInfo() {
+		EBlockType type = EBlockType(ReadU8());
+		ERotation rotation = ERotation(ReadU8());
+		UniqueID customBlockID = UniqueID(ReadVarint());
+		return BlockInfo(type, rotation, customBlockID);
+	}
+
+	void ReadRaw(void* data, size_t size) {
+		if (GetRemaining() < size) {
+			failed = true;
+			position = end;
+			return;
+		}
+		memcpy(data, position, size);
+		position += size;
+	}
+
+	const uint8_t* Skip(size_t size) {
+		if (GetRemaining() < size) {
+			failed = true;
+			position = end;
+			return nullptr;
+		}
+		const uint8_t* start = position;
+		position += size;
+		return start;
+	}
+};
@@ -0,0 +1,300 @@
+#pragma once
+#include "GameAPI.h"
+#include "BlockPalette.h"
+#include "ByteStream.h"
+#include "Orientation.h"
+
+/************************************************************
+	Clipboard storage. The dimensions are stored once and every voxel is a small index into the palette,
+	packed 4 bits per voxel while the palette has up to 16 entries and 8 bits up to 256.
+	Voxels are ordered x-inner, then y, then z, matching the order the region loops visit them in.
+	Rotations and mirrors only change the orientation; the indices stay in the order they were copied in.
+*************************************************************/
+
+struct Clipboard {
+	int64_t sizeX = 0;
+	int64_t sizeY = 0;
+	int64_t sizeZ = 0;
+
+	BlockPalette palette;
+	uint8_t bitsPerBlock = 4;
+	std::vector<uint8_t> indices;
+	Orientation orientation;
+
+	bool empty() const {
+		return GetVolume() == 0;
+	}
+
+	int64_t GetVolume() const {
+		return sizeX * sizeY * sizeZ;
+	}
+
+	int64_t GetIndex(int64_t x, int64_t y, int64_t z) const {
+		return x + sizeX * (y + sizeY * z);
+	}
+
+	void clear() {
+		Reset(0, 0, 0);
+	}
+
+	// Sizes the clipboard for a new region. Every voxel starts at palette index 0.
+	void Reset(int64_t x, int64_t y, int64_t z) {
+		sizeX = x;
+		sizeY = y;
+		sizeZ = z;
+		palette.clear();
+		bitsPerBlock = 4;
+		indices.assign(GetPackedSize(GetVolume(), bitsPerBlock), 0);
+		indices.shrink_to_fit();
+		orientation = Orientation();
+	}
+
+	BlockInfo Get(int64_t index) const {
+		return palette[GetPaletteIndex(index)];
+	}
+
+	void Set(int64_t index, const BlockInfo& info) {
+		uint32_t paletteIndex = palette.IndexOf(info);
+		while (paletteIndex >= (1u << bitsPerBlock)) {
+			Widen();
+		}
+		SetPaletteIndex(index, paletteIndex);
+	}
+
+	uint32_t GetPaletteIndex(int64_t index) const {
+		return ReadPacked(indices.data(), bitsPerBlock, index);
+	}
+
+	void SetPaletteIndex(int64_t index, uint32_t paletteIndex) {
+		WritePacked(indices.data(), bitsPerBlock, index, paletteIndex);
+	}
+
+	// Rotates or mirrors the clipboard by transform, on top of whatever it has already been turned by.
+	void Orient(Orientation transform) {
+		orientation = orientation.Then(transform);
+	}
+
+	// The size of the clipboard as it will be pasted.
+	std::array<int64_t, 3> GetOrientedSize() const {
+		return orientation.GetSize(sizeX, sizeY, sizeZ);
+	}
+
+	size_t GetMemoryBytes() const {
+		return sizeof(Clipboard) + indices.capacity() + palette.GetMemoryBytes();
+	}
+
+	// Saves the clipboard with its indices run-length coded, or packed as they are when the runs would be larger.
+	void Write(ByteWriter& writer) const {
+		writer.WriteVarint(uint64_t(sizeX));
+		writer.WriteVarint(uint64_t(sizeY));
+		writer.WriteVarint(uint64_t(sizeZ));
+		writer.WriteVarint(palette.size());
+		for (const BlockInfo& info : palette.entries) {
+			writer.WriteBlockInfo(info);
+		}
+		writer.WriteU8(bitsPerBlock);
+		writer.WriteU8(orientation.id);
+
+		ByteWriter runs;
+		int64_t volume = GetVolume();
+		for (int64_t i = 0; i < volume && runs.size() < indices.size();) {
+			uint32_t paletteIndex = GetPaletteIndex(i);
+			int64_t runEnd = i + 1;
+			while (runEnd < volume && GetPaletteIndex(runEnd) == paletteIndex) {
+				runEnd++;
+			}
+			runs.WriteVarint(uint64_t(runEnd - i));
+			runs.WriteVarint(paletteIndex);
+			i = runEnd;
+		}
+
+		if (runs.size() < indices.size()) {
+			writer.WriteU8(EncodingRuns);
+			writer.WriteRaw(runs.bytes.data(), runs.size());
+		}
+		else {
+			writer.WriteU8(EncodingPacked);
+			writer.WriteRaw(indices.data(), indices.size());
+		}
+	}
+
+	// Replaces the contents with a clipboard saved by Write. On malformed data the clipboard is left empty.
+	bool Read(ByteReader& reader) {
+		int64_t x = int64_t(reader.ReadVarint());
+		int64_t y = int64_t(reader.ReadVarint());
+		int64_t z = int64_t(reader.ReadVarint());
+		uint64_t paletteSize = reader.ReadVarint();
+		if (reader.failed || x < 0 || y < 0 || z < 0 || paletteSize > 0xFFFF || double(x) * double(y) * double(z) > double(MaxSavedVolume)) {
+			clear();
+			return false;
+		}
+
+		Reset(x, y, z);
+		for (uint64_t i = 0; i < paletteSize; i++) {
+			palette.IndexOf(reader.ReadBlockInfo());
+		}
+		uint8_t bits = reader.ReadU8();
+		uint8_t orientationId = reader.ReadU8();
+		uint8_t encoding = reader.ReadU8();
+		if (reader.failed || palette.size() != paletteSize || (bits != 4 && bits != 8 && bits != 16) || paletteSize > (uint64_t(1) << bits)
+			|| orientationId >= Orientation::Count) {
+			clear();
+			return false;
+		}
+
+		bitsPerBlock = bits;
+		orientation = Orientation(orientationId);
+		indices.assign(GetPackedSize(GetVolume(), bitsPerBlock), 0);
+		if (encoding == EncodingPacked) {
+			reader.ReadRaw(indices.data(), indices.size());
+		}
+		else if (encoding != EncodingRuns) {
+			reader.failed = true;
+		}
+		else {
+			int64_t volume = GetVolume();
+			for (int64_t i = 0; i < volume && !reader.failed;) {
+				int64_t length = int64_t(reader.ReadVarint());
+				uint64_t paletteIndex = reader.ReadVarint();
+				if (length <= 0 || length > volume - i || paletteIndex >= paletteSize) {
+					reader.failed = true;
+					break;
+				}
+				for (int64_t end = i + length; i < end; i++) {
+					SetPaletteIndex(i, uint32_t(paletteIndex));
+				}
+			}
+		}
+
+		if (reader.failed) {
+			clear();
+			return false;
+		}
+		return true;
+	}
+
+	static size_t GetPackedSize(int64_t volume, uint8_t bits) {
+		return size_t((volume * bits + 7) / 8);
+	}
+
+	static uint32_t ReadPacked(const uint8_t* data, uint8_t bits, int64_t index) {
+		switch (bits) {
+		case 4:
+			return ReadPacked<4>(data, index);
+		case 8:
+			return ReadPacked<8>(data, index);
+		default:
+			return ReadPacked<16>(data, index);
+		}
+	}
+
+	// For loops that pick the packing once, outside the loop.
+	template<uint8_t Bits> static uint32_t ReadPacked(const uint8_t* data, int64_t index) {
+		if constexpr (Bits == 4) return (data[index >> 1] >> ((index & 1) * 4)) & 0xF;
+		else if constexpr (Bits == 8) return data[index];
+		else return uint32_t(data[index * 2]) | (uint32_t(data[index * 2 + 1]) << 8);
+	}
+
+	static void WritePacked(uint8_t* data, uint8_t bits, int64_t index, uint32_t value) {
+		switch (bits) {
+		case 4: {
+			uint8_t shift = uint8_t((index & 1) * 4);
+			data[index >> 1] = uint8_t((data[index >> 1] & ~(0xF << shift)) | (value << shift));
+			break;
+		}
+		case 8:
+			data[index] = uint8_t(value);
+			break;
+		default:
+			data[index * 2] = uint8_t(value);
+			data[index * 2 + 1] = uint8_t(value >> 8);
+			break;
+		}
+	}
+
+private:
+	static constexpr uint8_t EncodingPacked = 0;
+	static constexpr uint8_t EncodingRuns = 1;
+	// Anything larger in a save is taken as corrupt rather than allocated.
+	static constexpr int64_t MaxSavedVolume = int64_t(1) << 32;
+
+	// Repacks the indices one size up once the palette no longer fits: 4 -> 8 bits, or 8 -> 16 bits past 256 entries.
+	void Widen() {
+		uint8_t newBits = (bitsPerBlock == 4) ? 8 : 16;
+		int64_t volume = GetVolume();
+		std::vector<uint8_t> widened(GetPackedSize(volume, newBits), 0);
+
+		for (int64_t i = 0; i < volume; i++) {
+			WritePacked(widened.data(), newBits, i, ReadPacked(indices.data(), bitsPerBlock, i));
+		}
+		indices.swap(widened);
+		bitsPerBlock = newBits;
+	}
+};
+
+// Read-only clipboard-shaped voxels that don't have to live in a Clipboard, e.g. a schematic in a mapped file.
+// The view is oriented: its sizes and coordinates are the pasted ones, and GetIndex maps them back to the stored order.
+struct ClipboardView {
+	int64_t sizeX = 0;
+	int64_t sizeY = 0;
+	int64_t sizeZ = 0;
+
+	const BlockInfo* palette = nullptr;
+	size_t paletteSize = 0;
+	uint8_t bitsPerBlock = 4;
+	const uint8_t* indices = nullptr;
+	Orientation orientation;
+
+	ClipboardView() = default;
+	ClipboardView(int64_t storedX, int64_t storedY, int64_t storedZ, const BlockInfo* viewPalette, size_t viewPaletteSize, uint8_t bits,
+		const uint8_t* viewIndices, Orientation viewOrientation)
+		: palette(viewPalette), paletteSize(viewPaletteSize), bitsPerBlock(bits), indices(viewIndices), orientation(viewOrientation) {
+		const int64_t size[3] = { storedX, storedY, storedZ };
+		const int64_t stride[3] = { 1, storedX, storedX * storedY };
+
+		// A step along a world axis is a step along its clipboard axis, backwards from the far end when flipped.
+		for (int axis = 0; axis < 3; axis++) {
+			int sourceAxis = orientation.GetSourceAxis(axis);
+			step[axis] = orientation.IsFlipped(axis) ? -stride[sourceAxis] : stride[sourceAxis];
+			if (orientation.IsFlipped(axis)) baseIndex += (size[sourceAxis] - 1) * stride[sourceAxis];
+		}
+		sizeX = size[orientation.GetSourceAxis(0)];
+		sizeY = size[orientation.GetSourceAxis(1)];
+		sizeZ = size[orientation.GetSourceAxis(2)];
+	}
+	explicit ClipboardView(const Clipboard& source)
+		: ClipboardView(source.sizeX, source.sizeY, source.sizeZ, source.palette.entries.data(), source.palette.size(), source.bitsPerBlock,
+			source.indices.data(), source.orientation) {}
+
+	bool empty() const {
+		return GetVolume() == 0;
+	}
+
+	int64_t GetVolume() const {
+		return sizeX * sizeY * sizeZ;
+	}
+
+	int64_t GetIndex(int64_t x, int64_t y, int64_t z) const {
+		return baseIndex + x * step[0] + y * step[1] + z * step[2];
+	}
+
+	uint32_t GetPaletteIndex(int64_t index) const {
+		return Clipboard::ReadPacked(indices, bitsPerBlock, index);
+	}
+
+	// How far the index moves for a step along world axis.
+	int64_t GetStep(int axis) const {
+		return step[axis];
+	}
+
+	// The block a palette entry pastes as. Torches are turned with the clipboard.
+	BlockInfo GetOrientedBlock(size_t paletteIndex) const {
+		BlockInfo info = palette[paletteIndex];
+		info.Rotation = orientation.Apply(info.Rotation);
+		return info;
+	}
+
+private:
+	int64_t baseIndex = 0;
+	int64_t step[3] = { 1, 0, 0 };
+};
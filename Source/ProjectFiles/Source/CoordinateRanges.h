@@ -0,0 +1,187 @@
+#pragma once
+#include "GameFunctions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+using namespace ModAPI;
+
+/************************************************************
+	Coordinates in a box extent or radius around a coordinate, produced one at a time instead of stored.
+	They come out in the same order as GetAllCoordinatesInBox and GetAllCoordinatesInRadius return them:
+	x outermost, z innermost. The world's 0..800 Z limit is applied once per column, not once per voxel,
+	and a radius solves each column's z range with integer math instead of a distance per voxel.
+*************************************************************/
+
+constexpr int64_t WorldMinZ = 0;
+constexpr int64_t WorldMaxZ = 800;
+
+// The offsets of a query: x and y over [-reachX, reachX) and [-reachY, reachY), and per column a z range,
+// already cut to the world's Z limits. An empty column has zFirst > zLast.
+struct CoordinateColumns {
+	CoordinateInBlocks center;
+	int64_t reachX = 0;
+	int64_t reachY = 0;
+	int64_t reachZ = 0;
+	// Zero for a box; otherwise the squared radius every offset has to stay within.
+	int64_t radiusSquared = 0;
+
+	void GetColumn(int64_t x, int64_t y, int64_t& zFirst, int64_t& zLast) const {
+		zFirst = std::max(-reachZ, WorldMinZ - center.Z);
+		zLast = std::min(reachZ - 1, WorldMaxZ - center.Z);
+		if (radiusSquared == 0) return;
+
+		int64_t left = radiusSquared - x * x - y * y;
+		if (left < 0) {
+			zFirst = 1;
+			zLast = 0;
+			return;
+		}
+		int64_t reach = int64_t(std::sqrt(double(left)));
+		while (reach * reach > left) reach--;
+		while ((reach + 1) * (reach + 1) <= left) reach++;
+		zFirst = std::max(zFirst, -reach);
+		zLast = std::min(zLast, reach);
+	}
+};
+
+// A forward range over the coordinates of a query. It holds one column at a time, so it uses the same memory however large the query is.
+class CoordinateRange {
+public:
+	class Iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = CoordinateInBlocks;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const CoordinateInBlocks*;
+		using reference = CoordinateInBlocks;
+
+		Iterator() = default;
+		Iterator(const CoordinateColumns* queryColumns, bool atEnd) : columns(queryColumns) {
+			x = -columns->reachX;
+			y = -columns->reachY;
+			if (atEnd || columns->reachX <= 0 || columns->reachY <= 0) {
+				x = columns->reachX;
+				return;
+			}
+			columns->GetColumn(x, y, z, zLast);
+			SkipEmptyColumns();
+		}
+
+		CoordinateInBlocks operator*() const {
+			return columns->center + CoordinateInBlocks(x, y, int16_t(z));
+		}
+
+		Iterator& operator++() {
+			if (++z > zLast) {
+				NextColumn();
+				SkipEmptyColumns();
+			}
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator previous = *this;
+			++*this;
+			return previous;
+		}
+
+		bool operator==(const Iterator& other) const {
+			return x == other.x && (x == columns->reachX || (y == other.y && z == other.z));
+		}
+
+		bool operator!=(const Iterator& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		const CoordinateColumns* columns = nullptr;
+		int64_t x = 0;
+		int64_t y = 0;
+		int64_t z = 0;
+		int64_t zLast = -1;
+
+		void NextColumn() {
+			if (++y >= columns->reachY) {
+				y = -columns->reachY;
+				if (++x >= columns->reachX) return;
+			}
+			columns->GetColumn(x, y, z, zLast);
+		}
+
+		void SkipEmptyColumns() {
+			while (x < columns->reachX && z > zLast) {
+				NextColumn();
+			}
+		}
+	};
+
+	explicit CoordinateRange(const CoordinateColumns& queryColumns) : columns(queryColumns) {}
+
+	Iterator begin() const {
+		return Iterator(&columns, false);
+	}
+
+	Iterator end() const {
+		return Iterator(&columns, true);
+	}
+
+	// Counts the coordinates a column at a time.
+	size_t size() const {
+		size_t count = 0;
+		ForEachColumn([&count](int64_t, int64_t, int64_t zFirst, int64_t zLast) { count += size_t(zLast - zFirst + 1); });
+		return count;
+	}
+
+	// Calls visit(CoordinateInBlocks) for every coordinate, in the same order as iterating the range.
+	template<typename Visitor> void ForEach(Visitor&& visit) const {
+		ForEachColumn([&](int64_t x, int64_t y, int64_t zFirst, int64_t zLast) {
+			CoordinateInBlocks at = columns.center + CoordinateInBlocks(x, y, int16_t(zFirst));
+			for (int64_t z = zFirst; z <= zLast; z++, at.Z++) {
+				visit(at);
+			}
+		});
+	}
+
+private:
+	CoordinateColumns columns;
+
+	template<typename ColumnVisitor> void ForEachColumn(ColumnVisitor&& visitColumn) const {
+		for (int64_t x = -columns.reachX; x < columns.reachX; x++) {
+			for (int64_t y = -columns.reachY; y < columns.reachY; y++) {
+				int64_t zFirst;
+				int64_t zLast;
+				columns.GetColumn(x, y, zFirst, zLast);
+				if (zFirst <= zLast) visitColumn(x, y, zFirst, zLast);
+			}
+		}
+	}
+};
+
+inline CoordinateRange CoordinatesInBox(CoordinateInBlocks At, CoordinateInBlocks BoxExtent) {
+	CoordinateColumns columns;
+	columns.center = At;
+	columns.reachX = BoxExtent.X;
+	columns.reachY = BoxExtent.Y;
+	columns.reachZ = BoxExtent.Z;
+	return CoordinateRange(columns);
+}
+
+inline CoordinateRange CoordinatesInRadius(CoordinateInBlocks At, int32_t Radius) {
+	CoordinateColumns columns;
+	columns.center = At;
+	columns.reachX = Radius;
+	columns.reachY = Radius;
+	columns.reachZ = Radius;
+	columns.radiusSquared = (Radius > 0) ? int64_t(Radius) * Radius : 0;
+	return CoordinateRange(columns);
+}
+
+template<typename Visitor> void ForEachCoordinateInBox(CoordinateInBlocks At, CoordinateInBlocks BoxExtent, Visitor&& Visit) {
+	CoordinatesInBox(At, BoxExtent).ForEach(std::forward<Visitor>(Visit));
+}
+
+template<typename Visitor> void ForEachCoordinateInRadius(CoordinateInBlocks At, int32_t Radius, Visitor&& Visit) {
+	CoordinatesInRadius(At, Radius).ForEach(std::forward<Visitor>(Visit));
+}
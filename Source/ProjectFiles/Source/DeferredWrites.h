@@ -0,0 +1,202 @@
+#pragma once
+#include "GameAPI.h"
+#include "ByteStream.h"
+#include "CoordinateRanges.h"
+
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/************************************************************
+	Writes that land in chunks the game hasn't loaded. GetBlock returns Invalid there and SetBlock does nothing,
+	so instead of losing them silently the region jobs queue them here, in one compact buffer per chunk column.
+	Event_Tick takes the buffers of columns that have come into range and writes them out as a job of their own.
+	The queue holds at most maxBytes of writes; anything past that is refused and reported.
+	Each write carries the tag of the operation that queued it, which its undo entry keeps as well, so undoing
+	the operation can take back the writes that haven't landed yet.
+*************************************************************/
+
+// A voxel inside its chunk column as x + 32 * (y + 32 * z), the tag of the operation that queued it
+// (0 for none), and the block it should become.
+struct DeferredWrite {
+	uint32_t local;
+	uint32_t operation;
+	BlockInfo block;
+};
+
+struct DeferredChunk {
+	// The column's lowest corner, at WorldMinZ.
+	CoordinateInBlocks corner;
+	std::vector<DeferredWrite> writes;
+
+	CoordinateInBlocks GetCoordinate(const DeferredWrite& write) const {
+		return corner + CoordinateInBlocks(int64_t(write.local & 31), int64_t((write.local >> 5) & 31), int16_t(write.local >> 10));
+	}
+};
+
+class DeferredWriteQueue {
+public:
+	static constexpr int64_t ChunkSize = 32;
+	size_t maxBytes;
+
+	explicit DeferredWriteQueue(size_t budgetBytes) : maxBytes(budgetBytes) {}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	// Queued writes, across all chunks.
+	size_t size() const {
+		return count;
+	}
+
+	size_t GetChunkCount() const {
+		return chunks.size();
+	}
+
+	size_t GetMemoryBytes() const {
+		size_t bytes = sizeof(DeferredWriteQueue);
+		for (const auto& entry : chunks) {
+			bytes += sizeof(ChunkMap::value_type) + entry.second.writes.capacity() * sizeof(DeferredWrite);
+		}
+		return bytes;
+	}
+
+	// Voxels outside the world's Z range never load, so they can't be queued.
+	static bool CanQueue(const CoordinateInBlocks& at) {
+		return at.Z >= WorldMinZ && at.Z <= WorldMaxZ;
+	}
+
+	// Set in the tags of writes whose materials were settled when they were queued, by undo and redo,
+	// so landing them doesn't charge the inventory again.
+	static constexpr uint32_t SettledTag = 0x80000000;
+
+	// A new nonzero tag for an operation's writes. Tags are random, so ones saved in earlier sessions don't collide.
+	uint32_t NewOperationTag(bool settled = false) {
+		uint32_t tag = 0;
+		while (tag == 0) tag = uint32_t(tagGenerator()) & ~SettledTag;
+		return settled ? tag | SettledTag : tag;
+	}
+
+	// Returns false when the write is refused because the queue is full or the voxel can't be queued.
+	// A voxel queued twice ends up with the later block.
+	bool Add(const CoordinateInBlocks& at, const BlockInfo& block, uint32_t operation = 0) {
+		if (!CanQueue(at) || (count + 1) * sizeof(DeferredWrite) > maxBytes) return false;
+
+		DeferredChunk& chunk = chunks[GetColumnKey(at)];
+		if (chunk.writes.empty()) {
+			chunk.corner = CoordinateInBlocks(FloorToChunk(at.X), FloorToChunk(at.Y), int16_t(WorldMinZ));
+		}
+		DeferredWrite write;
+		write.local = uint32_t((at.X - chunk.corner.X) + ChunkSize * ((at.Y - chunk.corner.Y) + ChunkSize * (int64_t(at.Z) - WorldMinZ)));
+		write.operation = operation;
+		write.block = block;
+		chunk.writes.push_back(write);
+		count++;
+		return true;
+	}
+
+	// Removes and returns the chunks isLoaded(corner) accepts, in grid order (x-inner, then y).
+	template<typename LoadedTest> std::vector<DeferredChunk> TakeLoaded(LoadedTest&& isLoaded) {
+		std::vector<DeferredChunk> taken;
+		for (auto entry = chunks.begin(); entry != chunks.end();) {
+			if (!isLoaded(entry->second.corner)) {
+				++entry;
+				continue;
+			}
+			count -= entry->second.writes.size();
+			taken.push_back(std::move(entry->second));
+			entry = chunks.erase(entry);
+		}
+		std::sort(taken.begin(), taken.end(), [](const DeferredChunk& a, const DeferredChunk& b) {
+			if (a.corner.Y != b.corner.Y) return a.corner.Y < b.corner.Y;
+			return a.corner.X < b.corner.X;
+		});
+		return taken;
+	}
+
+	// Removes the writes an operation queued, for when it's undone. Returns how many there were.
+	size_t DropOperation(uint32_t operation) {
+		if (operation == 0) return 0;
+		size_t dropped = 0;
+		for (auto entry = chunks.begin(); entry != chunks.end();) {
+			std::vector<DeferredWrite>& writes = entry->second.writes;
+			size_t before = writes.size();
+			writes.erase(std::remove_if(writes.begin(), writes.end(), [operation](const DeferredWrite& write) { return write.operation == operation; }), writes.end());
+			dropped += before - writes.size();
+			if (writes.empty()) entry = chunks.erase(entry);
+			else ++entry;
+		}
+		count -= dropped;
+		return dropped;
+	}
+
+	void clear() {
+		chunks.clear();
+		count = 0;
+	}
+
+	// Chunks in grid order, each as its corner, its write count and the writes in the order they were queued,
+	// each with its operation tag.
+	void Write(ByteWriter& writer) const {
+		std::vector<const DeferredChunk*> ordered;
+		for (const auto& entry : chunks) {
+			ordered.push_back(&entry.second);
+		}
+		std::sort(ordered.begin(), ordered.end(), [](const DeferredChunk* a, const DeferredChunk* b) {
+			if (a->corner.Y != b->corner.Y) return a->corner.Y < b->corner.Y;
+			return a->corner.X < b->corner.X;
+		});
+
+		writer.WriteVarint(ordered.size());
+		for (const DeferredChunk* chunk : ordered) {
+			writer.WriteCoordinate(chunk->corner);
+			writer.WriteVarint(chunk->writes.size());
+			for (const DeferredWrite& write : chunk->writes) {
+				writer.WriteVarint(write.local);
+				writer.WriteVarint(write.operation);
+				writer.WriteBlockInfo(write.block);
+			}
+		}
+	}
+
+	// Replaces the queue with one saved by Write. Writes past maxBytes are dropped.
+	bool Read(ByteReader& reader) {
+		clear();
+		uint64_t chunkCount = reader.ReadVarint();
+		for (uint64_t i = 0; i < chunkCount && !reader.failed; i++) {
+			DeferredChunk saved;
+			saved.corner = reader.ReadCoordinate();
+			uint64_t writeCount = reader.ReadVarint();
+			for (uint64_t w = 0; w < writeCount && !reader.failed; w++) {
+				DeferredWrite write;
+				write.local = uint32_t(reader.ReadVarint());
+				write.operation = uint32_t(reader.ReadVarint());
+				write.block = reader.ReadBlockInfo();
+				if (!reader.failed) Add(saved.GetCoordinate(write), write.block, write.operation);
+			}
+		}
+
+		if (reader.failed) {
+			clear();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	using ChunkMap = std::unordered_map<uint64_t, DeferredChunk>;
+	ChunkMap chunks;
+	size_t count = 0;
+	std::mt19937 tagGenerator{ std::random_device()() };
+
+	static int64_t FloorToChunk(int64_t value) {
+		return value & ~(ChunkSize - 1);
+	}
+
+	// 32 bits each for the column's chunk x and y.
+	static uint64_t GetColumnKey(const CoordinateInBlocks& at) {
+		return (uint64_t(at.X >> 5) & 0xFFFFFFFF) | (uint64_t(at.Y >> 5) << 32);
+	}
+};
@@ -1,4 +1,5 @@
 #include "GameAPI.h"
+#include "BlockCallCounters.h"
 
 #include <cstdint>
 #include <random>
@@ -12,17 +13,20 @@ void Log(const wString& String)
 
 BlockInfo GetBlock(CoordinateInBlocks At)
 {
+	blockCallCounters.getBlock++;
 	return InternalFunctions::I_GetBlock(At);
 }
 
 bool SetBlock(CoordinateInBlocks At, BlockInfo BlockType)
 {
+	blockCallCounters.setBlock++;
 	BlockInfo BlockTypeOut;
 	return InternalFunctions::I_SetBlock(At, BlockType, BlockTypeOut);
 }
 
 BlockInfo GetAndSetBlock(CoordinateInBlocks At, BlockInfo BlockType)
 {
+	blockCallCounters.setBlock++;
 	BlockInfo BlockTypeOut;
 	InternalFunctions::I_SetBlock(At, BlockType, BlockTypeOut);
 	return BlockTypeOut;
@@ -177,16 +181,28 @@ void SaveModData(wString ModName, const std::vector<uint8_t>& Data)
 
 std::vector<uint8_t> LoadModData(wString ModName)
 {
-	uint64_t ArraySize;
+	ScopedModData Loaded = LoadModDataInPlace(ModName);
+
+	if (Loaded.Data == nullptr) return std::vector<uint8_t>();
+
+	return std::vector<uint8_t>(Loaded.Data, Loaded.Data + Loaded.Size);
+}
+
+ScopedModData LoadModDataInPlace(wString ModName)
+{
+	uint64_t ArraySize = 0;
 	uint8_t* Data = InternalFunctions::I_LoadModData(ModName.c_str(), &ArraySize);
 
-	std::vector<uint8_t> DataOut(ArraySize);
-	
-	memcpy(&DataOut[0], Data, ArraySize);
+	if (Data == nullptr) ArraySize = 0;
 
-	HeapFree(GetProcessHeap(), 0, Data);
+	return ScopedModData(Data, ArraySize);
+}
 
-	return DataOut;
+ScopedModData::~ScopedModData()
+{
+	if (Data != nullptr) {
+		HeapFree(GetProcessHeap(), 0, Data);
+	}
 }
 
 
@@ -197,42 +213,22 @@ std::vector<uint8_t> LoadModData(wString ModName)
 
 std::vector<CoordinateInBlocks> GetAllCoordinatesInBox(CoordinateInBlocks At, CoordinateInBlocks BoxExtent)
 {
+	CoordinateRange Range = CoordinatesInBox(At, BoxExtent);
+
 	std::vector<CoordinateInBlocks> ReturnCoordinates;
-	
-	for (int64_t x = -BoxExtent.X; x < BoxExtent.X; x++) {
-		for (int64_t y = -BoxExtent.Y; y < BoxExtent.Y; y++) {
-			for (int16_t z = -BoxExtent.Z; z < BoxExtent.Z; z++) {
-
-				CoordinateInBlocks Offset = CoordinateInBlocks(x, y, z);
-
-				if ( ((int32_t(At.Z) + int32_t(Offset.Z)) >= 0) && ((int32_t(At.Z) + int32_t(Offset.Z)) <= 800)) {
-					ReturnCoordinates.push_back(At + Offset);				
-				}
-			}
-		}
-	}
+	ReturnCoordinates.reserve(Range.size());
+	Range.ForEach([&ReturnCoordinates](CoordinateInBlocks Coordinate) { ReturnCoordinates.push_back(Coordinate); });
 
 	return ReturnCoordinates;
 }
 
 std::vector<CoordinateInBlocks> GetAllCoordinatesInRadius(CoordinateInBlocks At, int32_t Radius)
 {
-	std::vector<CoordinateInBlocks> ReturnCoordinates;
-
-	for (int64_t x = -Radius; x < Radius; x++) {
-		for (int64_t y = -Radius; y < Radius; y++) {
-			for (int16_t z = -Radius; z < Radius; z++) {
+	CoordinateRange Range = CoordinatesInRadius(At, Radius);
 
-				CoordinateInBlocks Offset = CoordinateInBlocks(x, y, z);
-
-				if (((int32_t(At.Z) + int32_t(Offset.Z)) >= 0) && ((int32_t(At.Z) + int32_t(Offset.Z)) <= 800)) {
-					if (Offset.GetLength() <= Radius) {
-						ReturnCoordinates.push_back(At + Offset);
-					}
-				}
-			}
-		}
-	}
+	std::vector<CoordinateInBlocks> ReturnCoordinates;
+	ReturnCoordinates.reserve(Range.size());
+	Range.ForEach([&ReturnCoordinates](CoordinateInBlocks Coordinate) { ReturnCoordinates.push_back(Coordinate); });
 
 	return ReturnCoordinates;
 }
@@ -366,7 +362,10 @@ int32_t GetRandomInt()
 }
 
 
+// The headless build brings its own main.
+#ifndef CYUBE_HEADLESS
 int main() 
 {
 
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include "GameFunctions.h"
+#include "CoordinateRanges.h"
 typedef std::wstring wString;
 using namespace ModAPI;
 
@@ -171,6 +172,12 @@ using namespace ModAPI;
 	void SaveModData(wString ModName, const std::vector<uint8_t>& Data);
 	std::vector<uint8_t> LoadModData(wString ModName);
 
+/*
+*	LoadModDataInPlace returns the same data as LoadModData, but without copying it into a vector first. ScopedModData.Data points at the game's buffer, which is freed when the handle goes out of scope.
+*	If nothing was saved under that name, Data is nullptr and Size is 0.
+*/
+	ScopedModData LoadModDataInPlace(wString ModName);
+
 /*
 *	Returns the path where this mod is installed. Most likely in some Steam Workshop directory deep in some Steam folder hierarchy.
 *	Expect this to be reset every time the mod gets updated, so it makes no sense to write any non-temporary data here. Only use it to read files you might be shipping with your mod.
@@ -215,6 +222,18 @@ using namespace ModAPI;
 	std::vector<CoordinateInBlocks> GetAllCoordinatesInBox(CoordinateInBlocks At, CoordinateInBlocks BoxExtent);
 	std::vector<CoordinateInBlocks> GetAllCoordinatesInRadius(CoordinateInBlocks At, int32_t Radius);	
 
+/*
+*	The same coordinates without storing them. The ranges produce them one at a time in the same order, and use the same memory however large the box or radius is.
+*	The ForEach versions call your function for every coordinate and let the compiler inline it.
+*
+*	Example for iterating a radius:																for (CoordinateInBlocks Coordinate : CoordinatesInRadius(At, 10)) { ... }
+*	Example for visiting a box:																	ForEachCoordinateInBox(At, CoordinateInBlocks(4, 4, 4), [](CoordinateInBlocks Coordinate) { ... });
+*/
+	CoordinateRange CoordinatesInBox(CoordinateInBlocks At, CoordinateInBlocks BoxExtent);
+	CoordinateRange CoordinatesInRadius(CoordinateInBlocks At, int32_t Radius);
+	template<typename Visitor> void ForEachCoordinateInBox(CoordinateInBlocks At, CoordinateInBlocks BoxExtent, Visitor&& Visit);
+	template<typename Visitor> void ForEachCoordinateInRadius(CoordinateInBlocks At, int32_t Radius, Visitor&& Visit);
+
 /*
 *	Get a handle to memory that you want to share between multiple different mods. If you don't know what this does, you most likely never need to use it. 
 *	The handle automatically aquires a lock on the memory it points to, and releases it when going out of scope.
@@ -151,6 +151,19 @@ namespace ModAPI {
 		ScopedSharedMemoryHandle& operator=(const ScopedSharedMemoryHandle& i) = delete;
 	};
 
+	struct ScopedModData {
+		uint8_t* Data;
+		uint64_t Size;
+
+		ScopedModData(uint8_t* Data_, uint64_t Size_) : Data(Data_), Size(Size_) {}
+		ScopedModData(ScopedModData&& i) noexcept : Data(i.Data), Size(i.Size) { i.Data = nullptr; i.Size = 0; }
+
+		~ScopedModData(); // Declared here, defined in GameAPI.cpp
+
+		ScopedModData(const ScopedModData& i) = delete;
+		ScopedModData& operator=(const ScopedModData& i) = delete;
+	};
+
 	struct CoordinateInCentimeters;
 	struct CoordinateInBlocks;
 	struct DirectionVectorInCentimeters;
@@ -0,0 +1,150 @@
+#pragma once
+#include "GameAPI.h"
+#include "OperationTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+
+/************************************************************
+	Region jobs are operations that touch too many blocks to finish inside a single game callback.
+	They are queued on the JobExecutor and advanced a batch at a time from Event_Tick.
+*************************************************************/
+
+struct RegionJob {
+	wString name;
+	CoordinateInBlocks hintLocation;
+
+	RegionJob(wString jobName, CoordinateInBlocks hintAt) : name(jobName), hintLocation(hintAt) {}
+	virtual ~RegionJob() = default;
+
+	// Process at most maxBlocks blocks and return how many were processed.
+	virtual int64_t Advance(int64_t maxBlocks) = 0;
+	virtual bool IsFinished() const = 0;
+
+	// Called each tick after the last Advance until it returns true, for work handed to the worker pool
+	// that Complete needs. Jobs behind this one wait, so they see what it commits.
+	virtual bool Finalize() { return true; }
+
+	// Called once after Finalize, e.g. to commit the undo entry.
+	virtual void Complete() {}
+
+	virtual int64_t GetTotalBlocks() const = 0;
+	virtual int64_t GetProcessedBlocks() const = 0;
+	// Voxels the job changed, or would change in a dry run.
+	virtual int64_t GetChangedBlocks() const { return 0; }
+};
+
+class JobExecutor {
+public:
+	// Milliseconds of each tick the executor may spend, and a hard cap on blocks per tick.
+	double frameBudgetMilliseconds;
+	int64_t maxBlocksPerTick;
+	// Records a span per job when set.
+	OperationTracer* tracer = nullptr;
+
+	JobExecutor(double budgetMilliseconds, int64_t maxBlocks) : frameBudgetMilliseconds(budgetMilliseconds), maxBlocksPerTick(maxBlocks) {}
+
+	void Enqueue(std::unique_ptr<RegionJob> job) {
+		jobs.push_back(std::move(job));
+	}
+
+	bool IsIdle() const {
+		return jobs.empty();
+	}
+
+	size_t GetQueuedJobCount() const {
+		return jobs.size();
+	}
+
+	void Tick() {
+		if (jobs.empty()) return;
+
+		const auto tickStart = std::chrono::steady_clock::now();
+		int64_t blocksThisTick = 0;
+
+		while (!jobs.empty()) {
+			double elapsed = MillisecondsSince(tickStart);
+			double remaining = frameBudgetMilliseconds - elapsed;
+			if (remaining <= 0 || blocksThisTick >= maxBlocksPerTick) break;
+
+			RegionJob& job = *jobs.front();
+
+			int64_t processed = 0;
+			if (!job.IsFinished()) {
+				// Size the batch from the measured cost so it ends inside the remaining budget.
+				int64_t batch = int64_t(remaining / costPerBlockMilliseconds);
+				batch = std::clamp<int64_t>(batch, MinimumBatch, maxBlocksPerTick - blocksThisTick);
+
+				if (tracer != nullptr) tracer->BeginBatch(&job, job.name);
+				const auto batchStart = std::chrono::steady_clock::now();
+				processed = job.Advance(batch);
+				double batchTime = MillisecondsSince(batchStart);
+				if (tracer != nullptr) tracer->EndBatch(processed);
+				blocksThisTick += processed;
+
+				if (processed > 0) {
+					double measured = std::max(batchTime / double(processed), MinimumCostPerBlock);
+					costPerBlockMilliseconds += (measured - costPerBlockMilliseconds) * CostSmoothing;
+				}
+			}
+
+			if (job.IsFinished()) {
+				if (!job.Finalize()) break;
+				job.Complete();
+				if (tracer != nullptr) tracer->FinishSpan(job.GetProcessedBlocks(), job.GetChangedBlocks());
+				ClearProgressHint();
+				jobs.pop_front();
+			}
+			else if (processed == 0) {
+				break;
+			}
+		}
+
+		if (!jobs.empty()) {
+			ShowProgress(*jobs.front());
+		}
+	}
+
+private:
+	static constexpr int64_t MinimumBatch = 64;
+	static constexpr double MinimumCostPerBlock = 0.00001;
+	static constexpr double CostSmoothing = 0.25;
+	static constexpr int ProgressStepPercent = 5;
+
+	std::deque<std::unique_ptr<RegionJob>> jobs;
+	double costPerBlockMilliseconds = 0.001;
+
+	void* progressHint = nullptr;
+	int shownPercent = -1;
+
+	static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void ShowProgress(const RegionJob& job) {
+		int64_t total = job.GetTotalBlocks();
+		int percent = (total > 0) ? int(job.GetProcessedBlocks() * 100 / total) : 0;
+		percent -= percent % ProgressStepPercent;
+
+		// The hint text can't be edited, so the one handle is only replaced when the shown value changes.
+		if (progressHint != nullptr && percent == shownPercent) return;
+		ClearProgressHint();
+
+		wString text = job.name + L" " + std::to_wstring(percent) + L"%";
+		if (jobs.size() > 1) {
+			text += L"\n" + std::to_wstring(jobs.size() - 1) + L" queued";
+		}
+		progressHint = SpawnHintTextAdvanced(job.hintLocation, text, -1);
+		shownPercent = percent;
+	}
+
+	void ClearProgressHint() {
+		if (progressHint != nullptr) {
+			DestroyHintText(progressHint);
+			progressHint = nullptr;
+		}
+		shownPercent = -1;
+	}
+};
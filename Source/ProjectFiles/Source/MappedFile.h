@@ -0,0 +1,106 @@
+#pragma once
+#include "GameAPI.h"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#include "windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/************************************************************
+	A read-only memory mapping of a whole file. The OS pages bytes in as they are first touched,
+	so mapping a large file costs nothing up front.
+*************************************************************/
+
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		Close();
+	}
+
+	bool Open(const std::filesystem::path& path) {
+		Close();
+#ifdef _WIN32
+		// Writers may keep appending to the file while it is mapped.
+		file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			Close();
+			return false;
+		}
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) {
+			Close();
+			return false;
+		}
+		bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		byteCount = size_t(fileSize.QuadPart);
+#else
+		descriptor = open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) return false;
+
+		struct stat status;
+		if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+			Close();
+			return false;
+		}
+		void* view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+		bytes = (view == MAP_FAILED) ? nullptr : static_cast<const uint8_t*>(view);
+		byteCount = size_t(status.st_size);
+#endif
+		if (bytes == nullptr) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close() {
+#ifdef _WIN32
+		if (bytes != nullptr) UnmapViewOfFile(bytes);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes != nullptr) munmap(const_cast<uint8_t*>(bytes), byteCount);
+		if (descriptor >= 0) close(descriptor);
+		descriptor = -1;
+#endif
+		bytes = nullptr;
+		byteCount = 0;
+	}
+
+	bool IsOpen() const {
+		return bytes != nullptr;
+	}
+
+	const uint8_t* data() const {
+		return bytes;
+	}
+
+	size_t size() const {
+		return byteCount;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int descriptor = -1;
+#endif
+	const uint8_t* bytes = nullptr;
+	size_t byteCount = 0;
+};
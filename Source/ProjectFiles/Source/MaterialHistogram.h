@@ -0,0 +1,136 @@
+#pragma once
+#include "GameAPI.h"
+#include "BlockPalette.h"
+#include "Clipboard.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+/************************************************************
+	How many of each block an operation places or removes. The counts are kept per palette entry, so adding
+	a voxel is a palette lookup and an increment, and a whole operation settles with the inventory in one
+	call per distinct block. Air and Invalid aren't items and are never counted; rotation isn't part of an
+	item either, so a torch counts the same whichever way it faces.
+*************************************************************/
+
+struct MaterialHistogram {
+	BlockPalette blocks;
+	std::vector<int64_t> counts;
+
+	static bool IsMaterial(const BlockInfo& block) {
+		return block.Type != EBlockType::Air && block.Type != EBlockType::Invalid;
+	}
+
+	bool empty() const {
+		return std::all_of(counts.begin(), counts.end(), [](int64_t count) { return count == 0; });
+	}
+
+	void clear() {
+		blocks.clear();
+		counts.clear();
+	}
+
+	void Add(const BlockInfo& block, int64_t count = 1) {
+		if (!IsMaterial(block)) return;
+		uint32_t index = blocks.IndexOf(BlockInfo(block.Type, ERotation::None, block.CustomBlockID));
+		if (index >= counts.size()) counts.resize(size_t(index) + 1, 0);
+		counts[index] += count;
+	}
+
+	void Add(const MaterialHistogram& other, int64_t sign = 1) {
+		for (size_t i = 0; i < other.counts.size(); i++) {
+			if (other.counts[i] != 0) Add(other.blocks[i], other.counts[i] * sign);
+		}
+	}
+
+	// Counts a clipboard in one pass over its packed indices, then once per palette entry.
+	void AddClipboard(const ClipboardView& view) {
+		std::vector<int64_t> perEntry(view.paletteSize, 0);
+		int64_t volume = view.GetVolume();
+		for (int64_t i = 0; i < volume; i++) {
+			perEntry[view.GetPaletteIndex(i)]++;
+		}
+		for (size_t i = 0; i < view.paletteSize; i++) {
+			if (perEntry[i] != 0) Add(view.palette[i], perEntry[i]);
+		}
+	}
+
+	// The blocks with a count, largest first.
+	std::vector<std::pair<BlockInfo, int64_t>> GetEntries() const {
+		std::vector<std::pair<BlockInfo, int64_t>> entries;
+		for (size_t i = 0; i < counts.size(); i++) {
+			if (counts[i] != 0) entries.emplace_back(blocks[i], counts[i]);
+		}
+		std::stable_sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return std::abs(a.second) > std::abs(b.second); });
+		return entries;
+	}
+
+	// One line per block, "Stone x120", with anything past maxLines summed up in a last line.
+	// Negative counts are listed as coming back.
+	wString GetSummary(size_t maxLines = 8) const {
+		std::vector<std::pair<BlockInfo, int64_t>> entries = GetEntries();
+		if (entries.empty()) return L"No materials";
+
+		wString text;
+		for (size_t i = 0; i < entries.size() && i < maxLines; i++) {
+			if (i > 0) text += L"\n";
+			int64_t count = entries[i].second;
+			text += GetMaterialName(entries[i].first) + (count < 0 ? L" +" + std::to_wstring(-count) + L" back" : L" x" + std::to_wstring(count));
+		}
+		if (entries.size() > maxLines) {
+			text += L"\n" + std::to_wstring(entries.size() - maxLines) + L" more kinds";
+		}
+		return text;
+	}
+
+	static wString GetMaterialName(const BlockInfo& block) {
+		static const wchar_t* const names[] = {
+		L"Stone", L"Grass", L"Dirt", L"Air", L"BottomStone", L"GrassFoliage", L"TreeWood", L"Unused1", L"Unused2",
+		L"Unused3", L"Sand", L"Invalid", L"Ore_Coal", L"Ore_Iron", L"TreeRoot", L"Torch", L"Flower1", L"Flower2", L"T_Stick",
+		L"T_PickAxe_Stone", L"T_Axe_Stone", L"T_Shovel_Stone", L"Nugget_Copper", L"Nugget_Gold", L"Nugget_Coal",
+		L"Ore_Copper", L"Ore_Gold", L"Unused4", L"T_PickAxe_Copper", L"T_Axe_Copper", L"T_Shovel_Copper", L"Unused5",
+		L"TreeWoodBright", L"WoodPlankBright", L"WoodPlank", L"StoneMined", L"Flower3", L"TorchBlue", L"DyeBlue", L"Flower4",
+		L"TorchGreen", L"DyeGreen", L"Compass", L"Chest1", L"SpecialBlockObject", L"MeshObject", L"Wallstone", L"Flagstone",
+		L"DyeRed", L"TorchRed", L"Chair1", L"Chair1Birch", L"WoodScaffolding", L"Arrow", L"WallmountCopper", L"Cactus",
+		L"DesertGrass", L"FrameWood", L"FrameGold", L"FrameCopper", L"T_Sledgehammer_Copper", L"TorchRainbow", L"DyeRainbow",
+		L"FlowerRainbow", L"DyeWhite", L"Unused6", L"ModBlock", L"CrystalBlock", L"Crystal", L"Furnace", L"FurnaceMoldIron",
+		L"FlintStone", L"DryGrass", L"IngotIron", L"T_PickAxe_Iron", L"T_Sledgehammer_Iron", L"T_Axe_Iron", L"T_Shovel_Iron",
+		L"WoodStool", L"WoodTable1", L"WoodTable2", L"WoodCarafe", L"WoodBench1", L"WoodBarrel", L"WoodPost", L"MetalPod",
+		L"WoodBench2", L"WoodBench3", L"SandbagPile", L"GlassBlock", L"ModBlockTransparent", L"GlassIngot",
+		L"LootableInventory", L"RespawnTorch", L"T_Bow", L"SmoothbrainStatue"
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == size_t(EBlockType::MAX_BLOCKTYPE), "A block type has no name");
+
+		if (block.CustomBlockID != 0) return L"Custom block " + std::to_wstring(block.CustomBlockID);
+		if (size_t(block.Type) < size_t(EBlockType::MAX_BLOCKTYPE)) return names[size_t(block.Type)];
+		return L"Block " + std::to_wstring(int(block.Type));
+	}
+
+	// Takes what the histogram counts as placed from the inventory and gives back what it counts as removed,
+	// one call per block.
+	void Settle() const {
+		for (size_t i = 0; i < counts.size(); i++) {
+			Settle(blocks[i], counts[i]);
+		}
+	}
+
+	// Settles entries from GetEntries again, or with a sign of -1 reverses them.
+	static void Settle(const std::vector<std::pair<BlockInfo, int64_t>>& entries, int64_t sign) {
+		for (const auto& [block, count] : entries) {
+			Settle(block, count * sign);
+		}
+	}
+
+	// Takes count of the block from the inventory, or gives -count back, in one call.
+	// No inventory holds more than an int, so a larger count is capped there.
+	static void Settle(const BlockInfo& block, int64_t count) {
+		if (count == 0) return;
+		int amount = int(std::min<int64_t>(std::abs(count), INT_MAX));
+		if (count > 0) RemoveFromInventory(block, amount);
+		else AddToInventory(block, amount);
+	}
+};
@@ -1,11 +1,84 @@
 #include "GameAPI.h"
-#include <list>
+#include "JobExecutor.h"
+#include "Clipboard.h"
+#include "OperationHistory.h"
+#include "WritePlanner.h"
+#include "OperationJournal.h"
+#include "DeferredWrites.h"
+#include "BlockMask.h"
+#include "ReplaceTable.h"
+#include "RegionTraversal.h"
+#include "ModSave.h"
+#include "SchematicLibrary.h"
+#include "ShapeSpans.h"
+#include "VoxelSet.h"
+#include "WorkerPool.h"
+#include "SharedClipboard.h"
+
+#include <cmath>
+#include <functional>
 
 /************************************************************
 	Config Variables (Set these to whatever you need. They are automatically read by the game.)
 *************************************************************/
-float TickRate = 1;
-const int UndoHistoryLength = 5;
+float TickRate = 90;
+
+// Memory each of the undo and redo histories may hold before their oldest entries are dropped.
+const size_t UndoHistoryBudgetBytes = 256 * 1024 * 1024;
+// Of that, what each keeps in memory. Older entries are spilled to a file in the world's mod save folder
+// and mapped back in when they are undone.
+const size_t UndoHistoryResidentBytes = 32 * 1024 * 1024;
+
+// Threads for the work that doesn't touch the world, like encoding undo entries. The game keeps the rest of the cores busy.
+const size_t WorkerThreadCount = 2;
+
+// Region jobs are spread over ticks so a single tick stays well inside a 90 Hz frame (11.1 ms).
+const double JobFrameBudgetMilliseconds = 3.0;
+const int64_t JobMaxBlocksPerTick = 250000;
+
+// The tallest column of stack counts read from on top of the Copy block.
+const int16_t MaxStackColumnHeight = 64;
+
+// A flood fill stops growing once it holds this many blocks.
+const int64_t FloodFillMaxBlocks = 4 * 1024 * 1024;
+// The most blocks a selection built from boxes, polygons and the mask may hold, at one bit each.
+const int64_t SelectionMaxBlocks = 256 * 1024 * 1024;
+
+// For survival worlds: every operation takes the blocks it places from the inventory and gives back the ones
+// it replaces, settled once it's done. The game doesn't tell mods the game mode, so this is set by hand.
+bool ChargeInventory = false;
+
+// Publishes the clipboard under SharedClipboardKey for other mods to paste from memory, and pastes whichever
+// clipboard was published there last, this mod's or another's.
+bool ShareClipboard = false;
+
+// Shows the counters of each finished operation as a hint text as well as logging them.
+const bool ShowOperationSummaries = false;
+
+// How often the operation journal writes out what it has buffered, and the size at which the
+// histories are saved so the journal can start over.
+const double JournalCheckpointMilliseconds = 1000.0;
+const uint64_t JournalCompactBytes = 64 * 1024 * 1024;
+
+// Writes into chunks that aren't loaded wait in a queue of at most this size, and are written out
+// once the player is close enough. The queue is checked for loaded chunks every DeferredCheckTicks ticks.
+const size_t DeferredWriteBudgetBytes = 64 * 1024 * 1024;
+const int DeferredCheckTicks = 45;
+
+// Names the mod's state is saved under in each world.
+const wString SessionSaveName = L"CyubePainterSession";
+const wString ClipboardSaveName = L"CyubePainterClipboard";
+const wString HistorySaveName = L"CyubePainterHistory";
+const wString DeferredSaveName = L"CyubePainterDeferred";
+// The shared memory key the clipboard is published under.
+const wString SharedClipboardKey = L"CyubePainter.Clipboard";
+// The operation spans are written here, in the world's mod save folder, as Chrome trace-event JSON.
+const wString TraceFileName = L"CyubePainterTrace.json";
+// The operation journal, in the world's mod save folder.
+const wString JournalFileName = L"CyubePainterJournal.bin";
+// The older undo and redo entries, in the world's mod save folder. They only live as long as the world is loaded.
+const wString UndoSpillFileName = L"CyubePainterUndo.spill";
+const wString RedoSpillFileName = L"CyubePainterRedo.spill";
 
 // Unique Mod IDS
 //********************************
@@ -29,36 +102,6 @@ UniqueID ThisModUniqueIDs[] = {
 	PaintBlock, UndoBlock, Marker1Block, Marker2Block, MaskBlock, ToggleWandBlock, CopyBlock, CutBlock, 
 	PasteBlock, Rotate90CWBlock, RedoBlock, Rotate90CCWBlock, PaletteBlock, ToggleExchangeBlock };
 
-// Data Structs
-//********************************
-struct Block {
-	BlockInfo blockInfo;
-	CoordinateInBlocks location;
-
-	Block(BlockInfo info, CoordinateInBlocks cords) {
-		blockInfo = info;
-		location = cords;
-	}
-};
-struct PaintOperation {
-	std::vector<Block> paintedBlocks;
-
-	PaintOperation ExecutePaint() {
-		std::vector<Block> reverseOperation;
-
-
-		for (int i = 0; i < paintedBlocks.size(); i++) {
-			reverseOperation.push_back(
-				Block(
-				GetAndSetBlock(paintedBlocks[i].location, paintedBlocks[i].blockInfo),
-				paintedBlocks[i].location
-				)
-			);
-		}
-		return PaintOperation(reverseOperation);
-	}
-};
-
 // State Variables
 //********************************
 CoordinateInBlocks marker1Cord;
@@ -67,17 +110,49 @@ CoordinateInBlocks maskCord;
 CoordinateInBlocks paintCord;
 
 bool selectionWandEnabled = false;
-bool exchangingWandEnabled = false;
 
-std::list<PaintOperation> undoHistory;
-std::list<PaintOperation> redoHistory;
-std::vector<Block> clipboard;
+// Built from flood fills, marker boxes, polygons and the mask. While set, region operations only visit its voxels
+// and leave the marker box alone; it is never changed in place, since running jobs hold on to it.
+std::shared_ptr<const VoxelSet> voxelSelection;
+// The corners of the polygon being outlined with the selection wand.
+std::vector<CoordinateInBlocks> selectionPolygon;
+bool exchangingWandEnabled = false;
 
-int64_t clipboardWidth;
-int64_t clipboardLength;
+OperationHistory undoHistory(UndoHistoryBudgetBytes, UndoHistoryResidentBytes);
+OperationHistory redoHistory(UndoHistoryBudgetBytes, UndoHistoryResidentBytes);
+Clipboard clipboard;
 
 BlockInfo exchangeTarget(EBlockType::Air);
 
+JobExecutor jobExecutor(JobFrameBudgetMilliseconds, JobMaxBlocksPerTick);
+// Runs the stages that don't touch the world. Started on load and stopped on exit.
+WorkerPool workerPool;
+OperationTracer operationTracer;
+OperationJournal operationJournal;
+// Set while the unfinished operation a crash left behind is being rolled back. The journal is kept until it's done.
+bool journalRollbackPending = false;
+DeferredWriteQueue deferredWrites(DeferredWriteBudgetBytes);
+int ticksSinceDeferredCheck = 0;
+
+// The clipboard and the histories are only read back from the save when first used, so loading a world doesn't wait on them.
+bool clipboardRestorePending = false;
+bool historyRestorePending = false;
+
+// Bumped on every clipboard change; the clipboard is saved in the background whenever it differs from the saved one.
+uint64_t clipboardVersion = 0;
+uint64_t savedClipboardVersion = 0;
+BackgroundSave clipboardSave(ClipboardSaveName, workerPool);
+// The clipboard version last published, or none yet.
+uint64_t publishedClipboardVersion = UINT64_MAX;
+std::vector<uint8_t> savedSession;
+
+// Span tables of the last few shapes painted.
+ShapeSpanCache shapeSpanCache(8);
+
+// Opened on first use, since the global save folder can only be asked for once the game is running.
+SchematicLibrary schematicLibrary;
+int64_t selectedSchematic = -1;
+
 // Utility Methods
 //********************************
 CoordinateInBlocks GetSmallVector(CoordinateInBlocks cord1, CoordinateInBlocks cord2) {
@@ -145,60 +220,243 @@ std::vector<BlockInfo> GetMaskBlocks()
 	std::vector<BlockInfo> maskBlocks;
 	BlockInfo block = GetBlock(maskCord + CoordinateInBlocks(0, 0, 1));
 	int i = 1;
-	while (block.Type != EBlockType::Air) {
+	while (block.Type != EBlockType::Air && block.IsValid()) {
 		maskBlocks.push_back(block);
 		i++;
 		block = GetBlock(maskCord + CoordinateInBlocks(0, 0, i));
 	}
 	return maskBlocks;
 }
-bool BlockIsMaskTarget(BlockInfo info, std::vector<BlockInfo> mask) {
-	for (BlockInfo maskInfo : mask) {
-		if (maskInfo.CustomBlockID == AirFilter && info.Type == EBlockType::Air)
-			return true;
-		if (info.Type == maskInfo.Type && info.CustomBlockID == maskInfo.CustomBlockID)
-			return true;
+
+// Compiles the mask column once per operation. An Air Filter in the column selects air,
+// and a second Mask block stacked in it turns the mask into an exclude mask.
+BlockMask CompileMask(const std::vector<BlockInfo>& maskBlocks) {
+	BlockMask mask;
+	for (const BlockInfo& maskInfo : maskBlocks) {
+		if (maskInfo.CustomBlockID == AirFilter) {
+			mask.AddNative(EBlockType::Air);
+		}
+		else if (maskInfo.CustomBlockID == MaskBlock) {
+			mask.inverted = !mask.inverted;
+		}
+		else if (maskInfo.CustomBlockID != 0) {
+			mask.AddCustom(maskInfo.CustomBlockID);
+		}
+		else {
+			mask.AddNative(maskInfo.Type);
+		}
 	}
-	return false;
+	return mask;
 }
 
-// Undo Methods
+// Whether At is in the column on top of the palette's Mask block, or the free spot right above it.
+// A Mask block there is part of the mask, not a new palette Mask block.
+bool IsInMaskColumn(CoordinateInBlocks At) {
+	if (At.X != maskCord.X || At.Y != maskCord.Y || At.Z <= maskCord.Z) return false;
+	if (GetBlock(maskCord).CustomBlockID != MaskBlock) return false;
+	return int64_t(At.Z) - maskCord.Z <= int64_t(GetMaskBlocks().size()) + 1;
+}
+
+// The mask of the palette's Mask block, or an inactive one when no Mask block is placed.
+BlockMask GetPaletteMask() {
+	if (GetBlock(maskCord).CustomBlockID != MaskBlock) return BlockMask();
+	return CompileMask(GetMaskBlocks());
+}
+
+// Reads the mask column as source and destination pairs, bottom up. An Air Filter stands for air on either side.
+// A last source without a destination is left out.
+ReplaceTable CompileReplaceTable(const std::vector<BlockInfo>& columnBlocks) {
+	ReplaceTable table;
+	for (size_t i = 0; i + 1 < columnBlocks.size(); i += 2) {
+		BlockInfo source = (columnBlocks[i].CustomBlockID == AirFilter) ? BlockInfo(EBlockType::Air) : columnBlocks[i];
+		BlockInfo destination = (columnBlocks[i + 1].CustomBlockID == AirFilter) ? BlockInfo(EBlockType::Air) : columnBlocks[i + 1];
+		table.Add(source, destination);
+	}
+	return table;
+}
+
+// Save Methods
 //********************************
-void AddRedoOperation(const PaintOperation& paintOp) {
-	if (redoHistory.size() >= UndoHistoryLength) {
-		redoHistory.pop_back();
+std::vector<uint8_t> EncodeSession() {
+	ByteWriter writer;
+	WriteSaveHeader(writer);
+	writer.WriteCoordinate(marker1Cord);
+	writer.WriteCoordinate(marker2Cord);
+	writer.WriteCoordinate(maskCord);
+	writer.WriteCoordinate(paintCord);
+	writer.WriteU8(selectionWandEnabled);
+	writer.WriteU8(exchangingWandEnabled);
+	writer.WriteBlockInfo(exchangeTarget);
+	return std::move(writer.bytes);
+}
+
+void RestoreSession() {
+	ScopedModData saved = LoadModDataInPlace(SessionSaveName);
+	ByteReader reader(saved.Data, size_t(saved.Size));
+	if (!ReadSaveHeader(reader)) return;
+
+	CoordinateInBlocks marker1 = reader.ReadCoordinate();
+	CoordinateInBlocks marker2 = reader.ReadCoordinate();
+	CoordinateInBlocks mask = reader.ReadCoordinate();
+	CoordinateInBlocks paint = reader.ReadCoordinate();
+	bool selectionWand = reader.ReadU8() != 0;
+	bool exchangingWand = reader.ReadU8() != 0;
+	BlockInfo exchange = reader.ReadBlockInfo();
+	if (reader.failed) return;
+
+	marker1Cord = marker1;
+	marker2Cord = marker2;
+	maskCord = mask;
+	paintCord = paint;
+	selectionWandEnabled = selectionWand;
+	exchangingWandEnabled = exchangingWand;
+	exchangeTarget = exchange;
+	savedSession = EncodeSession();
+}
+
+// The session is a few dozen bytes, so it is compared every tick instead of tracking each place it changes.
+void SaveSessionIfChanged() {
+	std::vector<uint8_t> session = EncodeSession();
+	if (session == savedSession) return;
+	SaveModData(SessionSaveName, session);
+	savedSession.swap(session);
+}
+
+void RestoreClipboard() {
+	if (!clipboardRestorePending) return;
+	clipboardRestorePending = false;
+
+	// Decoded straight out of the game's buffer, without the copy LoadModData makes.
+	ScopedModData saved = LoadModDataInPlace(ClipboardSaveName);
+	ByteReader reader(saved.Data, size_t(saved.Size));
+	if (ReadSaveHeader(reader)) {
+		clipboard.Read(reader);
 	}
-	redoHistory.push_front(paintOp);
 }
-void AddUndoOperation(const PaintOperation& paintOp) {
-	if (undoHistory.size() >= UndoHistoryLength) {
-		undoHistory.pop_back();
+
+std::vector<uint8_t> EncodeClipboard(const Clipboard& source) {
+	ByteWriter writer;
+	WriteSaveHeader(writer);
+	source.Write(writer);
+	return std::move(writer.bytes);
+}
+
+// Starts encoding a snapshot of the clipboard on a worker thread if it changed since it was last saved.
+void SaveClipboardInBackground() {
+	clipboardSave.Poll();
+	if (clipboardSave.IsBusy() || clipboardVersion == savedClipboardVersion) return;
+
+	savedClipboardVersion = clipboardVersion;
+	std::shared_ptr<const Clipboard> snapshot = std::make_shared<Clipboard>(clipboard);
+	clipboardSave.Start([snapshot]() { return EncodeClipboard(*snapshot); });
+}
+
+// Publishes the clipboard if it changed since it was last published. The clipboard's address tells this
+// copy of the mod's buffers from the ones other mods publish.
+void PublishClipboard() {
+	if (!ShareClipboard) return;
+	RestoreClipboard();
+	if (clipboardVersion == publishedClipboardVersion) return;
+
+	publishedClipboardVersion = clipboardVersion;
+	if (clipboard.empty()) SharedClipboard::Withdraw(SharedClipboardKey, &clipboard);
+	else SharedClipboard::Publish(SharedClipboardKey, clipboard, &clipboard);
+}
+
+void RestoreHistory() {
+	if (!historyRestorePending) return;
+	historyRestorePending = false;
+
+	ScopedModData saved = LoadModDataInPlace(HistorySaveName);
+	ByteReader reader(saved.Data, size_t(saved.Size));
+	if (!ReadSaveHeader(reader)) return;
+	if (!undoHistory.Read(reader) || !redoHistory.Read(reader)) {
+		undoHistory.clear();
+		redoHistory.clear();
 	}
-	undoHistory.push_front(paintOp);
 }
 
-void UndoLastOperation() {
-	if (undoHistory.empty()) return;
+void SaveHistory() {
+	ByteWriter writer;
+	WriteSaveHeader(writer);
+	undoHistory.Write(writer);
+	redoHistory.Write(writer);
+	SaveModData(HistorySaveName, writer.bytes);
+}
 
-	PaintOperation paintOp = undoHistory.front();
-	AddRedoOperation(paintOp.ExecutePaint());
-	undoHistory.pop_front();
+// Undo Methods
+//********************************
+// The journal logs the entry as well, so the histories can be rebuilt after a crash.
+// An operation that only queued writes still gets an entry, so undoing it can drop them.
+void AddHistoryOperation(WritePlanner& planner, JournalStack pushTo, std::vector<std::pair<BlockInfo, int64_t>> charged) {
+	if (planner.recorder.empty() && planner.deferredTag == 0) {
+		operationJournal.Commit(JournalStack::None, nullptr);
+		return;
+	}
+	OperationHistory& history = (pushTo == JournalStack::Redo) ? redoHistory : undoHistory;
+	RestoreHistory();
+	PaintOperation paintOp = planner.recorder.Finish();
+	paintOp.deferredTag = planner.deferredTag;
+	paintOp.charged = std::move(charged);
+	history.Push(std::move(paintOp));
+	operationJournal.Commit(pushTo, &history.entries.front());
+}
+void AddRedoOperation(WritePlanner& planner, std::vector<std::pair<BlockInfo, int64_t>> charged) {
+	AddHistoryOperation(planner, JournalStack::Redo, std::move(charged));
+}
+void AddUndoOperation(WritePlanner& planner, std::vector<std::pair<BlockInfo, int64_t>> charged) {
+	AddHistoryOperation(planner, JournalStack::Undo, std::move(charged));
 }
 
-void RedoLastOperation() {
-	if (redoHistory.empty()) return;
+// Crash Recovery
+//********************************
+OperationHistory& GetJournalHistory(JournalStack stack) {
+	return (stack == JournalStack::Redo) ? redoHistory : undoHistory;
+}
 
-	PaintOperation paintOp = redoHistory.front();
-	AddUndoOperation(paintOp.ExecutePaint());
-	redoHistory.pop_front();
+// Saves the histories the journal rebuilt, after which the journal can start over.
+void CompactJournal() {
+	RestoreHistory();
+	SaveHistory();
+	operationJournal.Truncate();
 }
 
 // Paint Methods
 //********************************
-void Paint(PaintOperation& paintOp, BlockInfo newBlock, CoordinateInBlocks At) {
-	paintOp.paintedBlocks.push_back(
-		Block(GetAndSetBlock(At, newBlock), At)
-	);
+wString GetDeferredQueueSummary() {
+	return L"Queue: " + std::to_wstring(deferredWrites.size()) + L" blocks in " + std::to_wstring(deferredWrites.GetChunkCount()) + L" chunks, "
+		+ std::to_wstring((deferredWrites.GetMemoryBytes() + 1023) / 1024) + L" KB";
+}
+
+// Says how many of an operation's writes went to unloaded chunks, so a partly written region is never silent.
+void ReportDeferredWrites(const WritePlanner& planner, CoordinateInBlocks hintAt) {
+	if (planner.dryRun || (planner.deferredBlocks == 0 && planner.droppedBlocks == 0)) return;
+
+	wString text = std::to_wstring(planner.deferredBlocks) + L" blocks wait for their chunks to load\n" + GetDeferredQueueSummary();
+	if (planner.droppedBlocks > 0) {
+		text += L"\nThe queue is full: " + std::to_wstring(planner.droppedBlocks) + L" blocks were not written";
+	}
+	SpawnHintText(hintAt, text, 5, 1, 1);
+	Log(text);
+}
+
+// Settles an applied operation with the inventory and returns what it charged, which its undo entry keeps.
+// Undo and redo don't come through here; they settle what the entry charged.
+std::vector<std::pair<BlockInfo, int64_t>> ChargeMaterials(const WritePlanner& planner) {
+	if (!ChargeInventory || planner.dryRun) return {};
+	MaterialHistogram bill = planner.GetMaterialBill();
+	bill.Settle();
+	return bill.GetEntries();
+}
+
+// Commits the planned writes as an undo entry, or reports what a dry run found.
+void FinishPlan(WritePlanner& planner, const TiledRegionCursor& cursor, CoordinateInBlocks hintAt) {
+	if (planner.dryRun) {
+		SpawnHintText(hintAt, planner.GetDryRunSummary() + L"\n" + cursor.GetWriteSummary(), 5, 1, 1);
+		return;
+	}
+	AddUndoOperation(planner, ChargeMaterials(planner));
+	ReportDeferredWrites(planner, hintAt);
 }
 
 bool MarkersInLoadedChunks() {
@@ -225,6 +483,11 @@ bool MarkersInLoadedChunks() {
 	return true;
 }
 
+// The region operations work on the selection when there is one. Without one they need both markers loaded.
+bool RegionIsReady() {
+	return voxelSelection != nullptr || MarkersInLoadedChunks();
+}
+
 BlockInfo SetPaintTarget() {
 	if (!GetBlock(paintCord).IsValid()) {
 		SpawnHintText(
@@ -241,106 +504,1134 @@ BlockInfo SetPaintTarget() {
 	}
 }
 
-void PaintArea() {
-	bool useMask = false;
-	std::vector<BlockInfo> maskBlocks;
-	PaintOperation paintOp;
+// Region Jobs
+//********************************
+// Region jobs start with the chunks closest to the player.
+TiledRegionCursor GetRegionCursor(CoordinateInBlocks corner1, CoordinateInBlocks corner2) {
+	return TiledRegionCursor(GetSmallVector(corner1, corner2), GetLargeVector(corner1, corner2), TileOrder::NearestFirst, CoordinateInBlocks(GetPlayerLocation()));
+}
 
-	if (!MarkersInLoadedChunks()) return;
+// The selection's voxels when there is one, otherwise the marker box.
+TiledRegionCursor GetSelectionCursor() {
+	if (voxelSelection != nullptr) {
+		return TiledRegionCursor(voxelSelection, TileOrder::NearestFirst, CoordinateInBlocks(GetPlayerLocation()));
+	}
+	return GetRegionCursor(marker1Cord, marker2Cord);
+}
 
-	BlockInfo targetBlock = SetPaintTarget();
-	if (!targetBlock.IsValid()) return;
+bool ShapeFits(CoordinateInBlocks size, CoordinateInBlocks hintAt) {
+	if (size.X <= ShapeSpanTable::MaxSize && size.Y <= ShapeSpanTable::MaxSize && size.Z <= ShapeSpanTable::MaxSize) return true;
+	SpawnHintText(hintAt, L"Shapes can be at most " + std::to_wstring(ShapeSpanTable::MaxSize) + L" blocks across.", 1, 1);
+	return false;
+}
 
-	// Set the block mask if one exists
-	if ((GetBlock(maskCord).IsValid())) {
-		maskBlocks = GetMaskBlocks();
-		if (!(maskBlocks.empty())) {
-			useMask = true;
+// Region jobs look at the selection only once they start, so selection edits queued before them apply.
+// Without a selection the markers must still be loaded by then; otherwise the job ends without writing.
+bool StartSelectionCursor(TiledRegionCursor& cursor) {
+	if (!RegionIsReady()) return false;
+	cursor = GetSelectionCursor();
+	return true;
+}
+
+// Paints the selection or the marker box, or only the shape inscribed in its bounds when one is given.
+struct PaintJob : RegionJob {
+	TiledRegionCursor cursor;
+	BlockInfo targetBlock;
+	BlockMask mask;
+	ShapeKind shapeKind;
+	bool hollow;
+	bool dryRun;
+	bool started = false;
+	// The shape's table is solved on the worker pool; painting starts once it's ready.
+	std::shared_ptr<ShapeTask> shapeTask;
+	std::shared_ptr<const ShapeSpanTable> shape;
+	WritePlanner planner;
+
+	PaintJob(CoordinateInBlocks hintAt, BlockInfo target, BlockMask paintMask, bool isDryRun, ShapeKind paintShape = ShapeKind::Box, bool isHollow = false)
+		: RegionJob(isDryRun ? L"Planning Paint" : L"Painting Area", hintAt), targetBlock(target), mask(paintMask), shapeKind(paintShape), hollow(isHollow), dryRun(isDryRun) {}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		if (!started) {
+			started = true;
+			if (!StartSelectionCursor(cursor)) return 0;
+			if (shapeKind != ShapeKind::Box || hollow) {
+				// Inscribed in the bounds the cursor walks. Usually solved already, from when the paint was queued.
+				CoordinateInBlocks size = cursor.endCorner - cursor.startCorner + CoordinateInBlocks(1, 1, 1);
+				if (!ShapeFits(size, hintLocation)) {
+					cursor = TiledRegionCursor();
+					return 0;
+				}
+				shapeTask = shapeSpanCache.Get(shapeKind, size.X, size.Y, size.Z, hollow, workerPool);
+			}
+			planner.Begin(cursor.startCorner, cursor.endCorner, dryRun, &operationJournal, &deferredWrites);
+		}
+		if (shapeTask != nullptr && shape == nullptr) {
+			if (!shapeTask->IsReady()) return 0;
+			shape = shapeTask->Get();
+		}
+
+		if (!mask.IsActive()) return PaintRows<MaskKind::None>(maxBlocks);
+		if (mask.customBlocks.empty()) return PaintRows<MaskKind::Native>(maxBlocks);
+		return PaintRows<MaskKind::Custom>(maxBlocks);
+	}
+
+	// The mask is looked at once per batch and picks one of these, so the row loops never branch on it.
+	// A native-only mask is a table lookup per voxel; one with custom blocks also probes their hash set.
+	enum class MaskKind { None, Native, Custom };
+
+	template<MaskKind Mask> int64_t PaintRows(int64_t maxBlocks) {
+		int64_t processed = 0;
+		while (processed < maxBlocks && !cursor.IsDone()) {
+			CoordinateInBlocks rowStart;
+			if (cursor.selection != nullptr) {
+				uint32_t selected = cursor.NextSelectedRow(rowStart);
+				processed += std::popcount(selected);
+				PaintRow<Mask>(rowStart, ChunkSizeInBlocks, shape == nullptr ? selected : selected & GetShapeBits(rowStart, ChunkSizeInBlocks));
+				continue;
+			}
+			if (shape == nullptr) {
+				int64_t count = cursor.NextRun(std::min<int64_t>(64, maxBlocks - processed), rowStart);
+				PaintRow<Mask>(rowStart, count, ~uint64_t(0) >> (64 - count));
+				processed += count;
+				continue;
+			}
+
+			// Shapes take a whole tile row and only touch the part of it inside the shape.
+			// A row that misses the shape still costs one block of the budget.
+			int64_t count = cursor.NextRun(ChunkSizeInBlocks, rowStart);
+			uint64_t inside = GetShapeBits(rowStart, count);
+			PaintRow<Mask>(rowStart, count, inside);
+			processed += 1 + std::popcount(inside);
+		}
+		return processed;
+	}
+
+	// Bit i is set when rowStart + (i, 0, 0) is inside the shape, for a row of up to 64 voxels inside its bounds.
+	uint64_t GetShapeBits(CoordinateInBlocks rowStart, int64_t count) const {
+		const ShapeRow& row = shape->GetRow(rowStart.Y - cursor.startCorner.Y, int64_t(rowStart.Z) - cursor.startCorner.Z);
+		uint64_t bits = 0;
+		for (uint8_t i = 0; i < row.count; i++) {
+			int64_t first = std::max<int64_t>(rowStart.X, cursor.startCorner.X + row.start[i]);
+			int64_t last = std::min<int64_t>(rowStart.X + count - 1, cursor.startCorner.X + row.end[i]);
+			if (first > last) continue;
+
+			bits |= (~uint64_t(0) >> (64 - (last - first + 1))) << (first - rowStart.X);
 		}
+		return bits;
 	}
 
-	CoordinateInBlocks startCorner = GetSmallVector(marker1Cord, marker2Cord);
-	CoordinateInBlocks endCorner = GetLargeVector(marker1Cord, marker2Cord);
+	// Paints the voxels of one row of up to 64 that rowBits holds, so the mask is evaluated for the whole row at once.
+	// Only those voxels are read.
+	template<MaskKind Mask> void PaintRow(CoordinateInBlocks rowStart, int64_t count, uint64_t rowBits) {
+		BlockInfo row[64];
+		ForEachSetBit(rowBits, [&](size_t i) {
+			row[i] = GetBlock(rowStart + CoordinateInBlocks(int64_t(i), 0, 0));
+		});
+
+		uint64_t paintBits = rowBits;
+		if constexpr (Mask != MaskKind::None) paintBits &= mask.MatchRow<Mask == MaskKind::Native>(row, size_t(count));
+		ForEachSetBit(paintBits, [&](size_t i) {
+			if (planner.Plan(rowStart + CoordinateInBlocks(int64_t(i), 0, 0), row[i], targetBlock)) cursor.CountWrite();
+		});
+	}
+	bool IsFinished() const override { return started && cursor.IsDone(); }
+	bool Finalize() override { return planner.FinishInBackground(workerPool); }
+	void Complete() override { FinishPlan(planner, cursor, hintLocation); }
+	int64_t GetTotalBlocks() const override { return cursor.total; }
+	int64_t GetProcessedBlocks() const override { return cursor.visited; }
+	int64_t GetChangedBlocks() const override { return planner.changedBlocks; }
+};
 
-	for (int16_t z = startCorner.Z; z <= endCorner.Z; z++) {
+// Replaces every voxel of the selection or the marker box that has a rule, in one pass however many rules there are.
+struct ReplaceJob : RegionJob {
+	TiledRegionCursor cursor;
+	ReplaceTable table;
+	WritePlanner planner;
+	bool dryRun;
+	bool started = false;
+
+	ReplaceJob(CoordinateInBlocks hintAt, ReplaceTable rules, bool isDryRun)
+		: RegionJob(isDryRun ? L"Planning Replace" : L"Replacing Blocks", hintAt), table(std::move(rules)), dryRun(isDryRun) {}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		if (!started) {
+			started = true;
+			if (!StartSelectionCursor(cursor)) return 0;
+			planner.Begin(cursor.startCorner, cursor.endCorner, dryRun, &operationJournal, &deferredWrites);
+		}
+		return table.customTargets.empty() ? ReplaceRows<true>(maxBlocks) : ReplaceRows<false>(maxBlocks);
+	}
 
-		for (int64_t y = startCorner.Y; y <= endCorner.Y; y++) {
+	// One kernel per kind of table, picked once per batch, so the lookup loop never branches on it.
+	template<bool NativeOnly> int64_t ReplaceRows(int64_t maxBlocks) {
+		int64_t processed = 0;
+		while (processed < maxBlocks && !cursor.IsDone()) {
+			CoordinateInBlocks rowStart;
+			int64_t count = ChunkSizeInBlocks;
+			uint64_t rowBits = 0;
+			if (cursor.selection != nullptr) {
+				rowBits = cursor.NextSelectedRow(rowStart);
+				processed += std::popcount(rowBits);
+			}
+			else {
+				count = cursor.NextRun(std::min<int64_t>(64, maxBlocks - processed), rowStart);
+				rowBits = ~uint64_t(0) >> (64 - count);
+				processed += count;
+			}
 
-			for (int64_t x = startCorner.X; x <= endCorner.X; x++) {
-				
-				BlockInfo currentBlock = GetBlock(CoordinateInBlocks(x, y, z));
-				if (useMask && !(BlockIsMaskTarget(currentBlock, maskBlocks)) ) {
-					continue;
+			BlockInfo row[64];
+			BlockInfo replacements[64];
+			ForEachSetBit(rowBits, [&](size_t i) {
+				row[i] = GetBlock(rowStart + CoordinateInBlocks(int64_t(i), 0, 0));
+			});
+
+			uint64_t replaceBits = table.ReplaceRow<NativeOnly>(row, size_t(count), replacements) & rowBits;
+			ForEachSetBit(replaceBits, [&](size_t i) {
+				if (planner.Plan(rowStart + CoordinateInBlocks(int64_t(i), 0, 0), row[i], replacements[i])) cursor.CountWrite();
+			});
+		}
+		return processed;
+	}
+	bool IsFinished() const override { return started && cursor.IsDone(); }
+	bool Finalize() override { return planner.FinishInBackground(workerPool); }
+	void Complete() override { FinishPlan(planner, cursor, hintLocation); }
+	int64_t GetTotalBlocks() const override { return cursor.total; }
+	int64_t GetProcessedBlocks() const override { return cursor.visited; }
+	int64_t GetChangedBlocks() const override { return planner.changedBlocks; }
+};
+
+// Copies the selection or the marker region into the clipboard, clearing it to air as well when cutting.
+struct CopyJob : RegionJob {
+	TiledRegionCursor cursor;
+	bool cutBlocks;
+	WritePlanner planner;
+	bool dryRun;
+	bool started = false;
+
+	CopyJob(CoordinateInBlocks hintAt, bool cut, bool isDryRun)
+		: RegionJob(cut ? (isDryRun ? L"Planning Cut" : L"Cutting Region") : L"Copying Region", hintAt), cutBlocks(cut), dryRun(isDryRun) {}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		if (!started) {
+			started = true;
+			if (!StartSelectionCursor(cursor)) return 0;
+			planner.Begin(cursor.startCorner, cursor.endCorner, dryRun, &operationJournal);
+
+			// The clipboard is only replaced once the job runs, so queued pastes still see the old one.
+			// A dry run leaves it alone.
+			if (!dryRun) {
+				CoordinateInBlocks size = cursor.endCorner - cursor.startCorner;
+				clipboard.Reset(size.X + 1, size.Y + 1, int64_t(size.Z) + 1);
+				// Voxels outside a selection are never visited and keep palette entry 0, which is made Invalid so a paste skips them.
+				if (cursor.selection != nullptr) clipboard.Set(0, BlockInfo());
+			}
+		}
+
+		int64_t processed = 0;
+		while (processed < maxBlocks && !cursor.IsDone()) {
+			if (cursor.selection == nullptr) {
+				CopyVoxel(cursor.Next());
+				processed++;
+				continue;
+			}
+
+			CoordinateInBlocks rowStart;
+			uint32_t rowBits = cursor.NextSelectedRow(rowStart);
+			ForEachSetBit(rowBits, [&](size_t i) { CopyVoxel(rowStart + CoordinateInBlocks(int64_t(i), 0, 0)); });
+			processed += std::popcount(rowBits);
+		}
+		return processed;
+	}
+
+	void CopyVoxel(CoordinateInBlocks at) {
+		BlockInfo currentBlock = GetBlock(at);
+		if (!planner.dryRun) {
+			CoordinateInBlocks offset = at - cursor.startCorner;
+			clipboard.Set(clipboard.GetIndex(offset.X, offset.Y, offset.Z), currentBlock);
+		}
+		if (cutBlocks && planner.Plan(at, currentBlock, EBlockType::Air)) {
+			cursor.CountWrite();
+		}
+	}
+	bool IsFinished() const override { return started && cursor.IsDone(); }
+	bool Finalize() override { return !cutBlocks || planner.FinishInBackground(workerPool); }
+	void Complete() override {
+		if (!dryRun && cursor.total > 0) clipboardVersion++;
+		if (cutBlocks) FinishPlan(planner, cursor, hintLocation);
+	}
+	int64_t GetTotalBlocks() const override { return cursor.total; }
+	int64_t GetProcessedBlocks() const override { return cursor.visited; }
+	int64_t GetChangedBlocks() const override { return planner.changedBlocks; }
+};
+
+// Pastes the clipboard, or a schematic straight from its mapping when one is given.
+// With ShareClipboard set, the clipboard is the one in shared memory, read where it was published.
+struct PasteJob : RegionJob {
+	CoordinateInBlocks pasteAt;
+	bool ignoreAirBlocks;
+	bool started = false;
+	std::shared_ptr<MappedSchematic> schematic;
+	std::shared_ptr<SharedClipboard> shared;
+	ClipboardView source;
+	TiledRegionCursor cursor;
+	std::vector<uint8_t> skipEntry;
+	std::vector<BlockInfo> orientedPalette;
+	int64_t (PasteJob::*pasteRows)(int64_t) = nullptr;
+	WritePlanner planner;
+	bool dryRun;
+
+	PasteJob(CoordinateInBlocks hintAt, CoordinateInBlocks At, bool ignoreAir, bool isDryRun, std::shared_ptr<MappedSchematic> pasteSchematic = nullptr)
+		: RegionJob(isDryRun ? L"Planning Paste" : (pasteSchematic ? L"Pasting Schematic" : L"Pasting Clipboard"), hintAt),
+		pasteAt(At), ignoreAirBlocks(ignoreAir), schematic(pasteSchematic), dryRun(isDryRun) {}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		if (!started) {
+			started = true;
+			// The clipboard is looked at only now, so edits queued before this paste apply to it.
+			if (schematic == nullptr && ShareClipboard) {
+				PublishClipboard();
+				shared = SharedClipboard::Acquire(SharedClipboardKey);
+			}
+			source = schematic ? schematic->view : (shared ? shared->view : ClipboardView(clipboard));
+			if (source.empty()) return 0;
+
+			cursor = GetRegionCursor(pasteAt, pasteAt + CoordinateInBlocks(source.sizeX - 1, source.sizeY - 1, int16_t(source.sizeZ - 1)));
+			planner.Begin(cursor.startCorner, cursor.endCorner, dryRun, &operationJournal, &deferredWrites);
+			// Air skipping is decided once per palette entry instead of once per voxel.
+			// Every index the packing can hold gets an entry, and ones past the palette are skipped as damaged.
+			skipEntry.assign(size_t(1) << source.bitsPerBlock, 1);
+			orientedPalette.resize(source.paletteSize);
+			for (size_t i = 0; i < source.paletteSize; i++) {
+				skipEntry[i] = (ignoreAirBlocks && source.palette[i].Type == EBlockType::Air) || source.palette[i].Type == EBlockType::Invalid;
+				orientedPalette[i] = source.GetOrientedBlock(i);
+			}
+			// This mod's own clipboard never holds an index past its palette, so only a skipped entry needs checking for.
+			// Schematics and shared clipboards can be damaged and always check.
+			bool trusted = schematic == nullptr && shared == nullptr && source.paletteSize > 0;
+			bool skipEntries = !trusted || std::any_of(skipEntry.begin(), skipEntry.begin() + source.paletteSize, [](uint8_t skip) { return skip != 0; });
+			pasteRows = SelectPasteKernel(source.bitsPerBlock, source.GetStep(0) == 1, skipEntries);
+		}
+		return (this->*pasteRows)(maxBlocks);
+	}
+
+	// A paste runs one of twelve kernels, picked once when it starts: per packing, per whether the clipboard's
+	// X runs forwards along world X, and per whether any palette entry is skipped. Each reads a row's indices in
+	// a loop with no branches on any of those, then plans the row.
+	template<uint8_t Bits, bool ForwardX, bool SkipEntries> int64_t PasteRows(int64_t maxBlocks) {
+		const int64_t step = ForwardX ? 1 : source.GetStep(0);
+		int64_t processed = 0;
+		while (processed < maxBlocks && !cursor.IsDone()) {
+			CoordinateInBlocks rowStart;
+			int64_t count = cursor.NextRun(std::min<int64_t>(64, maxBlocks - processed), rowStart);
+			CoordinateInBlocks offset = rowStart - pasteAt;
+			int64_t index = source.GetIndex(offset.X, offset.Y, offset.Z);
+
+			uint32_t paletteIndices[64];
+			for (int64_t i = 0; i < count; i++) {
+				paletteIndices[i] = Clipboard::ReadPacked<Bits>(source.indices, index + i * step);
+			}
+			for (int64_t i = 0; i < count; i++) {
+				if (SkipEntries && skipEntry[paletteIndices[i]]) continue;
+				CoordinateInBlocks at = rowStart + CoordinateInBlocks(i, 0, 0);
+				if (planner.Plan(at, GetBlock(at), orientedPalette[paletteIndices[i]])) cursor.CountWrite();
+			}
+			processed += count;
+		}
+		return processed;
+	}
+
+	using PasteKernel = int64_t (PasteJob::*)(int64_t);
+
+	static PasteKernel SelectPasteKernel(uint8_t bits, bool forwardX, bool skipEntries) {
+		static constexpr PasteKernel kernels[3][2][2] = {
+			{ { &PasteJob::PasteRows<4, false, false>, &PasteJob::PasteRows<4, false, true> }, { &PasteJob::PasteRows<4, true, false>, &PasteJob::PasteRows<4, true, true> } },
+			{ { &PasteJob::PasteRows<8, false, false>, &PasteJob::PasteRows<8, false, true> }, { &PasteJob::PasteRows<8, true, false>, &PasteJob::PasteRows<8, true, true> } },
+			{ { &PasteJob::PasteRows<16, false, false>, &PasteJob::PasteRows<16, false, true> }, { &PasteJob::PasteRows<16, true, false>, &PasteJob::PasteRows<16, true, true> } },
+		};
+		return kernels[bits == 4 ? 0 : (bits == 8 ? 1 : 2)][forwardX][skipEntries];
+	}
+	bool IsFinished() const override { return started && cursor.IsDone(); }
+	bool Finalize() override { return planner.FinishInBackground(workerPool); }
+	void Complete() override { FinishPlan(planner, cursor, hintLocation); }
+	int64_t GetTotalBlocks() const override {
+		if (started) return cursor.total;
+		return schematic ? schematic->view.GetVolume() : clipboard.GetVolume();
+	}
+	int64_t GetProcessedBlocks() const override { return cursor.visited; }
+	int64_t GetChangedBlocks() const override { return planner.changedBlocks; }
+};
+
+// Repeats the marker region or the selection next to itself along up to three axes. The region is read once into
+// a compact buffer, then streamed into every copy; all copies share one undo entry over the grid they fill.
+struct StackJob : RegionJob {
+	TiledRegionCursor readCursor;
+	TiledRegionCursor cursor;
+	Clipboard buffer;
+	CoordinateInBlocks sourceMin;
+	CoordinateInBlocks sourceMax;
+	CoordinateInBlocks gridMin;
+	CoordinateInBlocks gridMax;
+	int64_t gridVolume = 0;
+	// A selection's copies, one per cell of the grid but the source's, so only their voxels are written.
+	std::shared_ptr<VoxelSet> copiedSelection;
+	WritePlanner planner;
+	// copies[axis] is how many copies go along each axis, in the direction of its sign.
+	int64_t copies[3];
+	bool dryRun;
+	bool started = false;
+
+	StackJob(CoordinateInBlocks hintAt, const int64_t stackCopies[3], bool isDryRun)
+		: RegionJob(isDryRun ? L"Planning Stack" : L"Stacking Region", hintAt), copies{ stackCopies[0], stackCopies[1], stackCopies[2] }, dryRun(isDryRun) {}
+
+	// Lays out the grid around the region to read, which is only looked at now.
+	bool Start() {
+		if (!StartSelectionCursor(readCursor)) return false;
+		sourceMin = readCursor.startCorner;
+		sourceMax = readCursor.endCorner;
+		CoordinateInBlocks size = sourceMax - sourceMin + CoordinateInBlocks(1, 1, 1);
+		gridMin = sourceMin + CoordinateInBlocks(std::min<int64_t>(copies[0], 0) * size.X, std::min<int64_t>(copies[1], 0) * size.Y, int16_t(std::min<int64_t>(copies[2], 0) * size.Z));
+		gridMax = sourceMax + CoordinateInBlocks(std::max<int64_t>(copies[0], 0) * size.X, std::max<int64_t>(copies[1], 0) * size.Y, int16_t(std::max<int64_t>(copies[2], 0) * size.Z));
+		gridVolume = (gridMax.X - gridMin.X + 1) * (gridMax.Y - gridMin.Y + 1) * (int64_t(gridMax.Z) - gridMin.Z + 1);
+		buffer.Reset(size.X, size.Y, size.Z);
+
+		if (readCursor.selection != nullptr) {
+			copiedSelection = std::make_shared<VoxelSet>();
+			for (int64_t z = std::min<int64_t>(copies[2], 0); z <= std::max<int64_t>(copies[2], 0); z++) {
+				for (int64_t y = std::min<int64_t>(copies[1], 0); y <= std::max<int64_t>(copies[1], 0); y++) {
+					for (int64_t x = std::min<int64_t>(copies[0], 0); x <= std::max<int64_t>(copies[0], 0); x++) {
+						if (x == 0 && y == 0 && z == 0) continue;
+						copiedSelection->InsertSet(*readCursor.selection, CoordinateInBlocks(x * size.X, y * size.Y, int16_t(z * size.Z)));
+					}
+				}
+			}
+			gridVolume = int64_t(copiedSelection->size());
+		}
+		return true;
+	}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		if (!started) {
+			started = true;
+			if (!Start()) return 0;
+		}
+
+		int64_t processed = 0;
+		while (processed < maxBlocks && !readCursor.IsDone()) {
+			if (readCursor.selection == nullptr) {
+				ReadVoxel(readCursor.Next());
+				processed++;
+				continue;
+			}
+
+			CoordinateInBlocks rowStart;
+			uint32_t rowBits = readCursor.NextSelectedRow(rowStart);
+			ForEachSetBit(rowBits, [&](size_t i) { ReadVoxel(rowStart + CoordinateInBlocks(int64_t(i), 0, 0)); });
+			processed += std::popcount(rowBits);
+		}
+		if (!readCursor.IsDone()) return processed;
+
+		if (cursor.total == 0) {
+			cursor = copiedSelection != nullptr ? TiledRegionCursor(copiedSelection, TileOrder::NearestFirst, CoordinateInBlocks(GetPlayerLocation())) : GetRegionCursor(gridMin, gridMax);
+			planner.Begin(cursor.startCorner, cursor.endCorner, dryRun, &operationJournal, &deferredWrites);
+		}
+
+		// Rows of the grid wrap around the buffer; the source itself is skipped.
+		while (processed < maxBlocks && !cursor.IsDone()) {
+			CoordinateInBlocks rowStart;
+			if (cursor.selection != nullptr) {
+				uint32_t rowBits = cursor.NextSelectedRow(rowStart);
+				processed += std::popcount(rowBits);
+				int64_t rowBase = buffer.GetIndex(0, (rowStart.Y - gridMin.Y) % buffer.sizeY, (int64_t(rowStart.Z) - gridMin.Z) % buffer.sizeZ);
+				ForEachSetBit(rowBits, [&](size_t i) {
+					CoordinateInBlocks at = rowStart + CoordinateInBlocks(int64_t(i), 0, 0);
+					if (planner.Plan(at, GetBlock(at), buffer.Get(rowBase + (at.X - gridMin.X) % buffer.sizeX))) cursor.CountWrite();
+				});
+				continue;
+			}
+
+			int64_t count = cursor.NextRun(maxBlocks - processed, rowStart);
+			processed += count;
+
+			bool rowInSource = rowStart.Y >= sourceMin.Y && rowStart.Y <= sourceMax.Y && rowStart.Z >= sourceMin.Z && rowStart.Z <= sourceMax.Z;
+			int64_t rowBase = buffer.GetIndex(0, (rowStart.Y - gridMin.Y) % buffer.sizeY, (int64_t(rowStart.Z) - gridMin.Z) % buffer.sizeZ);
+			int64_t sourceX = (rowStart.X - gridMin.X) % buffer.sizeX;
+			for (int64_t i = 0; i < count; i++, sourceX = (sourceX + 1 == buffer.sizeX) ? 0 : sourceX + 1) {
+				CoordinateInBlocks at = rowStart + CoordinateInBlocks(i, 0, 0);
+				if (rowInSource && at.X >= sourceMin.X && at.X <= sourceMax.X) continue;
+
+				if (planner.Plan(at, GetBlock(at), buffer.Get(rowBase + sourceX))) cursor.CountWrite();
+			}
+		}
+		return processed;
+	}
+
+	void ReadVoxel(CoordinateInBlocks at) {
+		CoordinateInBlocks offset = at - sourceMin;
+		buffer.Set(buffer.GetIndex(offset.X, offset.Y, offset.Z), GetBlock(at));
+	}
+	bool IsFinished() const override { return started && readCursor.IsDone() && cursor.IsDone() && (readCursor.total == 0 || cursor.total > 0); }
+	bool Finalize() override { return planner.FinishInBackground(workerPool); }
+	void Complete() override { FinishPlan(planner, cursor, hintLocation); }
+	int64_t GetTotalBlocks() const override { return readCursor.total + gridVolume; }
+	int64_t GetProcessedBlocks() const override { return readCursor.visited + cursor.visited; }
+	int64_t GetChangedBlocks() const override { return planner.changedBlocks; }
+};
+
+// Grows a set of face-connected voxels from a start block: the ones like it, or the ones the mask accepts when there is one.
+// Filled a row at a time: a seed grows along X, and each row beside it gets one seed per run it could still fill.
+// The result becomes the selection, or is replaced with the paint target as one undo entry.
+struct FloodFillJob : RegionJob {
+	BlockInfo startBlock;
+	BlockMask mask;
+	bool replace;
+	BlockInfo targetBlock;
+	int64_t maxFill;
+	bool limitReached = false;
+	bool filling = true;
+	std::shared_ptr<VoxelSet> filled = std::make_shared<VoxelSet>();
+	// What the fill test said about each voxel read so far. Scanning the rows beside a run reads most voxels
+	// from several sides, and the seed it leaves reads them again; these keep that to one GetBlock a voxel.
+	VoxelSet fillable;
+	VoxelSet blocked;
+	CoordinateInBlocks start;
+	bool started = false;
+	std::vector<CoordinateInBlocks> seeds;
+	std::vector<CoordinateInBlocks> chunkCorners;
+	size_t nextChunk = 0;
+	int64_t writtenBlocks = 0;
+	WritePlanner planner;
+
+	FloodFillJob(CoordinateInBlocks hintAt, CoordinateInBlocks startAt, BlockMask fillMask, bool replaceBlocks, BlockInfo target, int64_t maxBlocks)
+		: RegionJob(replaceBlocks ? L"Flood Replacing" : L"Flood Selecting", hintAt), mask(fillMask), replace(replaceBlocks), targetBlock(target), maxFill(maxBlocks), start(startAt) {
+		seeds.push_back(start);
+	}
+
+	bool Fills(BlockInfo info) const {
+		return info.IsValid() && (mask.IsActive() ? mask.Matches(info) : SameBlock(info, startBlock));
+	}
+
+	bool CanFill(const CoordinateInBlocks& at) {
+		if (at.Z < WorldMinZ || at.Z > WorldMaxZ || filled->Contains(at)) return false;
+		if (fillable.Contains(at)) return true;
+		if (blocked.Contains(at)) return false;
+
+		bool fill = Fills(GetBlock(at));
+		if (fill) fillable.Insert(at);
+		else blocked.Insert(at);
+		return fill;
+	}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		// The start block is looked at only now, so edits queued before the fill apply to it.
+		if (!started) {
+			started = true;
+			startBlock = GetBlock(start);
+		}
+
+		int64_t processed = 0;
+		while (filling && processed < maxBlocks) {
+			if (seeds.empty() || limitReached) {
+				FinishFilling();
+				break;
+			}
+
+			CoordinateInBlocks seed = seeds.back();
+			seeds.pop_back();
+			processed++;
+			if (!CanFill(seed)) continue;
+
+			int64_t first = seed.X;
+			int64_t last = seed.X;
+			while (CanFill(CoordinateInBlocks(first - 1, seed.Y, seed.Z))) first--;
+			while (CanFill(CoordinateInBlocks(last + 1, seed.Y, seed.Z))) last++;
+			if (int64_t(filled->size()) + (last - first + 1) > maxFill) {
+				last = first + (maxFill - int64_t(filled->size())) - 1;
+				limitReached = true;
+			}
+			filled->InsertRun(CoordinateInBlocks(first, seed.Y, seed.Z), last - first + 1);
+			processed += last - first + 1;
+
+			const CoordinateInBlocks beside[4] = { CoordinateInBlocks(0, 1, 0), CoordinateInBlocks(0, -1, 0), CoordinateInBlocks(0, 0, 1), CoordinateInBlocks(0, 0, -1) };
+			for (const CoordinateInBlocks& offset : beside) {
+				bool inRun = false;
+				for (int64_t x = first; x <= last; x++) {
+					CoordinateInBlocks at = CoordinateInBlocks(x, seed.Y, seed.Z) + offset;
+					bool fill = CanFill(at);
+					if (fill && !inRun) seeds.push_back(at);
+					inRun = fill;
 				}
-				Paint(paintOp, targetBlock, CoordinateInBlocks(x, y, z));
+				processed += last - first + 1;
+			}
+		}
+
+		// Writes go chunk by chunk, which is the order the undo entry stores them in. The fill may have read a
+		// voxel many ticks ago, so it is read again here, and one changed since so it no longer fills is left alone.
+		while (!filling && nextChunk < chunkCorners.size() && processed < maxBlocks) {
+			filled->ForEachInChunk(chunkCorners[nextChunk++], [&](CoordinateInBlocks at) {
+				BlockInfo current = GetBlock(at);
+				if (Fills(current)) planner.Plan(at, current, targetBlock);
+				writtenBlocks++;
+				processed++;
+			});
+		}
+		return processed;
+	}
+
+	void FinishFilling() {
+		filling = false;
+		seeds.clear();
+		seeds.shrink_to_fit();
+		fillable.clear();
+		blocked.clear();
+		if (replace && !filled->empty()) {
+			planner.Begin(filled->GetMinCorner(), filled->GetMaxCorner(), false, &operationJournal);
+			chunkCorners = filled->GetChunkCorners();
+		}
+	}
+
+	bool IsFinished() const override { return !filling && nextChunk >= chunkCorners.size(); }
+	bool Finalize() override { return !replace || planner.FinishInBackground(workerPool); }
+	void Complete() override {
+		wString limitText = limitReached ? L"\nStopped at the limit of " + std::to_wstring(maxFill) + L" blocks" : L"";
+		if (replace) {
+			AddUndoOperation(planner, ChargeMaterials(planner));
+			SpawnHintText(hintLocation, L"Replaced " + std::to_wstring(planner.changedBlocks) + L" blocks" + limitText, 2, 1);
+			return;
+		}
+		if (filled->empty()) return;
+
+		voxelSelection = filled;
+		marker1Cord = filled->GetMinCorner();
+		marker2Cord = filled->GetMaxCorner();
+		SpawnHintText(hintLocation, L"Selected " + std::to_wstring(filled->size()) + L" blocks" + limitText, 2, 1);
+	}
+	int64_t GetTotalBlocks() const override { return filling ? maxFill : int64_t(filled->size()); }
+	int64_t GetProcessedBlocks() const override { return filling ? int64_t(filled->size()) : writtenBlocks; }
+	int64_t GetChangedBlocks() const override { return planner.changedBlocks; }
+};
+
+// Reads the marker box and adds the voxels the mask accepts to the selection, or takes them out of it.
+struct MaskSelectJob : RegionJob {
+	TiledRegionCursor cursor;
+	BlockMask mask;
+	bool erase;
+	std::shared_ptr<VoxelSet> matched = std::make_shared<VoxelSet>();
+
+	MaskSelectJob(CoordinateInBlocks hintAt, BlockMask selectMask, bool eraseMatches)
+		: RegionJob(eraseMatches ? L"Deselecting Masked Blocks" : L"Selecting Masked Blocks", hintAt), mask(selectMask), erase(eraseMatches) {
+		cursor = GetRegionCursor(marker1Cord, marker2Cord);
+	}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		int64_t processed = 0;
+		while (processed < maxBlocks && !cursor.IsDone()) {
+			CoordinateInBlocks rowStart;
+			int64_t count = cursor.NextRun(std::min<int64_t>(64, maxBlocks - processed), rowStart);
+			BlockInfo row[64];
+			for (int64_t i = 0; i < count; i++) {
+				row[i] = GetBlock(rowStart + CoordinateInBlocks(i, 0, 0));
+			}
+			matched->InsertRowBits(rowStart, mask.MatchRow(row, size_t(count)));
+			processed += count;
+		}
+		return processed;
+	}
+	bool IsFinished() const override { return cursor.IsDone(); }
+	void Complete() override;
+	int64_t GetTotalBlocks() const override { return cursor.total; }
+	int64_t GetProcessedBlocks() const override { return cursor.visited; }
+};
+
+// Replays the newest undo (or redo) entry and records its reverse on the other history list.
+struct HistoryJob : RegionJob {
+	bool redo;
+	bool started = false;
+	PaintOperation paintOp;
+	// A spilled entry is read straight from the mapped spill file.
+	OperationData data;
+	std::unique_ptr<OperationReader> reader;
+	WritePlanner reversePlanner;
+	bool readerDone = false;
+
+	HistoryJob(CoordinateInBlocks hintAt, bool isRedo)
+		: RegionJob(isRedo ? L"Redoing Operation" : L"Undoing Operation", hintAt), redo(isRedo) {}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		if (!started) {
+			started = true;
+			OperationHistory& history = redo ? redoHistory : undoHistory;
+			if (history.empty()) {
+				readerDone = true;
+				return 0;
+			}
+
+			paintOp = history.PopNewest();
+			operationJournal.NotePop(redo ? JournalStack::Redo : JournalStack::Undo);
+			// Writes the entry's operation queued and that haven't landed yet go with it.
+			deferredWrites.DropOperation(paintOp.deferredTag);
+			data = history.GetData(paintOp);
+			if (data.data == nullptr) {
+				readerDone = true;
+				return 0;
+			}
+			reader = std::make_unique<OperationReader>(data.data, data.size);
+			reversePlanner.Begin(reader->GetMinCorner(), reader->GetMaxCorner(), false, &operationJournal, &deferredWrites);
+			reversePlanner.settledUpFront = true;
+		}
+
+		int64_t processed = 0;
+		CoordinateInBlocks at;
+		BlockInfo info;
+		for (; processed < maxBlocks; processed++) {
+			if (!reader->Next(at, info)) {
+				readerDone = true;
+				// Unmapped before Complete, which may rewrite the spill file.
+				data = OperationData();
+				break;
 			}
+			reversePlanner.Plan(at, GetBlock(at), info);
 		}
+		return processed;
+	}
+	bool IsFinished() const override { return readerDone; }
+	bool Finalize() override { return reversePlanner.FinishInBackground(workerPool); }
+	void Complete() override {
+		// Undo gives back exactly what the entry charged and redo takes it again, whatever the reversal changed.
+		std::vector<std::pair<BlockInfo, int64_t>> charged;
+		if (ChargeInventory) {
+			charged = paintOp.charged;
+			MaterialHistogram::Settle(charged, redo ? 1 : -1);
+		}
+		if (redo) AddUndoOperation(reversePlanner, std::move(charged));
+		else AddRedoOperation(reversePlanner, std::move(charged));
+		ReportDeferredWrites(reversePlanner, hintLocation);
+	}
+	int64_t GetTotalBlocks() const override { return reader ? reader->blockCount : 0; }
+	int64_t GetProcessedBlocks() const override { return reader ? reader->blocksRead : 0; }
+	int64_t GetChangedBlocks() const override { return reversePlanner.changedBlocks; }
+};
+
+// Writes back the blocks an operation had replaced when the game stopped in the middle of it.
+// A voxel written twice gets the value of its first record, which is the one from before the operation.
+struct RollbackJob : RegionJob {
+	std::vector<uint8_t> records;
+	ByteReader reader;
+	int64_t totalBlocks;
+	int64_t blocksRead = 0;
+	int64_t restoredBlocks = 0;
+	VoxelSet seen;
+	CoordinateInBlocks at = CoordinateInBlocks(0, 0, 0);
+
+	RollbackJob(CoordinateInBlocks hintAt, std::vector<uint8_t> unfinished, int64_t blockCount)
+		: RegionJob(L"Rolling Back Unfinished Operation", hintAt), records(std::move(unfinished)), reader(nullptr, 0), totalBlocks(blockCount) {
+		reader = ByteReader(records.data(), records.size());
+	}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		int64_t processed = 0;
+		for (; processed < maxBlocks && blocksRead < totalBlocks; processed++) {
+			at.X += reader.ReadSignedVarint();
+			at.Y += reader.ReadSignedVarint();
+			at.Z = int16_t(at.Z + reader.ReadSignedVarint());
+			BlockInfo previous = reader.ReadBlockInfo();
+			blocksRead++;
+			if (reader.failed) {
+				blocksRead = totalBlocks;
+				break;
+			}
+			if (!seen.Insert(at)) continue;
+			BlockInfo current = GetBlock(at);
+			if (!current.IsValid()) {
+				if (deferredWrites.Add(at, previous)) restoredBlocks++;
+			}
+			else if (!SameBlock(current, previous)) {
+				SetBlock(at, previous);
+				restoredBlocks++;
+			}
+		}
+		return processed;
+	}
+	bool IsFinished() const override { return blocksRead >= totalBlocks; }
+	void Complete() override {
+		journalRollbackPending = false;
+		CompactJournal();
+		Log(L"Rolled back " + std::to_wstring(restoredBlocks) + L" blocks of an operation that didn't finish.");
+	}
+	int64_t GetTotalBlocks() const override { return totalBlocks; }
+	int64_t GetProcessedBlocks() const override { return blocksRead; }
+	int64_t GetChangedBlocks() const override { return restoredBlocks; }
+};
+
+// Rebuilds the histories from the journal a crash left, and queues the rollback of the operation it interrupted.
+void ReplayJournal(const std::filesystem::path& journalPath) {
+	JournalContents contents = OperationJournal::Read(journalPath);
+	if (contents.empty()) return;
+
+	RestoreHistory();
+	for (JournalEntry& entry : contents.finished) {
+		if (entry.popFrom != JournalStack::None) {
+			OperationHistory& history = GetJournalHistory(entry.popFrom);
+			if (!history.empty()) history.PopNewest();
+		}
+		if (entry.pushTo != JournalStack::None) {
+			GetJournalHistory(entry.pushTo).Push(std::move(entry.paintOp));
+		}
+	}
+	Log(L"Journal replayed: " + std::to_wstring(contents.finished.size()) + L" finished operations, "
+		+ std::to_wstring(contents.unfinishedBlocks) + L" blocks of an unfinished one to roll back.");
+
+	if (contents.unfinishedBlocks > 0) {
+		journalRollbackPending = true;
+		jobExecutor.Enqueue(std::make_unique<RollbackJob>(GetPlayerLocation(), std::move(contents.unfinished), contents.unfinishedBlocks));
 	}
-	AddUndoOperation(paintOp);
 }
 
-void StackArea() {
-	DirectionVectorInCentimeters viewDirection = GetPlayerViewDirection();
+// Writes out the queued writes of chunks that have loaded, as one undo entry. A chunk that unloads again
+// before its turn goes back into the queue.
+struct DeferredFlushJob : RegionJob {
+	std::vector<DeferredChunk> chunks;
+	size_t nextChunk = 0;
+	size_t nextWrite = 0;
+	int64_t totalBlocks = 0;
+	int64_t writtenBlocks = 0;
+	WritePlanner planner;
+
+	DeferredFlushJob(CoordinateInBlocks hintAt, std::vector<DeferredChunk> loaded)
+		: RegionJob(L"Writing Queued Blocks", hintAt), chunks(std::move(loaded)) {
+		CoordinateInBlocks minCorner = chunks.front().corner;
+		CoordinateInBlocks maxCorner = chunks.front().corner;
+		int16_t minZ = int16_t(WorldMaxZ);
+		int16_t maxZ = int16_t(WorldMinZ);
+		for (const DeferredChunk& chunk : chunks) {
+			minCorner = GetSmallVector(minCorner, chunk.corner);
+			maxCorner = GetLargeVector(maxCorner, chunk.corner);
+			for (const DeferredWrite& write : chunk.writes) {
+				int16_t z = chunk.GetCoordinate(write).Z;
+				minZ = std::min(minZ, z);
+				maxZ = std::max(maxZ, z);
+			}
+			totalBlocks += int64_t(chunk.writes.size());
+		}
+		minCorner.Z = minZ;
+		maxCorner = CoordinateInBlocks(maxCorner.X + DeferredWriteQueue::ChunkSize - 1, maxCorner.Y + DeferredWriteQueue::ChunkSize - 1, maxZ);
+		planner.Begin(minCorner, maxCorner, false, &operationJournal, &deferredWrites);
+	}
+
+	int64_t Advance(int64_t maxBlocks) override {
+		int64_t processed = 0;
+		while (processed < maxBlocks && nextChunk < chunks.size()) {
+			const DeferredChunk& chunk = chunks[nextChunk];
+			for (; processed < maxBlocks && nextWrite < chunk.writes.size(); processed++, nextWrite++) {
+				CoordinateInBlocks at = chunk.GetCoordinate(chunk.writes[nextWrite]);
+				planner.settledUpFront = (chunk.writes[nextWrite].operation & DeferredWriteQueue::SettledTag) != 0;
+				planner.Plan(at, GetBlock(at), chunk.writes[nextWrite].block);
+				writtenBlocks++;
+			}
+			if (nextWrite == chunk.writes.size()) {
+				nextChunk++;
+				nextWrite = 0;
+			}
+		}
+		return processed;
+	}
+	bool IsFinished() const override { return nextChunk >= chunks.size(); }
+	bool Finalize() override { return planner.FinishInBackground(workerPool); }
+	void Complete() override {
+		AddUndoOperation(planner, ChargeMaterials(planner));
+		wString text = L"Wrote " + std::to_wstring(planner.changedBlocks) + L" queued blocks in " + std::to_wstring(chunks.size()) + L" chunks";
+		if (!deferredWrites.empty()) text += L"\n" + GetDeferredQueueSummary();
+		SpawnHintText(hintLocation, text, 3, 1);
+		Log(text);
+	}
+	int64_t GetTotalBlocks() const override { return totalBlocks; }
+	int64_t GetProcessedBlocks() const override { return writtenBlocks; }
+	int64_t GetChangedBlocks() const override { return planner.changedBlocks; }
+};
+
+// Hands the queued writes of chunks that have come into range to a flush job.
+void FlushDeferredWrites() {
+	std::vector<DeferredChunk> loaded = deferredWrites.TakeLoaded([](CoordinateInBlocks corner) { return GetBlock(corner).IsValid(); });
+	if (loaded.empty()) return;
+	jobExecutor.Enqueue(std::make_unique<DeferredFlushJob>(GetPlayerLocation(), std::move(loaded)));
 }
 
-// Clipboard Method
+void RestoreDeferredWrites() {
+	ScopedModData saved = LoadModDataInPlace(DeferredSaveName);
+	ByteReader reader(saved.Data, size_t(saved.Size));
+	if (!ReadSaveHeader(reader) || !deferredWrites.Read(reader)) {
+		deferredWrites.clear();
+	}
+}
+
+void SaveDeferredWrites() {
+	ByteWriter writer;
+	WriteSaveHeader(writer);
+	deferredWrites.Write(writer);
+	SaveModData(DeferredSaveName, writer.bytes);
+}
+
+// Runs a short clipboard edit in order with the region jobs queued around it.
+struct ImmediateJob : RegionJob {
+	std::function<void()> action;
+	bool done = false;
+
+	ImmediateJob(wString jobName, CoordinateInBlocks hintAt, std::function<void()> jobAction) : RegionJob(jobName, hintAt), action(std::move(jobAction)) {}
+
+	int64_t Advance(int64_t /*maxBlocks*/) override {
+		action();
+		done = true;
+		return 1;
+	}
+	bool IsFinished() const override { return done; }
+	int64_t GetTotalBlocks() const override { return 1; }
+	int64_t GetProcessedBlocks() const override { return done ? 1 : 0; }
+};
+
+// Instrumentation
 //********************************
-void CopyRegion() {
-	CoordinateInBlocks startCorner = GetSmallVector(marker1Cord, marker2Cord);
-	CoordinateInBlocks endCorner = GetLargeVector(marker1Cord, marker2Cord);
-	clipboard.clear();
+// Fills in what the clipboard and histories hold after an operation, and reports its span.
+void ReportOperationSpan(OperationSpan& span) {
+	span.clipboardBytes = clipboard.GetMemoryBytes();
+	span.historyBytes = undoHistory.usedBytes + redoHistory.usedBytes;
+	span.spilledHistoryBytes = undoHistory.spilledBytes + redoHistory.spilledBytes;
+
+	wString summary = span.GetSummary();
+	Log(summary);
+	if (ShowOperationSummaries) {
+		SpawnHintText(GetPlayerLocation(), summary, 3, 1);
+	}
+}
 
-	clipboardWidth = endCorner.X - startCorner.X;
-	clipboardLength = endCorner.Y - startCorner.Y;
+bool WriteOperationTrace() {
+	return operationTracer.WriteChromeTrace(std::filesystem::path(GetThisModSaveFolderPath(L"CyubePainter")) / TraceFileName);
+}
 
-	for (int16_t z = startCorner.Z; z <= endCorner.Z; z++) {
+// Operations
+//********************************
+// Paints the marker box, or a shape inscribed in it. An Air Filter on top of the paint target makes the shape hollow.
+void PaintArea(CoordinateInBlocks hintAt, bool dryRun, ShapeKind shapeKind = ShapeKind::Box) {
+	if (!RegionIsReady()) return;
 
-		for (int64_t y = startCorner.Y; y <= endCorner.Y; y++) {
+	BlockInfo targetBlock = SetPaintTarget();
+	if (!targetBlock.IsValid()) return;
 
-			for (int64_t x = startCorner.X; x <= endCorner.X; x++) {
-				int64_t localX = x - startCorner.X;
-				int64_t localY = y - startCorner.Y;
-				int16_t localZ = z - startCorner.Z;
-				BlockInfo currentBlock = GetBlock(CoordinateInBlocks(x, y, z));
+	BlockMask mask = GetPaletteMask();
+
+	bool hollow = GetBlock(paintCord + CoordinateInBlocks(0, 0, 2)).CustomBlockID == AirFilter;
+	if (shapeKind != ShapeKind::Box || hollow) {
+		// With a selection, the shape is inscribed in its bounds. The job looks again when it starts, but
+		// asking now lets the worker pool solve the table while the jobs before it run.
+		CoordinateInBlocks low = voxelSelection != nullptr ? voxelSelection->GetMinCorner() : GetSmallVector(marker1Cord, marker2Cord);
+		CoordinateInBlocks high = voxelSelection != nullptr ? voxelSelection->GetMaxCorner() : GetLargeVector(marker1Cord, marker2Cord);
+		CoordinateInBlocks size = high - low + CoordinateInBlocks(1, 1, 1);
+		if (!ShapeFits(size, hintAt)) return;
+		shapeSpanCache.Get(shapeKind, size.X, size.Y, size.Z, hollow, workerPool);
+	}
 
-				clipboard.push_back(Block(currentBlock, CoordinateInBlocks(localX, localY, localZ)));
-			}
+	jobExecutor.Enqueue(std::make_unique<PaintJob>(hintAt, targetBlock, mask, dryRun, shapeKind, hollow));
+}
+
+// Replaces blocks in the marker box by the pairs stacked on the palette's Mask block, e.g. stone then wallstone, dirt then sand.
+void ReplaceArea(CoordinateInBlocks hintAt, bool dryRun) {
+	if (!RegionIsReady()) return;
+
+	if (GetBlock(maskCord).CustomBlockID != MaskBlock) {
+		SpawnHintText(hintAt, L"Place the Mask block and stack source and replacement pairs on it.", 1, 1);
+		return;
+	}
+	ReplaceTable table = CompileReplaceTable(GetMaskBlocks());
+	if (table.empty()) {
+		SpawnHintText(hintAt, L"Stack source and replacement pairs on the Mask block.", 1, 1);
+		return;
+	}
+
+	jobExecutor.Enqueue(std::make_unique<ReplaceJob>(hintAt, std::move(table), dryRun));
+}
+
+// Stack counts come from the column on top of a block: each run of identical blocks is the number of copies along one axis.
+// One run stacks along the axis the player looks along, a second adds the other horizontal axis, a third the last axis.
+int64_t GetStackCounts(CoordinateInBlocks At, int64_t counts[3]) {
+	int64_t runs = 0;
+	BlockInfo previous;
+	for (int16_t z = 1; z <= MaxStackColumnHeight; z++) {
+		BlockInfo info = GetBlock(At + CoordinateInBlocks(0, 0, z));
+		if (!info.IsValid() || info.Type == EBlockType::Air) break;
+		if (runs == 0 || !SameBlock(info, previous)) {
+			if (runs == 3) break;
+			counts[runs++] = 0;
 		}
+		counts[runs - 1]++;
+		previous = info;
 	}
+	if (runs == 0) {
+		counts[runs++] = 1;
+	}
+	return runs;
 }
 
-void CutRegion() {
-	PaintOperation paintOp;
+void StackArea(CoordinateInBlocks At, bool dryRun) {
+	if (!RegionIsReady()) return;
 
-	CoordinateInBlocks startCorner = GetSmallVector(marker1Cord, marker2Cord);
-	CoordinateInBlocks endCorner = GetLargeVector(marker1Cord, marker2Cord);
-	
-	clipboard.clear();
+	int64_t counts[3] = { 0, 0, 0 };
+	int64_t axisCount = GetStackCounts(At, counts);
+
+	// The first axis is the one the player looks along most. Horizontal axes go the way the view leans, Z goes up unless looked along.
+	DirectionVectorInCentimeters viewDirection = GetPlayerViewDirection();
+	const float view[3] = { viewDirection.X, viewDirection.Y, viewDirection.Z };
+	int primary = (std::abs(view[0]) >= std::abs(view[1])) ? 0 : 1;
+	if (std::abs(view[2]) > std::abs(view[primary])) primary = 2;
+	int axes[3] = { primary, (primary == 0) ? 1 : 0, (primary == 2) ? 1 : 2 };
+
+	int64_t copies[3] = { 0, 0, 0 };
+	for (int64_t i = 0; i < axisCount; i++) {
+		int axis = axes[i];
+		bool negative = (axis == 2 && i > 0) ? false : view[axis] < 0;
+		copies[axis] = negative ? -counts[i] : counts[i];
+	}
 
-	clipboardWidth = endCorner.X - startCorner.X;
-	clipboardLength = endCorner.Y - startCorner.Y;
+	jobExecutor.Enqueue(std::make_unique<StackJob>(GetBlockAbove(At), copies, dryRun));
+}
 
-	for (int16_t z = startCorner.Z; z <= endCorner.Z; z++) {
+// Flood fills from a block: selects what it reaches, or replaces it with the paint target.
+void FloodFill(CoordinateInBlocks At, bool replace) {
+	BlockInfo targetBlock;
+	if (replace) {
+		targetBlock = SetPaintTarget();
+		if (!targetBlock.IsValid()) return;
+	}
+	jobExecutor.Enqueue(std::make_unique<FloodFillJob>(At + CoordinateInBlocks(0, 0, 1), At, GetPaletteMask(), replace, targetBlock, FloodFillMaxBlocks));
+}
 
-		for (int64_t y = startCorner.Y; y <= endCorner.Y; y++) {
+// Selection
+//********************************
+// Hitting Marker 1 adds to the selection and Marker 2 takes away from it: the stick the marker box, the arrow the
+// polygon outlined with the selection wand's arrow, the pickaxe what the mask accepts in the marker box.
+// The axe on either marker clears it.
 
-			for (int64_t x = startCorner.X; x <= endCorner.X; x++) {
-				int64_t localX = x - startCorner.X;
-				int64_t localY = y - startCorner.Y;
-				int16_t localZ = z - startCorner.Z;
-				BlockInfo currentBlock = GetBlock(CoordinateInBlocks(x, y, z));
+// The selection to change, as a copy, since jobs may still be walking the current one.
+std::shared_ptr<VoxelSet> CopySelection() {
+	return voxelSelection != nullptr ? std::make_shared<VoxelSet>(*voxelSelection) : std::make_shared<VoxelSet>();
+}
 
-				clipboard.push_back(Block(currentBlock, CoordinateInBlocks(localX, localY, localZ)));
-				Paint(paintOp, EBlockType::Air, CoordinateInBlocks(x, y, z));
-			}
+void SetSelection(std::shared_ptr<VoxelSet> selection, CoordinateInBlocks hintAt) {
+	if (selection->empty()) {
+		voxelSelection = nullptr;
+		selectionPolygon.clear();
+		SpawnHintText(hintAt, L"Selection cleared", 1, 1);
+		return;
+	}
+	voxelSelection = selection;
+	SpawnHintText(hintAt, L"Selected " + std::to_wstring(selection->size()) + L" blocks", 1, 1);
+}
+
+bool SelectionFits(int64_t addedBlocks, CoordinateInBlocks hintAt) {
+	int64_t selected = voxelSelection != nullptr ? int64_t(voxelSelection->size()) : 0;
+	if (selected + addedBlocks <= SelectionMaxBlocks) return true;
+	SpawnHintText(hintAt, L"Selections can hold at most " + std::to_wstring(SelectionMaxBlocks) + L" blocks.", 1, 1);
+	return false;
+}
+
+// Adds the marker box to the selection, or takes it out. Queued, so it applies after the selections queued before it.
+void SelectMarkerBox(CoordinateInBlocks hintAt, bool erase) {
+	CoordinateInBlocks corner1 = marker1Cord;
+	CoordinateInBlocks corner2 = marker2Cord;
+	CoordinateInBlocks size = GetLargeVector(corner1, corner2) - GetSmallVector(corner1, corner2) + CoordinateInBlocks(1, 1, 1);
+	if (!erase && !SelectionFits(size.X * size.Y * int64_t(size.Z), hintAt)) return;
+
+	jobExecutor.Enqueue(std::make_unique<ImmediateJob>(erase ? L"Deselecting Box" : L"Selecting Box", hintAt, [corner1, corner2, erase, hintAt]() {
+		std::shared_ptr<VoxelSet> selection = CopySelection();
+		if (erase) selection->EraseBox(corner1, corner2);
+		else selection->InsertBox(corner1, corner2);
+		SetSelection(selection, hintAt);
+	}));
+}
+
+// Adds the polygon outlined with the selection wand, extruded between the markers' heights, or takes it out.
+void SelectPolygon(CoordinateInBlocks hintAt, bool erase) {
+	if (selectionPolygon.size() < 3) {
+		SpawnHintText(hintAt, L"Outline a polygon with the selection wand's arrow first.", 1, 1);
+		return;
+	}
+
+	int16_t minZ = std::min(marker1Cord.Z, marker2Cord.Z);
+	int16_t maxZ = std::max(marker1Cord.Z, marker2Cord.Z);
+	CoordinateInBlocks low = selectionPolygon[0];
+	CoordinateInBlocks high = selectionPolygon[0];
+	for (const CoordinateInBlocks& point : selectionPolygon) {
+		low = GetSmallVector(low, point);
+		high = GetLargeVector(high, point);
+	}
+	if (!erase && !SelectionFits((high.X - low.X + 1) * (high.Y - low.Y + 1) * (int64_t(maxZ) - minZ + 1), hintAt)) return;
+
+	std::vector<CoordinateInBlocks> points;
+	points.swap(selectionPolygon);
+	jobExecutor.Enqueue(std::make_unique<ImmediateJob>(erase ? L"Deselecting Polygon" : L"Selecting Polygon", hintAt, [points, minZ, maxZ, erase, hintAt]() {
+		std::shared_ptr<VoxelSet> selection = CopySelection();
+		if (erase) {
+			VoxelSet prism;
+			prism.InsertPrism(points, minZ, maxZ);
+			selection->EraseSet(prism);
 		}
+		else {
+			selection->InsertPrism(points, minZ, maxZ);
+		}
+		SetSelection(selection, hintAt);
+	}));
+}
+
+// Adds the voxels of the marker box that the mask accepts to the selection, or takes them out.
+void SelectMasked(CoordinateInBlocks hintAt, bool erase) {
+	if (!MarkersInLoadedChunks()) return;
+
+	BlockMask mask = GetPaletteMask();
+	if (!mask.IsActive()) {
+		SpawnHintText(hintAt, L"Place the Mask block and stack the blocks to select on it.", 1, 1);
+		return;
 	}
-	AddUndoOperation(paintOp);
+	CoordinateInBlocks size = GetLargeVector(marker1Cord, marker2Cord) - GetSmallVector(marker1Cord, marker2Cord) + CoordinateInBlocks(1, 1, 1);
+	if (!erase && !SelectionFits(size.X * size.Y * int64_t(size.Z), hintAt)) return;
+
+	jobExecutor.Enqueue(std::make_unique<MaskSelectJob>(hintAt, mask, erase));
 }
 
-void PasteClipboard(CoordinateInBlocks At) {
-	if (clipboard.empty()) return;
-	PaintOperation paintOp;
+void MaskSelectJob::Complete() {
+	std::shared_ptr<VoxelSet> selection = CopySelection();
+	if (erase) selection->EraseSet(*matched);
+	else selection->InsertSet(*matched);
+	SetSelection(selection, hintLocation);
+}
+
+void ClearSelection(CoordinateInBlocks hintAt) {
+	selectionPolygon.clear();
+	jobExecutor.Enqueue(std::make_unique<ImmediateJob>(L"Clearing Selection", hintAt, [hintAt]() { SetSelection(std::make_shared<VoxelSet>(), hintAt); }));
+}
+
+void UndoLastOperation(CoordinateInBlocks hintAt) {
+	RestoreHistory();
+	jobExecutor.Enqueue(std::make_unique<HistoryJob>(hintAt, false));
+}
+
+void RedoLastOperation(CoordinateInBlocks hintAt) {
+	RestoreHistory();
+	jobExecutor.Enqueue(std::make_unique<HistoryJob>(hintAt, true));
+}
+
+// Clipboard Method
+//********************************
+// A copy or cut replaces the clipboard, so a saved one that was never restored doesn't need to be.
+void CopyRegion(CoordinateInBlocks hintAt) {
+	clipboardRestorePending = false;
+	jobExecutor.Enqueue(std::make_unique<CopyJob>(hintAt, false, false));
+}
+
+void CutRegion(CoordinateInBlocks hintAt, bool dryRun) {
+	if (!dryRun) clipboardRestorePending = false;
+	jobExecutor.Enqueue(std::make_unique<CopyJob>(hintAt, true, dryRun));
+}
+
+void PasteClipboard(CoordinateInBlocks At, bool dryRun) {
+	RestoreClipboard();
+	if (clipboard.empty() && jobExecutor.IsIdle() && !(ShareClipboard && SharedClipboard::GetPublishedVersion(SharedClipboardKey) != 0)) return;
 
 	bool ignoreAirBlocks = false;
 	BlockInfo blockAbove = GetBlock(GetBlockAbove(At));
@@ -348,41 +1639,112 @@ void PasteClipboard(CoordinateInBlocks At) {
 		ignoreAirBlocks = true;
 	}
 
-	for (int i = 0; i < clipboard.size(); i++) {
-		if (ignoreAirBlocks && clipboard[i].blockInfo.Type == EBlockType::Air) continue;
+	jobExecutor.Enqueue(std::make_unique<PasteJob>(GetBlockAbove(At), At, ignoreAirBlocks, dryRun));
+}
 
-		Paint(paintOp, clipboard[i].blockInfo, At + clipboard[i].location);
+// Only the clipboard's orientation changes; the paste moves the blocks.
+void OrientClipboard(Orientation transform) {
+	RestoreClipboard();
+	clipboard.Orient(transform);
+	clipboardVersion++;
+}
+
+void QueueOrientClipboard(CoordinateInBlocks hintAt, Orientation transform, const wString& hint) {
+	jobExecutor.Enqueue(std::make_unique<ImmediateJob>(L"Orienting Clipboard", hintAt, [transform]() { OrientClipboard(transform); }));
+	SpawnHintText(hintAt, hint, 1, 1);
+}
+
+// What pasting the clipboard takes, before any of it is pasted. Queued, so it counts a copy still running.
+void ShowClipboardMaterials(CoordinateInBlocks hintAt) {
+	jobExecutor.Enqueue(std::make_unique<ImmediateJob>(L"Counting Materials", hintAt, [hintAt]() {
+		RestoreClipboard();
+		if (clipboard.empty()) {
+			SpawnHintText(hintAt, L"Clipboard is empty.", 1, 1);
+			return;
+		}
+		MaterialHistogram materials;
+		materials.AddClipboard(ClipboardView(clipboard));
+		SpawnHintText(hintAt, L"Bill of materials:\n" + materials.GetSummary(), 5, 1, 1);
+	}));
+}
+
+// Schematic Library
+//********************************
+SchematicLibrary& GetSchematicLibrary() {
+	if (!schematicLibrary.IsOpen()) {
+		schematicLibrary.Open(std::filesystem::path(GetThisModGlobalSaveFolderPath(L"CyubePainter")) / L"Schematics");
 	}
-	AddUndoOperation(paintOp);
+	return schematicLibrary;
 }
 
-void RotateClipboard90DegreesClockwise() {
-	for (int i = 0; i < clipboard.size(); i++) {
-		int64_t x = clipboard[i].location.Y;
-		int64_t y = clipboard[i].location.X * -1;
-		clipboard[i].location = CoordinateInBlocks(x, y+clipboardWidth, clipboard[i].location.Z);
+// There is no text input in game, so schematics are named after the world they were saved in.
+void SaveClipboardAsSchematic(CoordinateInBlocks hintAt) {
+	RestoreClipboard();
+	if (clipboard.empty()) {
+		SpawnHintText(hintAt, L"Clipboard is empty.", 1, 1);
+		return;
+	}
+
+	SchematicLibrary& library = GetSchematicLibrary();
+	wString name = GetWorldName() + L" #" + std::to_wstring(library.GetEntries().size() + 1);
+	if (!library.Add(name, clipboard)) {
+		SpawnHintText(hintAt, L"Could not save schematic.", 1, 1);
+		return;
 	}
-	int64_t width = clipboardWidth;
-	clipboardWidth = clipboardLength;
-	clipboardLength = width;
+	selectedSchematic = int64_t(library.GetEntries().size()) - 1;
+	SpawnHintText(hintAt, L"Saved schematic " + name, 2, 1);
 }
 
-void RotateClipboard90DegreesCounterClockwise() {
-	for (int i = 0; i < clipboard.size(); i++) {
-		int64_t x = clipboard[i].location.Y * -1;
-		int64_t y = clipboard[i].location.X;
-		clipboard[i].location = CoordinateInBlocks(x+clipboardLength, y, clipboard[i].location.Z);
+// Steps through the schematics that contain the block placed on top of the paste block, or through all of them.
+void SelectNextSchematic(CoordinateInBlocks At) {
+	SchematicLibrary& library = GetSchematicLibrary();
+	CoordinateInBlocks hintAt = GetBlockAbove(At);
+
+	std::vector<size_t> matches;
+	BlockInfo filter = GetBlock(hintAt);
+	if (filter.IsValid() && filter.Type != EBlockType::Air && filter.CustomBlockID != AirFilter) {
+		matches = library.FindContaining(filter);
+	}
+	else {
+		for (size_t i = 0; i < library.GetEntries().size(); i++) matches.push_back(i);
+	}
+
+	if (matches.empty()) {
+		SpawnHintText(hintAt, L"No matching schematics.", 1, 1);
+		return;
 	}
-	int64_t width = clipboardWidth;
-	clipboardWidth = clipboardLength;
-	clipboardLength = width;
+
+	auto next = std::upper_bound(matches.begin(), matches.end(), size_t(selectedSchematic));
+	if (selectedSchematic < 0 || next == matches.end()) next = matches.begin();
+	selectedSchematic = int64_t(*next);
+
+	const SchematicInfo& info = library.GetEntries()[*next];
+	std::array<int64_t, 3> size = info.GetOrientedSize();
+	SpawnHintText(hintAt, info.name + L" (" + std::to_wstring(size[0]) + L"x" + std::to_wstring(size[1]) + L"x" + std::to_wstring(size[2]) + L"), "
+		+ std::to_wstring(next - matches.begin() + 1) + L" of " + std::to_wstring(matches.size()), 2, 1);
+}
+
+void PasteSchematic(CoordinateInBlocks At, bool dryRun) {
+	if (selectedSchematic < 0) {
+		SpawnHintText(GetBlockAbove(At), L"No schematic selected.", 1, 1);
+		return;
+	}
+
+	std::shared_ptr<MappedSchematic> schematic = GetSchematicLibrary().Map(size_t(selectedSchematic));
+	if (schematic == nullptr) {
+		SpawnHintText(GetBlockAbove(At), L"Could not read schematic.", 1, 1);
+		return;
+	}
+
+	bool ignoreAirBlocks = GetBlock(GetBlockAbove(At)).CustomBlockID == AirFilter;
+	jobExecutor.Enqueue(std::make_unique<PasteJob>(GetBlockAbove(At), At, ignoreAirBlocks, dryRun, schematic));
 }
 
 /************************************************************* 
 //	Event Functions
 *************************************************************/
 
-void Event_BlockPlaced(CoordinateInBlocks At, UniqueID CustomBlockID, bool Moved)
+void Event_BlockPlaced(CoordinateInBlocks At, UniqueID CustomBlockID, bool /*Moved*/)
 {
 	if (CustomBlockID == Marker1Block) {
 		marker1Cord = At;
@@ -391,16 +1753,17 @@ void Event_BlockPlaced(CoordinateInBlocks At, UniqueID CustomBlockID, bool Moved
 		marker2Cord = At;
 	}
 	else if (CustomBlockID == MaskBlock) {
-		maskCord = At;
+		// One stacked in the column inverts the mask and leaves the palette's Mask block where it is.
+		if (!IsInMaskColumn(At)) maskCord = At;
 	}
 	else if (CustomBlockID == PaintBlock) {
 		paintCord = At;
 	}
 }
 
-void Event_BlockDestroyed(CoordinateInBlocks At, UniqueID CustomBlockID, bool Moved)
+void Event_BlockDestroyed(CoordinateInBlocks At, UniqueID CustomBlockID, bool /*Moved*/)
 {
-	if (CustomBlockID == MaskBlock) {
+	if (CustomBlockID == MaskBlock && At == maskCord) {
 		// May cause issues in edge case if painting after placing multiple palettes
 		maskCord = CoordinateInBlocks(0, 0, 0);
 	}
@@ -412,11 +1775,101 @@ void Event_BlockDestroyed(CoordinateInBlocks At, UniqueID CustomBlockID, bool Mo
 	}
 }
 
-void Event_BlockHitByTool(CoordinateInBlocks At, UniqueID CustomBlockID, wString ToolName, CoordinateInCentimeters ExactHitLocation, bool ToolHeldByHandLeft)
+void Event_BlockHitByTool(CoordinateInBlocks At, UniqueID CustomBlockID, wString ToolName, CoordinateInCentimeters /*ExactHitLocation*/, bool /*ToolHeldByHandLeft*/)
 {
 	if (ToolName == L"T_Arrow") {
-		if (CustomBlockID == PasteBlock) {
-			PasteClipboard(At);
+		if (CustomBlockID == PaintBlock) {
+			PaintArea(GetBlockAbove(At), false, ShapeKind::Ellipsoid);
+			SpawnHintText(GetBlockAbove(At), L"Painting Ellipsoid.", 1, 1);
+		}
+		else if (CustomBlockID == PasteBlock) {
+			PasteClipboard(At, false);
+		}
+		else if (CustomBlockID == Rotate90CWBlock) {
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::QuarterTurn(0, false), L"Rotating Clipboard 90 degrees around X.");
+		}
+		else if (CustomBlockID == Rotate90CCWBlock) {
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::QuarterTurn(0, true), L"Rotating Clipboard -90 degrees around X.");
+		}
+		else if (CustomBlockID == CopyBlock) {
+			// Queued, so a copy still running is saved once it finishes.
+			CoordinateInBlocks hintAt = GetBlockAbove(At);
+			jobExecutor.Enqueue(std::make_unique<ImmediateJob>(L"Saving Schematic", hintAt, [hintAt]() { SaveClipboardAsSchematic(hintAt); }));
+		}
+		else if (CustomBlockID == Marker1Block || CustomBlockID == Marker2Block) {
+			SelectPolygon(GetBlockAbove(At), CustomBlockID == Marker2Block);
+		}
+		else if (CustomBlockID == UndoBlock) {
+			bool written = WriteOperationTrace();
+			SpawnHintText(GetBlockAbove(At), written ? L"Operation trace written." : L"Could not write the operation trace.", 1, 1);
+		}
+	}
+
+	if (ToolName == L"T_Pickaxe_Stone") {
+		if (CustomBlockID == PaintBlock) {
+			PaintArea(GetBlockAbove(At), false, ShapeKind::Cylinder);
+			SpawnHintText(GetBlockAbove(At), L"Painting Cylinder.", 1, 1);
+		}
+		else if (CustomBlockID == PasteBlock) {
+			SelectNextSchematic(At);
+		}
+		else if (CustomBlockID == Marker1Block || CustomBlockID == Marker2Block) {
+			SelectMasked(GetBlockAbove(At), CustomBlockID == Marker2Block);
+		}
+		else if (CustomBlockID == CopyBlock) {
+			StackArea(At, false);
+			SpawnHintText(GetBlockAbove(At), L"Stacking Selected Region.", 1, 1);
+		}
+		else if (CustomBlockID == Rotate90CWBlock) {
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::QuarterTurn(1, false), L"Rotating Clipboard 90 degrees around Y.");
+		}
+		else if (CustomBlockID == Rotate90CCWBlock) {
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::QuarterTurn(1, true), L"Rotating Clipboard -90 degrees around Y.");
+		}
+	}
+
+	if (ToolName == L"T_Axe_Stone") {
+		if (CustomBlockID == PaintBlock) {
+			PaintArea(GetBlockAbove(At), false, ShapeKind::Cone);
+			SpawnHintText(GetBlockAbove(At), L"Painting Cone.", 1, 1);
+		}
+		else if (CustomBlockID == MaskBlock) {
+			ReplaceArea(GetBlockAbove(At), false);
+			SpawnHintText(GetBlockAbove(At), L"Replacing Blocks.", 1, 1);
+		}
+		else if (CustomBlockID == PasteBlock) {
+			PasteSchematic(At, false);
+		}
+		else if (CustomBlockID == Marker1Block || CustomBlockID == Marker2Block) {
+			ClearSelection(GetBlockAbove(At));
+		}
+		else if (CustomBlockID == CopyBlock) {
+			ShowClipboardMaterials(GetBlockAbove(At));
+		}
+		else if (CustomBlockID == Rotate90CWBlock) {
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::Mirror(0), L"Mirroring Clipboard along X.");
+		}
+		else if (CustomBlockID == Rotate90CCWBlock) {
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::Mirror(1), L"Mirroring Clipboard along Y.");
+		}
+	}
+
+	// The shovel runs a dry run: it reports what an operation would change without touching the world.
+	if (ToolName == L"T_Shovel_Stone") {
+		if (CustomBlockID == PaintBlock) {
+			PaintArea(GetBlockAbove(At), true);
+		}
+		else if (CustomBlockID == CutBlock) {
+			CutRegion(GetBlockAbove(At), true);
+		}
+		else if (CustomBlockID == PasteBlock) {
+			PasteClipboard(At, true);
+		}
+		else if (CustomBlockID == CopyBlock) {
+			StackArea(At, true);
+		}
+		else if (CustomBlockID == MaskBlock) {
+			ReplaceArea(GetBlockAbove(At), true);
 		}
 	}
 
@@ -431,23 +1884,23 @@ void Event_BlockHitByTool(CoordinateInBlocks At, UniqueID CustomBlockID, wString
 			}
 		}
 		else if (CustomBlockID == PaintBlock) {
-			PaintArea();
+			PaintArea(GetBlockAbove(At), false);
 			SpawnHintText(GetBlockAbove(At), L"Painting Area.", 1, 1);
 		}
 		else if (CustomBlockID == UndoBlock) {
-			UndoLastOperation();
+			UndoLastOperation(GetBlockAbove(At));
 			SpawnHintText(GetBlockAbove(At), L"Undoing Last Operation", 1, 1);
 		}
 		else if (CustomBlockID == RedoBlock) {
-			RedoLastOperation();
+			RedoLastOperation(GetBlockAbove(At));
 			SpawnHintText(GetBlockAbove(At), L"Redoing Last Operation.", 1, 1);
 		}
 		else if (CustomBlockID == CopyBlock) {
-			CopyRegion();
+			CopyRegion(GetBlockAbove(At));
 			SpawnHintText(GetBlockAbove(At), L"Copying Selected Region.", 1, 1);
 		}
 		else if (CustomBlockID == CutBlock) {
-			CutRegion();
+			CutRegion(GetBlockAbove(At), false);
 			SpawnHintText(GetBlockAbove(At), L"Cutting Selected Region.", 1, 1);
 		}
 		else if (CustomBlockID == ToggleWandBlock) {
@@ -463,50 +1916,140 @@ void Event_BlockHitByTool(CoordinateInBlocks At, UniqueID CustomBlockID, wString
 			SpawnHintText(GetBlockAbove(At), messageText, 1, 1);
 		}
 		else if (CustomBlockID == Rotate90CWBlock) {
-			RotateClipboard90DegreesClockwise();
-			SpawnHintText(GetBlockAbove(At), L"Rotating Clipboard 90 degrees clockwise.", 1, 1);
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::QuarterTurn(2, false), L"Rotating Clipboard 90 degrees clockwise.");
 		}
 		else if (CustomBlockID == Rotate90CCWBlock) {
-			RotateClipboard90DegreesCounterClockwise();
-			SpawnHintText(GetBlockAbove(At), L"Rotating Clipboard 90 degrees counterclockwise", 1, 1);
+			QueueOrientClipboard(GetBlockAbove(At), Orientation::QuarterTurn(2, true), L"Rotating Clipboard 90 degrees counterclockwise");
 		}
 		else if (CustomBlockID == PasteBlock) {
-			PasteClipboard(At);
+			PasteClipboard(At, false);
+		}
+		else if (CustomBlockID == Marker1Block || CustomBlockID == Marker2Block) {
+			SelectMarkerBox(GetBlockAbove(At), CustomBlockID == Marker2Block);
 		}
 	}
 }
 
 void Event_Tick()
 {
+	workerPool.DrainCompletions();
+	jobExecutor.Tick();
+	SaveSessionIfChanged();
+	SaveClipboardInBackground();
+	// Between jobs, so a copy still filling the clipboard is never published half done.
+	if (jobExecutor.IsIdle()) PublishClipboard();
+
+	operationJournal.CheckpointIfDue(JournalCheckpointMilliseconds);
+	if (jobExecutor.IsIdle() && operationJournal.GetFileSize() > JournalCompactBytes) {
+		CompactJournal();
+	}
 
+	// Flushed between operations, so a job never sees its own queued writes come back.
+	if (!deferredWrites.empty() && jobExecutor.IsIdle() && ++ticksSinceDeferredCheck >= DeferredCheckTicks) {
+		ticksSinceDeferredCheck = 0;
+		FlushDeferredWrites();
+	}
 }
 
-void Event_OnLoad()
+void Event_OnLoad(bool CreatedNewWorld)
 {
+	workerPool.Start(WorkerThreadCount);
+
+	// The mod stays loaded between worlds, so nothing from the last one may carry over.
+	marker1Cord = CoordinateInBlocks(0, 0, 0);
+	marker2Cord = CoordinateInBlocks(0, 0, 0);
+	voxelSelection = nullptr;
+	maskCord = CoordinateInBlocks(0, 0, 0);
+	paintCord = CoordinateInBlocks(0, 0, 0);
+	selectionWandEnabled = false;
+	exchangingWandEnabled = false;
+	exchangeTarget = BlockInfo(EBlockType::Air);
+	clipboard.clear();
+	undoHistory.clear();
+	redoHistory.clear();
+	std::filesystem::path saveFolder = std::filesystem::path(GetThisModSaveFolderPath(L"CyubePainter"));
+	undoHistory.SetSpillFile(saveFolder / UndoSpillFileName);
+	redoHistory.SetSpillFile(saveFolder / RedoSpillFileName);
+	clipboardVersion = 0;
+	savedClipboardVersion = 0;
+	publishedClipboardVersion = UINT64_MAX;
+	savedSession = EncodeSession();
+	operationTracer.clear();
+	operationTracer.onSpanFinished = ReportOperationSpan;
+	jobExecutor.tracer = &operationTracer;
+
+	clipboardRestorePending = !CreatedNewWorld;
+	historyRestorePending = !CreatedNewWorld;
+	deferredWrites.clear();
+	ticksSinceDeferredCheck = 0;
+	if (!CreatedNewWorld) {
+		RestoreSession();
+		RestoreDeferredWrites();
+	}
 
+	// Anything left in the journal means the game stopped without saving the histories.
+	std::filesystem::path journalPath = saveFolder / JournalFileName;
+	journalRollbackPending = false;
+	if (!CreatedNewWorld) {
+		ReplayJournal(journalPath);
+	}
+	operationJournal.Open(journalPath);
+	if (!journalRollbackPending) {
+		if (!historyRestorePending) SaveHistory();
+		operationJournal.Truncate();
+	}
 }
 
 void Event_OnExit()
 {
-	
+	SaveSessionIfChanged();
+
+	clipboardSave.Finish();
+	if (clipboardVersion != savedClipboardVersion) {
+		SaveModData(ClipboardSaveName, EncodeClipboard(clipboard));
+		savedClipboardVersion = clipboardVersion;
+	}
+	// Other mods keep any reference they hold; only the slot lets go of it.
+	SharedClipboard::Withdraw(SharedClipboardKey, &clipboard);
+
+	// Left as saved if it was never restored, since nothing could have changed it.
+	// With a rollback still to do, the journal stays as it is and is replayed again on the next load.
+	if (journalRollbackPending) {
+		operationJournal.Close();
+	}
+	else if (!historyRestorePending) {
+		SaveHistory();
+		operationJournal.Truncate();
+	}
+
+	SaveDeferredWrites();
+
+	if (!operationTracer.GetSpans().empty()) {
+		WriteOperationTrace();
+	}
+
+	workerPool.Shutdown();
 }
 
 /*************************************************************
 //	Advanced Event Functions
 *************************************************************/
 
-void Event_AnyBlockPlaced(CoordinateInBlocks At, BlockInfo Type, bool Moved)
+void Event_AnyBlockPlaced(CoordinateInBlocks /*At*/, BlockInfo /*Type*/, bool /*Moved*/)
 {
 
 }
 
-void Event_AnyBlockDestroyed(CoordinateInBlocks At, BlockInfo Type, bool Moved)
+void Event_AnyBlockDestroyed(CoordinateInBlocks /*At*/, BlockInfo /*Type*/, bool /*Moved*/)
 {
 
 }
 
-void Event_AnyBlockHitByTool(CoordinateInBlocks At, BlockInfo Type, wString ToolName, CoordinateInCentimeters ExactHitLocation, bool ToolHeldByHandLeft)
+void Event_AnyBlockHitByTool(CoordinateInBlocks At, BlockInfo Type, wString ToolName, CoordinateInCentimeters /*ExactHitLocation*/, bool /*ToolHeldByHandLeft*/)
 {
+	// The mod's own blocks have their tool actions in Event_BlockHitByTool, so the wands leave them alone.
+	if (std::find(std::begin(ThisModUniqueIDs), std::end(ThisModUniqueIDs), Type.CustomBlockID) != std::end(ThisModUniqueIDs)) return;
+
 	if (exchangingWandEnabled) {
 		if (ToolName == L"T_Arrow") {
 			exchangeTarget = Type;
@@ -514,6 +2057,9 @@ void Event_AnyBlockHitByTool(CoordinateInBlocks At, BlockInfo Type, wString Tool
 		if (ToolName == L"T_Pickaxe_Stone" || ToolName == L"T_Axe_Stone") {
 			SetBlock(At, exchangeTarget);
 		}
+		if (ToolName == L"T_Shovel_Stone") {
+			FloodFill(At, true);
+		}
 	}
 
 	if (selectionWandEnabled) {
@@ -525,5 +2071,13 @@ void Event_AnyBlockHitByTool(CoordinateInBlocks At, BlockInfo Type, wString Tool
 			SpawnHintText(At + CoordinateInBlocks(0, 0, 1), L"Marker 2 set!", 1, 1);
 			marker2Cord = At;
 		}
+		if (ToolName == L"T_Shovel_Stone") {
+			SpawnHintText(At + CoordinateInBlocks(0, 0, 1), L"Flood selecting", 1, 1);
+			FloodFill(At, false);
+		}
+		if (ToolName == L"T_Arrow") {
+			selectionPolygon.push_back(At);
+			SpawnHintText(At + CoordinateInBlocks(0, 0, 1), L"Polygon corner " + std::to_wstring(selectionPolygon.size()), 1, 1);
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+#include "GameAPI.h"
+#include "ByteStream.h"
+#include "WorkerPool.h"
+
+#include <functional>
+
+/************************************************************
+	Per-world save data, written with SaveModData. Every blob starts with a magic number and a format version,
+	and a blob whose header doesn't match is ignored instead of being half read.
+*************************************************************/
+
+constexpr uint32_t SaveMagic = 0x50425943; // "CYBP"
+// Version 2 added the clipboard's orientation, version 3 the tags linking queued writes to their undo entries,
+// version 4 the materials each undo entry charged.
+constexpr uint32_t SaveFormatVersion = 4;
+
+inline void WriteSaveHeader(ByteWriter& writer) {
+	writer.WriteU32(SaveMagic);
+	writer.WriteVarint(SaveFormatVersion);
+}
+
+inline bool ReadSaveHeader(ByteReader& reader) {
+	uint32_t magic = reader.ReadU32();
+	uint64_t version = reader.ReadVarint();
+	return !reader.failed && magic == SaveMagic && version == SaveFormatVersion;
+}
+
+// Encodes one save blob on the worker pool. The game's functions are only called from the game thread,
+// so Poll (from Event_Tick) or Finish hands the finished blob to SaveModData.
+class BackgroundSave {
+public:
+	wString name;
+
+	BackgroundSave(wString saveName, WorkerPool& workerPool) : name(saveName), pool(workerPool) {}
+
+	bool IsBusy() const {
+		return pending != nullptr;
+	}
+
+	// Only one encode runs at a time; call this when IsBusy is false.
+	void Start(std::function<std::vector<uint8_t>()> encode) {
+		pending = pool.Run<std::vector<uint8_t>>(std::move(encode));
+	}
+
+	// Saves the blob if the worker is done. Returns true when it saved.
+	bool Poll() {
+		if (pending == nullptr || !pending->IsReady()) return false;
+		SaveModData(name, pending->Get());
+		pending = nullptr;
+		return true;
+	}
+
+	// Waits for a running encode and saves its blob.
+	void Finish() {
+		if (pending != nullptr) {
+			SaveModData(name, pending->Wait());
+			pending = nullptr;
+		}
+	}
+
+private:
+	WorkerPool& pool;
+	std::shared_ptr<WorkerTask<std::vector<uint8_t>>> pending;
+};
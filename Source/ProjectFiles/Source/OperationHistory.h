@@ -0,0 +1,524 @@
+#pragma once
+#include "GameAPI.h"
+#include "BlockPalette.h"
+#include "ByteStream.h"
+#include "RegionTraversal.h"
+#include "MappedFile.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+
+/************************************************************
+	Undo and redo entries. An entry stores the blocks an operation replaced, run-length coded over the
+	operation's bounding box in RegionTiling order: chunk tile by chunk tile, x-inner, y, z inside each.
+	Coordinates are implied by the position in that traversal, so no per-block coordinates are kept.
+
+	Layout: origin, box size, block count, palette, then runs of (skipped voxels, run length, palette index)
+	until the end of the data.
+*************************************************************/
+
+struct PaintOperation {
+	std::vector<uint8_t> data;
+	int64_t blockCount = 0;
+	// The tag of the writes the operation queued for chunks that weren't loaded, or 0 if it queued none.
+	uint32_t deferredTag = 0;
+	// What the operation took from the inventory per block, with what it gave back as negative counts.
+	// Undo gives back and redo takes again exactly this.
+	std::vector<std::pair<BlockInfo, int64_t>> charged;
+	// A spilled entry keeps its data in the history's spill file instead, at spillOffset.
+	bool spilled = false;
+	uint64_t spillOffset = 0;
+	uint64_t spillSize = 0;
+
+	bool empty() const {
+		return blockCount == 0;
+	}
+
+	size_t GetMemoryBytes() const {
+		return sizeof(PaintOperation) + data.capacity() + charged.capacity() * sizeof(charged[0]);
+	}
+
+	// The deferred tag and the charged materials, which the history save and the journal store before the data.
+	void WriteSettlement(ByteWriter& writer) const {
+		writer.WriteVarint(deferredTag);
+		writer.WriteVarint(charged.size());
+		for (const auto& [block, count] : charged) {
+			writer.WriteBlockInfo(block);
+			writer.WriteSignedVarint(count);
+		}
+	}
+
+	void ReadSettlement(ByteReader& reader) {
+		deferredTag = uint32_t(reader.ReadVarint());
+		charged.clear();
+		uint64_t chargedCount = reader.ReadVarint();
+		for (uint64_t i = 0; i < chargedCount && !reader.failed; i++) {
+			BlockInfo block = reader.ReadBlockInfo();
+			charged.emplace_back(block, reader.ReadSignedVarint());
+		}
+	}
+
+	size_t GetDataSize() const {
+		return spilled ? size_t(spillSize) : data.size();
+	}
+};
+
+// The encoded data of an entry, either in memory or in a mapping of the spill file that it keeps open.
+struct OperationData {
+	std::shared_ptr<MappedFile> mapping;
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+// Collects the previous value of every block an operation writes, in any order, and encodes them once it's done.
+// Records are kept per chunk tile, so an operation that finishes one tile before starting the next needs no sort,
+// whatever order it visits the tiles in.
+struct OperationRecorder {
+	CoordinateInBlocks origin;
+	int64_t sizeX = 0;
+	int64_t sizeY = 0;
+	int64_t sizeZ = 0;
+
+	OperationRecorder() = default;
+	OperationRecorder(CoordinateInBlocks minCorner, CoordinateInBlocks maxCorner) {
+		Begin(minCorner, maxCorner);
+	}
+
+	void Begin(CoordinateInBlocks minCorner, CoordinateInBlocks maxCorner) {
+		origin = minCorner;
+		sizeX = maxCorner.X - minCorner.X + 1;
+		sizeY = maxCorner.Y - minCorner.Y + 1;
+		sizeZ = int64_t(maxCorner.Z) - minCorner.Z + 1;
+		tiling = RegionTiling(minCorner, maxCorner);
+		palette.clear();
+		tileRecords.assign(tiling.GetTileCount(), {});
+		tileInOrder.assign(tiling.GetTileCount(), 1);
+		recordCount = 0;
+	}
+
+	bool empty() const {
+		return recordCount == 0;
+	}
+
+	size_t size() const {
+		return recordCount;
+	}
+
+	// Sorts and encodes the records on a worker instead of in Finish, which can take a whole tick for a large
+	// operation. Call it until it returns true; Finish then returns the encoded entry.
+	bool FinishInBackground(WorkerPool& pool) {
+		if (encoded == nullptr) {
+			if (empty()) return true;
+
+			auto records = std::make_shared<OperationRecorder>(std::move(*this));
+			size_t count = records->recordCount;
+			*this = OperationRecorder();
+			recordCount = count;
+			encoded = pool.Run<PaintOperation>([records]() { return records->Finish(); });
+		}
+		return encoded->IsReady();
+	}
+
+	// Each record is the voxel's index in the box above the palette index in the low 16 bits.
+	void Record(CoordinateInBlocks at, const BlockInfo& previous) {
+		uint64_t index = uint64_t(tiling.GetIndex(at));
+		uint64_t record = (index << 16) | palette.IndexOf(previous);
+
+		size_t tile = tiling.GetTileOf(at);
+		std::vector<uint64_t>& records = tileRecords[tile];
+		if (!records.empty() && (records.back() >> 16) >= index) {
+			tileInOrder[tile] = 0;
+		}
+		records.push_back(record);
+		recordCount++;
+	}
+
+	PaintOperation Finish() {
+		if (encoded != nullptr) {
+			PaintOperation paintOp = std::move(encoded->Wait());
+			encoded = nullptr;
+			recordCount = 0;
+			return paintOp;
+		}
+
+		size_t blockCount = 0;
+		for (size_t tile = 0; tile < tileRecords.size(); tile++) {
+			std::vector<uint64_t>& records = tileRecords[tile];
+			if (!tileInOrder[tile]) {
+				// A voxel written twice keeps the value it had before the operation, which is its first record.
+				std::stable_sort(records.begin(), records.end(), [](uint64_t a, uint64_t b) { return (a >> 16) < (b >> 16); });
+				records.erase(std::unique(records.begin(), records.end(), [](uint64_t a, uint64_t b) { return (a >> 16) == (b >> 16); }), records.end());
+			}
+			blockCount += records.size();
+		}
+
+		ByteWriter writer;
+		writer.WriteCoordinate(origin);
+		writer.WriteVarint(uint64_t(sizeX));
+		writer.WriteVarint(uint64_t(sizeY));
+		writer.WriteVarint(uint64_t(sizeZ));
+		writer.WriteVarint(blockCount);
+		writer.WriteVarint(palette.size());
+		for (const BlockInfo& info : palette.entries) {
+			writer.WriteBlockInfo(info);
+		}
+
+		// Tiles are numbered in index order, so their records concatenate into one sorted stream.
+		uint64_t nextIndex = 0;
+		uint64_t runStart = 0;
+		uint64_t runLength = 0;
+		uint64_t runPalette = 0;
+		auto writeRun = [&]() {
+			writer.WriteVarint(runStart - nextIndex);
+			writer.WriteVarint(runLength);
+			writer.WriteVarint(runPalette);
+			nextIndex = runStart + runLength;
+		};
+
+		for (const std::vector<uint64_t>& records : tileRecords) {
+			for (uint64_t record : records) {
+				uint64_t index = record >> 16;
+				uint64_t paletteIndex = record & 0xFFFF;
+				if (runLength > 0 && index == runStart + runLength && paletteIndex == runPalette) {
+					runLength++;
+					continue;
+				}
+				if (runLength > 0) writeRun();
+				runStart = index;
+				runLength = 1;
+				runPalette = paletteIndex;
+			}
+		}
+		if (runLength > 0) writeRun();
+
+		PaintOperation paintOp;
+		paintOp.blockCount = int64_t(blockCount);
+		paintOp.data = std::move(writer.bytes);
+		paintOp.data.shrink_to_fit();
+
+		tileRecords.clear();
+		tileRecords.shrink_to_fit();
+		tileInOrder.clear();
+		recordCount = 0;
+		palette.clear();
+		return paintOp;
+	}
+
+private:
+	RegionTiling tiling;
+	BlockPalette palette;
+	std::vector<std::vector<uint64_t>> tileRecords;
+	std::vector<uint8_t> tileInOrder;
+	size_t recordCount = 0;
+	std::shared_ptr<WorkerTask<PaintOperation>> encoded;
+};
+
+// Decodes an entry one block at a time, so replaying it can be spread over several ticks.
+struct OperationReader {
+	CoordinateInBlocks origin;
+	int64_t sizeX = 0;
+	int64_t sizeY = 0;
+	int64_t sizeZ = 0;
+	int64_t blockCount = 0;
+	int64_t blocksRead = 0;
+
+	OperationReader(const uint8_t* data, size_t size) : reader(data, size) {
+		origin = reader.ReadCoordinate();
+		sizeX = int64_t(reader.ReadVarint());
+		sizeY = int64_t(reader.ReadVarint());
+		sizeZ = int64_t(reader.ReadVarint());
+		blockCount = int64_t(reader.ReadVarint());
+
+		uint64_t paletteSize = reader.ReadVarint();
+		for (uint64_t i = 0; i < paletteSize && !reader.failed; i++) {
+			palette.push_back(reader.ReadBlockInfo());
+		}
+		if (!reader.failed && sizeX > 0 && sizeY > 0 && sizeZ > 0) {
+			tiling = RegionTiling(GetMinCorner(), GetMaxCorner());
+		}
+	}
+
+	explicit OperationReader(const PaintOperation& paintOp) : OperationReader(paintOp.data.data(), paintOp.data.size()) {}
+
+	CoordinateInBlocks GetMinCorner() const {
+		return origin;
+	}
+
+	CoordinateInBlocks GetMaxCorner() const {
+		return origin + CoordinateInBlocks(sizeX - 1, sizeY - 1, int16_t(sizeZ - 1));
+	}
+
+	bool Next(CoordinateInBlocks& at, BlockInfo& info) {
+		if (runRemaining == 0) {
+			if (reader.AtEnd()) return false;
+
+			index += int64_t(reader.ReadVarint());
+			runRemaining = int64_t(reader.ReadVarint());
+			runPalette = reader.ReadVarint();
+			if (reader.failed || runPalette >= palette.size() || runRemaining == 0 || index + runRemaining > tiling.GetVolume()) return false;
+
+			current = tiling.GetCoordinate(index, tile);
+			tileBox = tiling.GetTile(tile);
+		}
+
+		at = current;
+		info = palette[runPalette];
+
+		index++;
+		runRemaining--;
+		blocksRead++;
+		if (!tileBox.Step(current) && ++tile < tiling.GetTileCount()) {
+			tileBox = tiling.GetTile(tile);
+			current = tileBox.minCorner;
+		}
+		return true;
+	}
+
+private:
+	ByteReader reader;
+	std::vector<BlockInfo> palette;
+	RegionTiling tiling;
+	int64_t index = 0;
+	int64_t runRemaining = 0;
+	uint64_t runPalette = 0;
+	size_t tile = 0;
+	RegionTile tileBox;
+	CoordinateInBlocks current = CoordinateInBlocks(0, 0, 0);
+};
+
+// A list of entries, newest first, that drops its oldest entries once it holds more than budgetBytes.
+// Given a spill file, entries past the newest residentBudgetBytes are written out to it and read back
+// through a memory map, so a deep history doesn't stay in memory.
+struct OperationHistory {
+	std::list<PaintOperation> entries;
+	size_t budgetBytes;
+	size_t residentBudgetBytes;
+	// Bytes held in memory, and bytes of the entries in the spill file.
+	size_t usedBytes = 0;
+	size_t spilledBytes = 0;
+
+	OperationHistory(size_t budget, size_t residentBudget) : budgetBytes(budget), residentBudgetBytes(residentBudget) {}
+	OperationHistory(size_t budget) : OperationHistory(budget, budget) {}
+
+	~OperationHistory() {
+		CloseSpillFile();
+	}
+
+	// Starts spilling to a file at path, which is emptied first. Spilled entries are lost with it, so call this on an empty history.
+	void SetSpillFile(const std::filesystem::path& path) {
+		CloseSpillFile();
+		spillPath = path;
+		std::error_code error;
+		std::filesystem::create_directories(spillPath.parent_path(), error);
+		ResetSpillFile();
+	}
+
+	bool empty() const {
+		return entries.empty();
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	// The newest entry is always kept in memory, even when it is larger than the whole budget on its own.
+	void Push(PaintOperation&& paintOp) {
+		usedBytes += paintOp.GetMemoryBytes();
+		entries.push_front(std::move(paintOp));
+		Trim();
+	}
+
+	// A spilled entry comes back without its data; read it with GetData.
+	PaintOperation PopNewest() {
+		PaintOperation paintOp = std::move(entries.front());
+		entries.pop_front();
+		RemoveBytes(paintOp);
+		return paintOp;
+	}
+
+	// Maps the spill file for a spilled entry, or reuses a mapping from an earlier call.
+	OperationData GetData(const PaintOperation& paintOp, std::shared_ptr<MappedFile> mapping = nullptr) const {
+		OperationData view;
+		if (!paintOp.spilled) {
+			view.data = paintOp.data.data();
+			view.size = paintOp.data.size();
+			return view;
+		}
+
+		view.mapping = mapping;
+		if (view.mapping == nullptr) {
+			view.mapping = std::make_shared<MappedFile>();
+			if (!view.mapping->Open(spillPath)) view.mapping = nullptr;
+		}
+		if (view.mapping == nullptr || paintOp.spillOffset + paintOp.spillSize > view.mapping->size()) {
+			view.mapping = nullptr;
+			return view;
+		}
+		view.data = view.mapping->data() + paintOp.spillOffset;
+		view.size = size_t(paintOp.spillSize);
+		return view;
+	}
+
+	size_t GetSpilledCount() const {
+		return spilledCount;
+	}
+
+	uint64_t GetSpillFileBytes() const {
+		return spillFileBytes;
+	}
+
+	void clear() {
+		entries.clear();
+		usedBytes = 0;
+		spilledBytes = 0;
+		spilledCount = 0;
+		if (spillFile.is_open()) ResetSpillFile();
+	}
+
+	// Saves the entries newest first, each with its settlement. Each one is already compact, so it is stored as it is.
+	// Spilled entries are read back through one mapping of the spill file. One that can't be read is left out.
+	void Write(ByteWriter& writer) const {
+		std::shared_ptr<MappedFile> mapping;
+		std::vector<std::pair<const PaintOperation*, OperationData>> views;
+		for (const PaintOperation& paintOp : entries) {
+			OperationData view = GetData(paintOp, mapping);
+			if (view.data == nullptr) continue;
+			mapping = view.mapping;
+			views.push_back({ &paintOp, view });
+		}
+
+		writer.WriteVarint(views.size());
+		for (const auto& [paintOp, view] : views) {
+			writer.WriteVarint(uint64_t(paintOp->blockCount));
+			paintOp->WriteSettlement(writer);
+			writer.WriteVarint(view.size);
+			writer.WriteRaw(view.data, view.size);
+		}
+	}
+
+	// Replaces the entries with ones saved by Write. Older entries that no longer fit the budget are dropped.
+	bool Read(ByteReader& reader) {
+		clear();
+		uint64_t count = reader.ReadVarint();
+		for (uint64_t i = 0; i < count && !reader.failed; i++) {
+			PaintOperation paintOp;
+			paintOp.blockCount = int64_t(reader.ReadVarint());
+			paintOp.ReadSettlement(reader);
+			uint64_t size = reader.ReadVarint();
+			const uint8_t* data = reader.Skip(size_t(std::min<uint64_t>(size, reader.GetRemaining() + 1)));
+			if (data == nullptr || (!entries.empty() && usedBytes + spilledBytes + sizeof(PaintOperation) + size > budgetBytes)) continue;
+
+			paintOp.data.assign(data, data + size);
+			usedBytes += paintOp.GetMemoryBytes();
+			entries.push_back(std::move(paintOp));
+			// Entries come oldest last, so each one past the resident budget goes straight to the spill file.
+			if (spillFile.is_open() && usedBytes > residentBudgetBytes && entries.size() > 1) Spill(entries.back());
+		}
+
+		if (reader.failed) {
+			clear();
+			return false;
+		}
+		Trim();
+		return true;
+	}
+
+private:
+	std::filesystem::path spillPath;
+	std::ofstream spillFile;
+	uint64_t spillFileBytes = 0;
+	size_t spilledCount = 0;
+
+	void RemoveBytes(const PaintOperation& paintOp) {
+		if (paintOp.spilled) {
+			spilledBytes -= size_t(paintOp.spillSize);
+			spilledCount--;
+		}
+		usedBytes -= paintOp.GetMemoryBytes();
+	}
+
+	// Spills the oldest entries in memory until the rest fits residentBudgetBytes, then drops the oldest
+	// entries until everything fits budgetBytes.
+	void Trim() {
+		if (spillFile.is_open()) {
+			for (auto entry = entries.rbegin(); usedBytes > residentBudgetBytes && entry != entries.rend(); ++entry) {
+				if (entry->spilled) continue;
+				if (std::next(entry) == entries.rend()) break;
+				Spill(*entry);
+			}
+		}
+
+		while (usedBytes + spilledBytes > budgetBytes && entries.size() > 1) {
+			RemoveBytes(entries.back());
+			entries.pop_back();
+		}
+		if (spilledCount == 0 && spillFileBytes > 0) ResetSpillFile();
+		else if (spillFileBytes > 2 * uint64_t(spilledBytes) + MinCompactBytes) CompactSpillFile();
+	}
+
+	static constexpr uint64_t MinCompactBytes = 16 * 1024 * 1024;
+
+	// Appends the entry's data to the spill file in one sequential write and frees it.
+	void Spill(PaintOperation& paintOp) {
+		spillFile.write(reinterpret_cast<const char*>(paintOp.data.data()), std::streamsize(paintOp.data.size()));
+		spillFile.flush();
+		if (!spillFile) return;
+
+		usedBytes -= paintOp.GetMemoryBytes();
+		paintOp.spilled = true;
+		paintOp.spillOffset = spillFileBytes;
+		paintOp.spillSize = paintOp.data.size();
+		paintOp.data = std::vector<uint8_t>();
+		usedBytes += paintOp.GetMemoryBytes();
+		spillFileBytes += paintOp.spillSize;
+		spilledBytes += size_t(paintOp.spillSize);
+		spilledCount++;
+	}
+
+	void ResetSpillFile() {
+		spillFile.close();
+		spillFile.open(spillPath, std::ios::binary | std::ios::trunc | std::ios::out);
+		spillFileBytes = 0;
+	}
+
+	void CloseSpillFile() {
+		spillFile.close();
+		std::error_code error;
+		if (!spillPath.empty()) std::filesystem::remove(spillPath, error);
+	}
+
+	// Dropped and popped entries leave holes in the file. Once those are most of it, the live entries
+	// are copied to a fresh file in order.
+	void CompactSpillFile() {
+		MappedFile old;
+		if (!old.Open(spillPath)) return;
+
+		std::filesystem::path compactPath = spillPath;
+		compactPath += L".compact";
+		std::ofstream compact(compactPath, std::ios::binary | std::ios::trunc);
+		uint64_t offset = 0;
+		std::vector<std::pair<PaintOperation*, uint64_t>> moved;
+		for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+			if (!entry->spilled) continue;
+			compact.write(reinterpret_cast<const char*>(old.data() + entry->spillOffset), std::streamsize(entry->spillSize));
+			moved.push_back({ &*entry, offset });
+			offset += entry->spillSize;
+		}
+		compact.close();
+		old.Close();
+		if (!compact) return;
+
+		spillFile.close();
+		std::error_code error;
+		std::filesystem::rename(compactPath, spillPath, error);
+		if (!error) {
+			for (auto& [paintOp, newOffset] : moved) paintOp->spillOffset = newOffset;
+			spillFileBytes = offset;
+		}
+		spillFile.open(spillPath, std::ios::binary | std::ios::app);
+	}
+};
@@ -0,0 +1,331 @@
+#pragma once
+#include "GameAPI.h"
+#include "ByteStream.h"
+#include "OperationHistory.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+/************************************************************
+	An append-only file of what the region operations overwrite, so a crash can't leave a half finished edit
+	behind or lose the undo history. Every voxel an operation writes is logged with its previous value, and
+	a finished operation logs its undo entry. Replaying the file after a crash rolls back the operations that
+	never finished and rebuilds the undo and redo histories from the last time they were saved.
+
+	Records are buffered and written in large sequential writes at checkpoints, never flushed per block.
+	The file is a header followed by frames of (payload size, checksum, payload); a torn last frame is ignored.
+*************************************************************/
+
+enum class JournalStack : uint8_t {
+	None,
+	Undo,
+	Redo
+};
+
+// A finished operation: the history entry it took, if any, and the one it added.
+struct JournalEntry {
+	JournalStack popFrom = JournalStack::None;
+	JournalStack pushTo = JournalStack::None;
+	PaintOperation paintOp;
+};
+
+struct JournalContents {
+	std::vector<JournalEntry> finished;
+	// The previous values the unfinished operations logged, in the order they wrote them:
+	// coordinates as deltas from the record before, then the block.
+	std::vector<uint8_t> unfinished;
+	int64_t unfinishedBlocks = 0;
+
+	bool empty() const {
+		return finished.empty() && unfinishedBlocks == 0;
+	}
+};
+
+class OperationJournal {
+public:
+	static constexpr uint32_t Magic = 0x4A425943; // "CYBJ"
+	// Version 2 added the entry's deferred tag to the commit frame, version 3 its charged materials.
+	static constexpr uint32_t FormatVersion = 3;
+	// Buffered records are written once they reach this size, so writes stay large and sequential.
+	static constexpr size_t FlushBytes = 1024 * 1024;
+
+	~OperationJournal() {
+		Close();
+	}
+
+	// Appends to the journal at path, creating it if needed.
+	void Open(const std::filesystem::path& journalPath) {
+		Close();
+		path = journalPath;
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+		fileSize = std::filesystem::exists(path, error) ? std::filesystem::file_size(path, error) : 0;
+		file.open(path, std::ios::binary | std::ios::app);
+		if (fileSize == 0) {
+			WriteHeader();
+		}
+		lastCheckpoint = std::chrono::steady_clock::now();
+	}
+
+	void Close() {
+		if (!file.is_open()) return;
+		Checkpoint();
+		file.close();
+		operationOpen = false;
+		pendingPop = JournalStack::None;
+	}
+
+	bool IsOpen() const {
+		return file.is_open();
+	}
+
+	uint64_t GetFileSize() const {
+		return fileSize + buffer.size();
+	}
+
+	bool HasOpenOperation() const {
+		return operationOpen;
+	}
+
+	// The next operation took the newest entry of a history. It only counts once the operation finishes.
+	void NotePop(JournalStack stack) {
+		pendingPop = stack;
+	}
+
+	// Logs the value a voxel had before the running operation wrote it.
+	void Record(CoordinateInBlocks at, const BlockInfo& previous) {
+		if (!file.is_open()) return;
+		if (!operationOpen) BeginOperation();
+		if (frame.size() == 0) {
+			frame.bytes.reserve(FlushBytes + 64);
+			frame.WriteU8(uint8_t(FrameType::Blocks));
+			frame.WriteVarint(operationID);
+			lastRecord = CoordinateInBlocks(0, 0, 0);
+		}
+
+		frame.WriteSignedVarint(at.X - lastRecord.X);
+		frame.WriteSignedVarint(at.Y - lastRecord.Y);
+		frame.WriteSignedVarint(int64_t(at.Z) - lastRecord.Z);
+		frame.WriteBlockInfo(previous);
+		lastRecord = at;
+
+		if (frame.size() >= FlushBytes) {
+			EndFrame();
+			WriteBuffer();
+		}
+	}
+
+	// Logs that the running operation finished and the entry it added to a history, then writes everything out.
+	void Commit(JournalStack pushTo, const PaintOperation* paintOp) {
+		if (!file.is_open()) return;
+		if (!operationOpen && pendingPop == JournalStack::None && paintOp == nullptr) return;
+		if (!operationOpen) BeginOperation();
+		EndFrame();
+
+		frame.WriteU8(uint8_t(FrameType::Commit));
+		frame.WriteVarint(operationID);
+		frame.WriteU8(uint8_t(paintOp != nullptr ? pushTo : JournalStack::None));
+		if (paintOp != nullptr) {
+			frame.WriteVarint(uint64_t(paintOp->blockCount));
+			paintOp->WriteSettlement(frame);
+			frame.WriteRaw(paintOp->data.data(), paintOp->data.size());
+		}
+		EndFrame();
+		operationOpen = false;
+		Checkpoint();
+	}
+
+	// Writes out what is buffered, so at most the time since the last checkpoint is lost in a crash.
+	void Checkpoint() {
+		EndFrame();
+		WriteBuffer();
+		lastCheckpoint = std::chrono::steady_clock::now();
+	}
+
+	void CheckpointIfDue(double intervalMilliseconds) {
+		if (frame.size() == 0 && buffer.size() == 0) return;
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lastCheckpoint).count();
+		if (elapsed >= intervalMilliseconds) Checkpoint();
+	}
+
+	// Empties the journal once the histories it rebuilds have been saved. An operation still running keeps
+	// its records, so a crash after this still rolls it back.
+	void Truncate() {
+		if (!file.is_open()) return;
+		Checkpoint();
+
+		std::vector<uint8_t> kept;
+		if (operationOpen) {
+			std::ifstream in(path, std::ios::binary);
+			in.seekg(std::streamoff(operationOffset));
+			kept.resize(size_t(fileSize - operationOffset));
+			in.read(reinterpret_cast<char*>(kept.data()), std::streamsize(kept.size()));
+		}
+
+		file.close();
+		file.open(path, std::ios::binary | std::ios::trunc | std::ios::out);
+		fileSize = 0;
+		WriteHeader();
+		operationOffset = fileSize;
+		file.write(reinterpret_cast<const char*>(kept.data()), std::streamsize(kept.size()));
+		file.flush();
+		fileSize += kept.size();
+		file.close();
+		file.open(path, std::ios::binary | std::ios::app);
+	}
+
+	// Reads a journal back. Reading stops at the first frame that is cut off or doesn't match its checksum.
+	static JournalContents Read(const std::filesystem::path& journalPath) {
+		JournalContents contents;
+		std::ifstream in(journalPath, std::ios::binary | std::ios::ate);
+		if (!in) return contents;
+		std::vector<uint8_t> bytes(size_t(in.tellg()));
+		in.seekg(0);
+		in.read(reinterpret_cast<char*>(bytes.data()), std::streamsize(bytes.size()));
+		if (!in) return contents;
+
+		ByteReader reader(bytes.data(), bytes.size());
+		if (reader.ReadU32() != Magic || reader.ReadVarint() != FormatVersion || reader.failed) return contents;
+
+		bool open = false;
+		uint64_t openID = 0;
+		JournalStack openPop = JournalStack::None;
+		ByteWriter unfinished;
+		int64_t unfinishedBlocks = 0;
+		CoordinateInBlocks lastUnfinished = CoordinateInBlocks(0, 0, 0);
+		// Where the open operation's records start. Anything before it belongs to operations that never finished.
+		size_t openBytes = 0;
+		int64_t openBlocks = 0;
+		CoordinateInBlocks openLast = CoordinateInBlocks(0, 0, 0);
+
+		while (reader.GetRemaining() >= 8) {
+			uint32_t size = reader.ReadU32();
+			uint32_t checksum = reader.ReadU32();
+			if (reader.GetRemaining() < size) break;
+			const uint8_t* payload = reader.Skip(size);
+			if (Checksum(payload, size) != checksum) break;
+
+			ByteReader frameReader(payload, size);
+			FrameType type = FrameType(frameReader.ReadU8());
+			uint64_t id = frameReader.ReadVarint();
+			if (type == FrameType::Begin) {
+				// An operation still open here was cut off by a crash, and a later session started another
+				// before rolling it back. Its records stay to be rolled back with whatever else never finished.
+				open = true;
+				openID = id;
+				openPop = JournalStack(frameReader.ReadU8());
+				openBytes = unfinished.size();
+				openBlocks = unfinishedBlocks;
+				openLast = lastUnfinished;
+			}
+			else if (type == FrameType::Blocks && open && id == openID) {
+				CoordinateInBlocks at = CoordinateInBlocks(0, 0, 0);
+				while (!frameReader.AtEnd() && !frameReader.failed) {
+					at.X += frameReader.ReadSignedVarint();
+					at.Y += frameReader.ReadSignedVarint();
+					at.Z = int16_t(at.Z + frameReader.ReadSignedVarint());
+					BlockInfo previous = frameReader.ReadBlockInfo();
+					if (frameReader.failed) break;
+
+					unfinished.WriteSignedVarint(at.X - lastUnfinished.X);
+					unfinished.WriteSignedVarint(at.Y - lastUnfinished.Y);
+					unfinished.WriteSignedVarint(int64_t(at.Z) - lastUnfinished.Z);
+					unfinished.WriteBlockInfo(previous);
+					lastUnfinished = at;
+					unfinishedBlocks++;
+				}
+			}
+			else if (type == FrameType::Commit && open && id == openID) {
+				JournalEntry entry;
+				entry.popFrom = openPop;
+				entry.pushTo = JournalStack(frameReader.ReadU8());
+				if (entry.pushTo != JournalStack::None) {
+					entry.paintOp.blockCount = int64_t(frameReader.ReadVarint());
+					entry.paintOp.ReadSettlement(frameReader);
+					entry.paintOp.data.assign(payload + (size - frameReader.GetRemaining()), payload + size);
+				}
+				if (frameReader.failed) break;
+				contents.finished.push_back(std::move(entry));
+
+				// The records of a finished operation are in its entry already.
+				open = false;
+				unfinished.bytes.resize(openBytes);
+				unfinishedBlocks = openBlocks;
+				lastUnfinished = openLast;
+			}
+		}
+
+		contents.unfinished = std::move(unfinished.bytes);
+		contents.unfinishedBlocks = unfinishedBlocks;
+		return contents;
+	}
+
+private:
+	enum class FrameType : uint8_t {
+		Begin,
+		Blocks,
+		Commit
+	};
+
+	std::filesystem::path path;
+	std::ofstream file;
+	uint64_t fileSize = 0;
+	// Frames waiting for the next write, and the frame being filled.
+	ByteWriter buffer;
+	ByteWriter frame;
+	CoordinateInBlocks lastRecord = CoordinateInBlocks(0, 0, 0);
+	std::chrono::steady_clock::time_point lastCheckpoint;
+
+	uint64_t operationID = 0;
+	bool operationOpen = false;
+	// Where the running operation's Begin frame starts in the file.
+	uint64_t operationOffset = 0;
+	JournalStack pendingPop = JournalStack::None;
+
+	// FNV-1a, which is enough to tell a torn write from a whole frame.
+	static uint32_t Checksum(const uint8_t* data, size_t size) {
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ data[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+	void WriteHeader() {
+		ByteWriter header;
+		header.WriteU32(Magic);
+		header.WriteVarint(FormatVersion);
+		file.write(reinterpret_cast<const char*>(header.bytes.data()), std::streamsize(header.size()));
+		file.flush();
+		fileSize += header.size();
+	}
+
+	void BeginOperation() {
+		EndFrame();
+		operationID++;
+		operationOpen = true;
+		operationOffset = fileSize + buffer.size();
+		frame.WriteU8(uint8_t(FrameType::Begin));
+		frame.WriteVarint(operationID);
+		frame.WriteU8(uint8_t(pendingPop));
+		EndFrame();
+		pendingPop = JournalStack::None;
+	}
+
+	void EndFrame() {
+		if (frame.size() == 0) return;
+		buffer.WriteU32(uint32_t(frame.size()));
+		buffer.WriteU32(Checksum(frame.bytes.data(), frame.size()));
+		buffer.WriteRaw(frame.bytes.data(), frame.size());
+		frame.bytes.clear();
+	}
+
+	void WriteBuffer() {
+		if (buffer.size() == 0 || !file.is_open()) return;
+		file.write(reinterpret_cast<const char*>(buffer.bytes.data()), std::streamsize(buffer.size()));
+		file.flush();
+		fileSize += buffer.size();
+		buffer.bytes.clear();
+	}
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include "GameAPI.h"
+#include "BlockCallCounters.h"
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+
+/************************************************************
+	Counters and spans for the region jobs. Every job gets one span from its first batch to Complete,
+	with a slice per batch, the host block calls it made and how many voxels it visited and changed.
+	The spans can be written as Chrome trace-event JSON, which chrome://tracing and Perfetto show as a timeline.
+*************************************************************/
+
+// One batch of a job inside a tick.
+struct TraceSlice {
+	double startMicroseconds = 0;
+	double durationMicroseconds = 0;
+	int64_t blocks = 0;
+};
+
+struct OperationSpan {
+	wString name;
+	// Microseconds since the tracer was created.
+	double startMicroseconds = 0;
+	double endMicroseconds = 0;
+	double busyMicroseconds = 0;
+	uint64_t getBlockCalls = 0;
+	uint64_t setBlockCalls = 0;
+	int64_t visitedBlocks = 0;
+	int64_t changedBlocks = 0;
+	// What the clipboard and the undo and redo histories hold once the job is done, and what the histories have spilled to disk.
+	size_t clipboardBytes = 0;
+	size_t historyBytes = 0;
+	size_t spilledHistoryBytes = 0;
+	std::vector<TraceSlice> slices;
+
+	wString GetSummary() const {
+		return name + L": " + FormatMilliseconds(endMicroseconds - startMicroseconds) + L" ms wall, "
+			+ FormatMilliseconds(busyMicroseconds) + L" ms busy in " + std::to_wstring(slices.size()) + L" batches\n"
+			+ std::to_wstring(visitedBlocks) + L" visited, " + std::to_wstring(changedBlocks) + L" changed, "
+			+ std::to_wstring(getBlockCalls) + L" GetBlock, " + std::to_wstring(setBlockCalls) + L" SetBlock\n"
+			+ L"Clipboard " + std::to_wstring((clipboardBytes + 1023) / 1024) + L" KB, history " + std::to_wstring((historyBytes + 1023) / 1024) + L" KB"
+			+ L" (" + std::to_wstring((spilledHistoryBytes + 1023) / 1024) + L" KB spilled)";
+	}
+
+private:
+	static wString FormatMilliseconds(double microseconds) {
+		wchar_t text[32];
+		swprintf(text, 32, L"%.1f", microseconds / 1000.0);
+		return text;
+	}
+};
+
+class OperationTracer {
+public:
+	// The newest spans kept for the trace file.
+	static constexpr size_t MaxSpans = 256;
+
+	// Called with each finished span before it's kept, so the mod can fill in what it holds and report it.
+	std::function<void(OperationSpan&)> onSpanFinished;
+
+	OperationTracer() : origin(std::chrono::steady_clock::now()) {}
+
+	// Starts a span for a job the first time one of its batches runs. Jobs run one after the other, so one span is open at a time.
+	void BeginBatch(const void* job, const wString& name) {
+		if (openJob != job) {
+			openJob = job;
+			open = OperationSpan();
+			open.name = name;
+			open.startMicroseconds = Now();
+			startCounters = blockCallCounters;
+		}
+		batchStart = Now();
+	}
+
+	void EndBatch(int64_t blocks) {
+		TraceSlice slice;
+		slice.startMicroseconds = batchStart;
+		slice.durationMicroseconds = Now() - batchStart;
+		slice.blocks = blocks;
+		open.busyMicroseconds += slice.durationMicroseconds;
+		open.slices.push_back(slice);
+	}
+
+	void FinishSpan(int64_t visitedBlocks, int64_t changedBlocks) {
+		if (openJob == nullptr) return;
+
+		open.endMicroseconds = Now();
+		open.getBlockCalls = blockCallCounters.getBlock - startCounters.getBlock;
+		open.setBlockCalls = blockCallCounters.setBlock - startCounters.setBlock;
+		open.visitedBlocks = visitedBlocks;
+		open.changedBlocks = changedBlocks;
+		openJob = nullptr;
+		if (onSpanFinished) onSpanFinished(open);
+
+		spans.push_back(std::move(open));
+		if (spans.size() > MaxSpans) {
+			spans.pop_front();
+		}
+	}
+
+	const std::deque<OperationSpan>& GetSpans() const {
+		return spans;
+	}
+
+	void clear() {
+		spans.clear();
+		openJob = nullptr;
+	}
+
+	// Writes the kept spans as Chrome trace-event JSON: a complete event per span with its batches nested
+	// inside it, and a counter track for the clipboard and history memory.
+	bool WriteChromeTrace(const std::filesystem::path& path) const {
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CyubePainter\"}}";
+		for (const OperationSpan& span : spans) {
+			std::string name = ToJsonString(span.name);
+			file << ",\n{\"name\":" << name << ",\"cat\":\"operation\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+				<< ",\"ts\":" << FormatMicroseconds(span.startMicroseconds) << ",\"dur\":" << FormatMicroseconds(span.endMicroseconds - span.startMicroseconds)
+				<< ",\"args\":{\"busyMs\":" << FormatMicroseconds(span.busyMicroseconds / 1000.0)
+				<< ",\"batches\":" << span.slices.size()
+				<< ",\"visited\":" << span.visitedBlocks << ",\"changed\":" << span.changedBlocks
+				<< ",\"getBlock\":" << span.getBlockCalls << ",\"setBlock\":" << span.setBlockCalls << "}}";
+			for (const TraceSlice& slice : span.slices) {
+				file << ",\n{\"name\":\"Batch\",\"cat\":\"batch\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+					<< ",\"ts\":" << FormatMicroseconds(slice.startMicroseconds) << ",\"dur\":" << FormatMicroseconds(slice.durationMicroseconds)
+					<< ",\"args\":{\"blocks\":" << slice.blocks << "}}";
+			}
+			file << ",\n{\"name\":\"Memory\",\"ph\":\"C\",\"pid\":1,\"ts\":" << FormatMicroseconds(span.endMicroseconds)
+				<< ",\"args\":{\"clipboardKB\":" << (span.clipboardBytes + 1023) / 1024 << ",\"historyKB\":" << (span.historyBytes + 1023) / 1024
+				<< ",\"spilledHistoryKB\":" << (span.spilledHistoryBytes + 1023) / 1024 << "}}";
+		}
+		file << "\n]}\n";
+		return bool(file);
+	}
+
+private:
+	std::chrono::steady_clock::time_point origin;
+	std::deque<OperationSpan> spans;
+	OperationSpan open;
+	const void* openJob = nullptr;
+	BlockCallCounters startCounters;
+	double batchStart = 0;
+
+	double Now() const {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	static std::string FormatMicroseconds(double microseconds) {
+		char text[32];
+		snprintf(text, sizeof(text), "%.3f", microseconds);
+		return text;
+	}
+
+	// Job names are plain ASCII; anything else is replaced rather than encoded.
+	static std::string ToJsonString(const wString& text) {
+		std::string out = "\"";
+		for (wchar_t c : text) {
+			if (c == L'"' || c == L'\\') {
+				out += '\\';
+				out += char(c);
+			}
+			else if (c < 0x20 || c > 0x7E) {
+				out += '?';
+			}
+			else {
+				out += char(c);
+			}
+		}
+		return out + "\"";
+	}
+};
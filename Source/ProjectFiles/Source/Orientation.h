@@ -0,0 +1,122 @@
+#pragma once
+#include "GameAPI.h"
+
+#include <array>
+
+/************************************************************
+	The 48 axis-aligned symmetries of a box: every rotation in steps of 90 degrees, with or without a mirror.
+	An orientation says which clipboard axis runs along each world axis, and whether it runs backwards.
+	Rotating or mirroring the clipboard only composes orientations; the blocks are moved once, by the paste.
+*************************************************************/
+
+struct Orientation {
+	// The permutation in the high bits, one flip bit per world axis in the low three. Zero is the identity.
+	uint8_t id = 0;
+
+	static constexpr uint8_t Count = 48;
+
+	constexpr Orientation() = default;
+	constexpr explicit Orientation(uint8_t orientationId) : id(orientationId) {}
+
+	// The clipboard axis (0 = X, 1 = Y, 2 = Z) that runs along world axis.
+	constexpr int GetSourceAxis(int axis) const {
+		return Permutations[id >> 3][axis];
+	}
+
+	// True when the clipboard axis runs along world axis in the negative direction.
+	constexpr bool IsFlipped(int axis) const {
+		return (id >> axis) & 1;
+	}
+
+	constexpr bool IsIdentity() const {
+		return id == 0;
+	}
+
+	constexpr bool operator==(const Orientation& other) const {
+		return id == other.id;
+	}
+
+	// This orientation followed by next.
+	constexpr Orientation Then(Orientation next) const {
+		std::array<int, 3> axes = {};
+		uint8_t flips = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			int between = next.GetSourceAxis(axis);
+			axes[axis] = GetSourceAxis(between);
+			flips |= uint8_t((next.IsFlipped(axis) != IsFlipped(between)) << axis);
+		}
+		return FromAxes(axes, flips);
+	}
+
+	// The size of a box with the given clipboard size once it is oriented.
+	std::array<int64_t, 3> GetSize(int64_t sizeX, int64_t sizeY, int64_t sizeZ) const {
+		const int64_t size[3] = { sizeX, sizeY, sizeZ };
+		return { size[GetSourceAxis(0)], size[GetSourceAxis(1)], size[GetSourceAxis(2)] };
+	}
+
+	// Where a torch facing rotation in the clipboard faces once it is pasted.
+	ERotation Apply(ERotation rotation) const {
+		return RotationTable[id][size_t(rotation)];
+	}
+
+	// A quarter turn around axis. Positive turns take the next axis onto the one after it (X to Y, Y to Z, Z to X).
+	static constexpr Orientation QuarterTurn(int axis, bool positive) {
+		int a = (axis + 1) % 3;
+		int b = (axis + 2) % 3;
+		std::array<int, 3> axes = {};
+		axes[axis] = axis;
+		axes[a] = b;
+		axes[b] = a;
+		return FromAxes(axes, uint8_t(1 << (positive ? a : b)));
+	}
+
+	static constexpr Orientation Mirror(int axis) {
+		return Orientation(uint8_t(1 << axis));
+	}
+
+private:
+	static constexpr int Permutations[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+
+	static constexpr Orientation FromAxes(const std::array<int, 3>& axes, uint8_t flips) {
+		for (uint8_t permutation = 0; permutation < 6; permutation++) {
+			if (Permutations[permutation][0] == axes[0] && Permutations[permutation][1] == axes[1]) {
+				return Orientation(uint8_t((permutation << 3) | flips));
+			}
+		}
+		return Orientation();
+	}
+
+	// ERotation as a direction. The game uses Unreal's axes: Forward is +X, Right is +Y, Up is +Z.
+	static constexpr int RotationAxis[6] = { 1, 1, 0, 0, 2, 2 };
+	static constexpr bool RotationNegative[6] = { false, true, false, true, false, true };
+
+	static constexpr ERotation GetRotation(int axis, bool negative) {
+		for (int rotation = 0; rotation < 6; rotation++) {
+			if (RotationAxis[rotation] == axis && RotationNegative[rotation] == negative) return ERotation(rotation);
+		}
+		return ERotation::None;
+	}
+
+	using RotationRow = std::array<ERotation, size_t(ERotation::None) + 1>;
+
+	static constexpr std::array<RotationRow, Count> BuildRotationTable() {
+		std::array<RotationRow, Count> table = {};
+		for (uint8_t id = 0; id < Count; id++) {
+			Orientation orientation(id);
+			for (int rotation = 0; rotation < 6; rotation++) {
+				for (int axis = 0; axis < 3; axis++) {
+					if (orientation.GetSourceAxis(axis) == RotationAxis[rotation]) {
+						table[id][rotation] = GetRotation(axis, RotationNegative[rotation] != orientation.IsFlipped(axis));
+					}
+				}
+			}
+			table[id][size_t(ERotation::None)] = ERotation::None;
+		}
+		return table;
+	}
+
+	static const std::array<RotationRow, Count> RotationTable;
+};
+
+// Defined once the class is complete, since building it calls the class's own constexpr functions.
+inline constexpr std::array<Orientation::RotationRow, Orientation::Count> Orientation::RotationTable = Orientation::BuildRotationTable();
@@ -0,0 +1,280 @@
+#pragma once
+#include "GameAPI.h"
+#include "VoxelSet.h"
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <vector>
+
+/************************************************************
+	Region operations walk their box one chunk column at a time. The box is cut on the game's 32x32 chunk
+	grid into tiles, and each tile is walked z-outer, y, x-inner to its end before the next one starts, so a
+	batch of reads and writes stays inside one or two chunks instead of striping across every chunk the box
+	covers. Tiles can be visited nearest to the player first, so the part being looked at updates first.
+
+	A cursor can also walk a selection instead of a box. It then goes through the chunks that hold selected
+	voxels, column by column in the same tile order, and hands out one chunk row's set bits at a time.
+*************************************************************/
+
+constexpr int64_t ChunkSizeInBlocks = 32;
+
+enum class TileOrder {
+	Grid,
+	NearestFirst
+};
+
+struct RegionTile {
+	CoordinateInBlocks minCorner;
+	CoordinateInBlocks maxCorner;
+	// Blocks the operation actually changed in this tile.
+	int64_t writes = 0;
+
+	int64_t GetVolume() const {
+		return (maxCorner.X - minCorner.X + 1) * (maxCorner.Y - minCorner.Y + 1) * (int64_t(maxCorner.Z) - minCorner.Z + 1);
+	}
+
+	// Moves at to the next voxel of the tile in x-inner, y, z order. Returns false once it passes the last one.
+	bool Step(CoordinateInBlocks& at) const {
+		if (++at.X <= maxCorner.X) return true;
+		at.X = minCorner.X;
+		if (++at.Y <= maxCorner.Y) return true;
+		at.Y = minCorner.Y;
+		return ++at.Z <= maxCorner.Z;
+	}
+};
+
+// The chunk tiles of a box in grid order (x-inner, then y), and a numbering of the box's voxels that runs
+// through the tiles in that order. Undo entries use this numbering, so replaying one also goes chunk by chunk.
+struct RegionTiling {
+	CoordinateInBlocks minCorner;
+	CoordinateInBlocks maxCorner;
+	int64_t tilesX = 0;
+	int64_t tilesY = 0;
+
+	RegionTiling() = default;
+	RegionTiling(CoordinateInBlocks start, CoordinateInBlocks end) : minCorner(start), maxCorner(end) {
+		tilesX = (FloorToChunk(end.X) - FloorToChunk(start.X)) / ChunkSizeInBlocks + 1;
+		tilesY = (FloorToChunk(end.Y) - FloorToChunk(start.Y)) / ChunkSizeInBlocks + 1;
+
+		tileOffsets.assign(GetTileCount() + 1, 0);
+		for (size_t tile = 0; tile < GetTileCount(); tile++) {
+			tileOffsets[tile + 1] = tileOffsets[tile] + GetTile(tile).GetVolume();
+		}
+	}
+
+	size_t GetTileCount() const {
+		return size_t(tilesX * tilesY);
+	}
+
+	int64_t GetVolume() const {
+		return tileOffsets.empty() ? 0 : tileOffsets.back();
+	}
+
+	RegionTile GetTile(size_t tile) const {
+		int64_t x = FloorToChunk(minCorner.X) + int64_t(tile % size_t(tilesX)) * ChunkSizeInBlocks;
+		int64_t y = FloorToChunk(minCorner.Y) + int64_t(tile / size_t(tilesX)) * ChunkSizeInBlocks;
+
+		RegionTile result;
+		result.minCorner = CoordinateInBlocks(std::max(x, minCorner.X), std::max(y, minCorner.Y), minCorner.Z);
+		result.maxCorner = CoordinateInBlocks(std::min(x + ChunkSizeInBlocks - 1, maxCorner.X), std::min(y + ChunkSizeInBlocks - 1, maxCorner.Y), maxCorner.Z);
+		return result;
+	}
+
+	size_t GetTileOf(const CoordinateInBlocks& at) const {
+		int64_t column = (FloorToChunk(at.X) - FloorToChunk(minCorner.X)) / ChunkSizeInBlocks;
+		int64_t row = (FloorToChunk(at.Y) - FloorToChunk(minCorner.Y)) / ChunkSizeInBlocks;
+		return size_t(column + row * tilesX);
+	}
+
+	int64_t GetIndex(const CoordinateInBlocks& at) const {
+		size_t tile = GetTileOf(at);
+		int64_t tileMinX = std::max(FloorToChunk(at.X), minCorner.X);
+		int64_t tileMinY = std::max(FloorToChunk(at.Y), minCorner.Y);
+		int64_t width = std::min(FloorToChunk(at.X) + ChunkSizeInBlocks - 1, maxCorner.X) - tileMinX + 1;
+		int64_t depth = std::min(FloorToChunk(at.Y) + ChunkSizeInBlocks - 1, maxCorner.Y) - tileMinY + 1;
+		return tileOffsets[tile] + (at.X - tileMinX) + width * ((at.Y - tileMinY) + depth * (int64_t(at.Z) - minCorner.Z));
+	}
+
+	// The inverse of GetIndex. Also returns the tile the voxel is in.
+	CoordinateInBlocks GetCoordinate(int64_t index, size_t& tile) const {
+		tile = size_t(std::upper_bound(tileOffsets.begin(), tileOffsets.end(), index) - tileOffsets.begin()) - 1;
+		RegionTile box = GetTile(tile);
+		int64_t width = box.maxCorner.X - box.minCorner.X + 1;
+		int64_t depth = box.maxCorner.Y - box.minCorner.Y + 1;
+		int64_t local = index - tileOffsets[tile];
+		return box.minCorner + CoordinateInBlocks(local % width, (local / width) % depth, int16_t(local / (width * depth)));
+	}
+
+	// Chunk sizes are a power of two, so masking the low bits rounds negative coordinates down as well.
+	static int64_t FloorToChunk(int64_t value) {
+		return value & ~(ChunkSizeInBlocks - 1);
+	}
+
+private:
+	std::vector<int64_t> tileOffsets;
+};
+
+// Walks an inclusive box, or the voxels of a selection, tile by tile and can be resumed at any point.
+struct TiledRegionCursor {
+	CoordinateInBlocks startCorner;
+	CoordinateInBlocks endCorner;
+	int64_t visited = 0;
+	int64_t total = 0;
+	std::vector<RegionTile> tiles;
+	// Set when the cursor walks a selection; startCorner and endCorner are then its bounds.
+	std::shared_ptr<const VoxelSet> selection;
+
+	TiledRegionCursor() = default;
+	TiledRegionCursor(CoordinateInBlocks start, CoordinateInBlocks end, TileOrder order = TileOrder::Grid, CoordinateInBlocks player = CoordinateInBlocks(0, 0, 0))
+		: startCorner(start), endCorner(end) {
+		RegionTiling tiling(start, end);
+		total = tiling.GetVolume();
+		for (size_t tile = 0; tile < tiling.GetTileCount(); tile++) {
+			tiles.push_back(tiling.GetTile(tile));
+		}
+
+		if (order == TileOrder::NearestFirst) {
+			SortNearestFirst(tiles, player);
+		}
+
+		if (!tiles.empty()) {
+			current = tiles[0].minCorner;
+		}
+	}
+
+	// Walks only the voxels of set, which mustn't be empty. total is its size, and a tile is a chunk column holding some of it.
+	TiledRegionCursor(std::shared_ptr<const VoxelSet> set, TileOrder order = TileOrder::Grid, CoordinateInBlocks player = CoordinateInBlocks(0, 0, 0))
+		: startCorner(set->GetMinCorner()), endCorner(set->GetMaxCorner()), selection(set) {
+		total = int64_t(set->size());
+
+		// The corners come column by column, so each new column starts a tile.
+		std::vector<CoordinateInBlocks> corners = set->GetChunkCorners();
+		for (const CoordinateInBlocks& corner : corners) {
+			if (!tiles.empty() && RegionTiling::FloorToChunk(tiles.back().minCorner.X) == corner.X && RegionTiling::FloorToChunk(tiles.back().minCorner.Y) == corner.Y) continue;
+
+			RegionTile tile;
+			tile.minCorner = CoordinateInBlocks(std::max(corner.X, startCorner.X), std::max(corner.Y, startCorner.Y), startCorner.Z);
+			tile.maxCorner = CoordinateInBlocks(std::min(corner.X + ChunkSizeInBlocks - 1, endCorner.X), std::min(corner.Y + ChunkSizeInBlocks - 1, endCorner.Y), endCorner.Z);
+			tiles.push_back(tile);
+		}
+		if (order == TileOrder::NearestFirst) {
+			SortNearestFirst(tiles, player);
+		}
+
+		// Each tile's chunks, bottom up, which keeps the walk in the order undo entries store voxels in.
+		auto columnOrder = [](const CoordinateInBlocks& a, const CoordinateInBlocks& b) {
+			if (a.Y != b.Y) return a.Y < b.Y;
+			return a.X < b.X;
+		};
+		for (size_t tile = 0; tile < tiles.size(); tile++) {
+			CoordinateInBlocks column = CoordinateInBlocks(RegionTiling::FloorToChunk(tiles[tile].minCorner.X), RegionTiling::FloorToChunk(tiles[tile].minCorner.Y), 0);
+			auto range = std::equal_range(corners.begin(), corners.end(), column, columnOrder);
+			for (auto corner = range.first; corner != range.second; ++corner) {
+				selectedChunks.push_back(*corner);
+				selectedChunkTiles.push_back(tile);
+			}
+		}
+	}
+
+	bool IsDone() const {
+		return visited >= total;
+	}
+
+	CoordinateInBlocks Next() {
+		CoordinateInBlocks runStart;
+		NextRun(1, runStart);
+		return runStart;
+	}
+
+	// Takes up to maxCount voxels along the current x row of the current tile at once. Returns how many were taken.
+	int64_t NextRun(int64_t maxCount, CoordinateInBlocks& runStart) {
+		const RegionTile& tile = tiles[tileIndex];
+		int64_t count = std::min({ maxCount, tile.maxCorner.X - current.X + 1, total - visited });
+		runStart = current;
+		runTile = tileIndex;
+		visited += count;
+		current.X += count;
+		if (current.X > tile.maxCorner.X) {
+			current.X = tile.minCorner.X;
+			if (++current.Y > tile.maxCorner.Y) {
+				current.Y = tile.minCorner.Y;
+				if (++current.Z > tile.maxCorner.Z && ++tileIndex < tiles.size()) {
+					current = tiles[tileIndex].minCorner;
+				}
+			}
+		}
+		return count;
+	}
+
+	// Takes the next row of a selected chunk that has selected voxels in it. Bit i of the result stands for rowStart + (i, 0, 0).
+	// Rows and pairs of rows with nothing selected are skipped, so visited only ever counts selected voxels.
+	uint32_t NextSelectedRow(CoordinateInBlocks& rowStart) {
+		constexpr size_t ChunkRows = size_t(ChunkSizeInBlocks * ChunkSizeInBlocks);
+		while (chunkIndex < selectedChunks.size()) {
+			const CoordinateInBlocks& corner = selectedChunks[chunkIndex];
+			const uint64_t* words = selection->GetChunkWords(corner);
+			while (words != nullptr && rowIndex < ChunkRows) {
+				uint64_t word = words[rowIndex >> 1];
+				if (word == 0) {
+					rowIndex = (rowIndex | 1) + 1;
+					continue;
+				}
+				size_t row = rowIndex++;
+				uint32_t bits = uint32_t(word >> (32 * (row & 1)));
+				if (bits == 0) continue;
+
+				rowStart = corner + CoordinateInBlocks(0, int64_t(row % ChunkSizeInBlocks), int16_t(row / ChunkSizeInBlocks));
+				runTile = selectedChunkTiles[chunkIndex];
+				visited += std::popcount(bits);
+				return bits;
+			}
+			chunkIndex++;
+			rowIndex = 0;
+		}
+		visited = total;
+		return 0;
+	}
+
+	// Counts a write against the tile of the last run taken.
+	void CountWrite() {
+		tiles[runTile].writes++;
+	}
+
+	size_t GetWrittenTileCount() const {
+		return size_t(std::count_if(tiles.begin(), tiles.end(), [](const RegionTile& tile) { return tile.writes > 0; }));
+	}
+
+	int64_t GetMaxTileWrites() const {
+		int64_t most = 0;
+		for (const RegionTile& tile : tiles) {
+			most = std::max(most, tile.writes);
+		}
+		return most;
+	}
+
+	wString GetWriteSummary() const {
+		return std::to_wstring(GetWrittenTileCount()) + L" of " + std::to_wstring(tiles.size()) + L" chunks written, "
+			+ std::to_wstring(GetMaxTileWrites()) + L" blocks in the busiest";
+	}
+
+private:
+	CoordinateInBlocks current = CoordinateInBlocks(0, 0, 0);
+	size_t tileIndex = 0;
+	size_t runTile = 0;
+	// The selected chunks in walk order, the tile each is in, and the next row to look at in the current one.
+	std::vector<CoordinateInBlocks> selectedChunks;
+	std::vector<size_t> selectedChunkTiles;
+	size_t chunkIndex = 0;
+	size_t rowIndex = 0;
+
+	// Horizontal distance from the player to the closest point of each tile; ties keep grid order.
+	static void SortNearestFirst(std::vector<RegionTile>& tiles, CoordinateInBlocks player) {
+		auto distance = [&player](const RegionTile& tile) {
+			int64_t dx = std::max({ tile.minCorner.X - player.X, int64_t(0), player.X - tile.maxCorner.X });
+			int64_t dy = std::max({ tile.minCorner.Y - player.Y, int64_t(0), player.Y - tile.maxCorner.Y });
+			return dx * dx + dy * dy;
+		};
+		std::stable_sort(tiles.begin(), tiles.end(), [&distance](const RegionTile& a, const RegionTile& b) { return distance(a) < distance(b); });
+	}
+};
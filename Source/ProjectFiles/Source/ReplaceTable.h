@@ -0,0 +1,127 @@
+#pragma once
+#include "GameAPI.h"
+
+/************************************************************
+	A set of replace rules compiled once per operation from source and destination pairs.
+	Native sources are looked up in a table indexed by EBlockType and custom sources in a flat hash map of
+	their CustomBlockIDs, so replacing a voxel costs the same no matter how many rules the table holds.
+*************************************************************/
+
+// Open-addressing map from non-zero CustomBlockIDs to the block that replaces them. Zero marks an empty slot.
+struct CustomBlockIDMap {
+	struct Slot {
+		UniqueID id = 0;
+		BlockInfo value;
+	};
+	std::vector<Slot> slots;
+	size_t count = 0;
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	// Later rules for the same block replace earlier ones.
+	void Set(UniqueID id, const BlockInfo& value) {
+		if (id == 0) return;
+		if ((count + 1) * 2 > slots.size()) {
+			Grow();
+		}
+		Slot& slot = FindSlot(id);
+		if (slot.id == 0) count++;
+		slot.id = id;
+		slot.value = value;
+	}
+
+	const BlockInfo* Find(UniqueID id) const {
+		if (slots.empty()) return nullptr;
+
+		size_t mask = slots.size() - 1;
+		for (size_t slot = Hash(id) & mask; ; slot = (slot + 1) & mask) {
+			if (slots[slot].id == id) return &slots[slot].value;
+			if (slots[slot].id == 0) return nullptr;
+		}
+	}
+
+private:
+	static size_t Hash(UniqueID id) {
+		return size_t(id * 0x9E3779B1u);
+	}
+
+	Slot& FindSlot(UniqueID id) {
+		size_t mask = slots.size() - 1;
+		size_t slot = Hash(id) & mask;
+		while (slots[slot].id != 0 && slots[slot].id != id) {
+			slot = (slot + 1) & mask;
+		}
+		return slots[slot];
+	}
+
+	void Grow() {
+		std::vector<Slot> old;
+		old.swap(slots);
+		slots.assign(old.empty() ? 8 : old.size() * 2, Slot());
+		for (const Slot& entry : old) {
+			if (entry.id != 0) FindSlot(entry.id) = entry;
+		}
+	}
+};
+
+struct ReplaceTable {
+	// Bit i is set when native block type i has a rule. Rotation is ignored when matching, like a mask does.
+	uint64_t nativeMapped[4] = { 0, 0, 0, 0 };
+	BlockInfo nativeTargets[256];
+	CustomBlockIDMap customTargets;
+	size_t ruleCount = 0;
+
+	bool empty() const {
+		return ruleCount == 0;
+	}
+
+	void Add(const BlockInfo& source, const BlockInfo& destination) {
+		if (source.CustomBlockID != 0) {
+			customTargets.Set(source.CustomBlockID, destination);
+		}
+		else {
+			uint8_t index = uint8_t(source.Type);
+			nativeMapped[index >> 6] |= uint64_t(1) << (index & 63);
+			nativeTargets[index] = destination;
+		}
+		ruleCount++;
+	}
+
+	// Returns the replacement for a block, or nullptr when no rule matches it.
+	const BlockInfo* Find(const BlockInfo& info) const {
+		if (info.CustomBlockID != 0) return customTargets.Find(info.CustomBlockID);
+
+		uint8_t index = uint8_t(info.Type);
+		return ((nativeMapped[index >> 6] >> (index & 63)) & 1) ? &nativeTargets[index] : nullptr;
+	}
+
+	// Looks up up to 64 blocks at once. Bit i of the result is set when blocks[i] has a rule, and out[i] is then its replacement.
+	uint64_t ReplaceRow(const BlockInfo* blocks, size_t count, BlockInfo* out) const {
+		return customTargets.empty() ? ReplaceRow<true>(blocks, count, out) : ReplaceRow<false>(blocks, count, out);
+	}
+
+	// ReplaceRow for callers that pick the kind of table once, outside their loop. NativeOnly must match customTargets.empty().
+	template<bool NativeOnly> uint64_t ReplaceRow(const BlockInfo* blocks, size_t count, BlockInfo* out) const {
+		uint64_t result = 0;
+		if constexpr (NativeOnly) {
+			// Native-only tables are a table lookup per block with no branches. A custom block never has a rule here.
+			for (size_t i = 0; i < count; i++) {
+				uint8_t index = uint8_t(blocks[i].Type);
+				uint64_t mapped = (nativeMapped[index >> 6] >> (index & 63)) & uint64_t(blocks[i].CustomBlockID == 0);
+				out[i] = nativeTargets[index];
+				result |= mapped << i;
+			}
+		}
+		else {
+			for (size_t i = 0; i < count; i++) {
+				const BlockInfo* target = Find(blocks[i]);
+				if (target == nullptr) continue;
+				out[i] = *target;
+				result |= uint64_t(1) << i;
+			}
+		}
+		return result;
+	}
+};
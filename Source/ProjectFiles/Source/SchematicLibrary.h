@@ -0,0 +1,271 @@
+#pragma once
+#include "GameAPI.h"
+#include "BlockPalette.h"
+#include "ByteStream.h"
+#include "Clipboard.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+/************************************************************
+	Named clipboards shared between worlds, kept in two files that are only ever appended to.
+	Schematics.dat holds each schematic's palette followed by its packed indices, exactly as the clipboard
+	stores them. Schematics.idx holds one small record per schematic: name, size, block histogram and where
+	its data starts. Listing and searching only read the index; pasting maps the data file and reads the
+	indices straight from the mapping.
+*************************************************************/
+
+struct SchematicInfo {
+	wString name;
+	int64_t sizeX = 0;
+	int64_t sizeY = 0;
+	int64_t sizeZ = 0;
+	uint64_t offset = 0;
+	uint64_t length = 0;
+	Orientation orientation;
+	// Block counts, most common first.
+	std::vector<std::pair<BlockInfo, int64_t>> histogram;
+
+	std::array<int64_t, 3> GetOrientedSize() const {
+		return orientation.GetSize(sizeX, sizeY, sizeZ);
+	}
+
+	bool Contains(const BlockInfo& info) const {
+		return std::any_of(histogram.begin(), histogram.end(), [&info](const std::pair<BlockInfo, int64_t>& entry) { return SameBlock(entry.first, info); });
+	}
+};
+
+// A schematic inside a mapping of the data file. The view points into the mapping, so it is valid as long as this is.
+struct MappedSchematic {
+	MappedFile file;
+	std::vector<BlockInfo> palette;
+	ClipboardView view;
+};
+
+class SchematicLibrary {
+public:
+	// The index keeps at most this many of a schematic's most common blocks.
+	static constexpr size_t MaxHistogramEntries = 64;
+
+	bool IsOpen() const {
+		return open;
+	}
+
+	// Reads the index in folder. Records that point past the end of the data file are from an interrupted save and are dropped.
+	void Open(const std::filesystem::path& folder) {
+		dataPath = folder / L"Schematics.dat";
+		indexPath = folder / L"Schematics.idx";
+		entries.clear();
+		open = true;
+
+		std::error_code error;
+		uint64_t dataSize = std::filesystem::exists(dataPath, error) ? std::filesystem::file_size(dataPath, error) : 0;
+
+		std::vector<uint8_t> index = ReadFile(indexPath);
+		ByteReader reader(index.data(), index.size());
+		if (!ReadHeader(reader, IndexMagic)) return;
+
+		while (!reader.AtEnd()) {
+			uint64_t recordSize = reader.ReadVarint();
+			const uint8_t* record = reader.Skip(size_t(std::min<uint64_t>(recordSize, reader.GetRemaining() + 1)));
+			if (record == nullptr) break;
+
+			ByteReader recordReader(record, size_t(recordSize));
+			SchematicInfo info = ReadInfo(recordReader);
+			if (!recordReader.failed && info.offset + info.length <= dataSize) {
+				entries.push_back(std::move(info));
+			}
+		}
+	}
+
+	const std::vector<SchematicInfo>& GetEntries() const {
+		return entries;
+	}
+
+	std::vector<size_t> FindContaining(const BlockInfo& info) const {
+		std::vector<size_t> found;
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (entries[i].Contains(info)) found.push_back(i);
+		}
+		return found;
+	}
+
+	std::vector<size_t> FindByName(const wString& part) const {
+		std::vector<size_t> found;
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (entries[i].name.find(part) != wString::npos) found.push_back(i);
+		}
+		return found;
+	}
+
+	// Appends the clipboard to the data file, then its record to the index.
+	bool Add(const wString& name, const Clipboard& source) {
+		if (!open || source.empty()) return false;
+
+		std::error_code error;
+		std::filesystem::create_directories(dataPath.parent_path(), error);
+		uint64_t dataFileSize = std::filesystem::exists(dataPath, error) ? std::filesystem::file_size(dataPath, error) : 0;
+		bool newIndexFile = !std::filesystem::exists(indexPath, error) || std::filesystem::file_size(indexPath, error) == 0;
+
+		ByteWriter data;
+		if (dataFileSize == 0) {
+			WriteHeader(data, DataMagic);
+		}
+		size_t headerSize = data.size();
+		data.WriteVarint(source.palette.size());
+		for (const BlockInfo& info : source.palette.entries) {
+			data.WriteBlockInfo(info);
+		}
+		data.WriteU8(source.bitsPerBlock);
+		data.WriteRaw(source.indices.data(), source.indices.size());
+
+		SchematicInfo info;
+		info.name = name;
+		info.sizeX = source.sizeX;
+		info.sizeY = source.sizeY;
+		info.sizeZ = source.sizeZ;
+		info.offset = dataFileSize + headerSize;
+		info.length = data.size() - headerSize;
+		info.orientation = source.orientation;
+		info.histogram = GetHistogram(source);
+
+		ByteWriter record;
+		WriteInfo(record, info);
+		ByteWriter index;
+		if (newIndexFile) {
+			WriteHeader(index, IndexMagic);
+		}
+		index.WriteVarint(record.size());
+		index.WriteRaw(record.bytes.data(), record.size());
+
+		// The data goes first, so an index record never points at data that isn't there.
+		if (!AppendFile(dataPath, data) || !AppendFile(indexPath, index)) return false;
+		entries.push_back(std::move(info));
+		return true;
+	}
+
+	// Maps the data file and points a view at the schematic's palette and indices. Returns nullptr if the data is unusable.
+	// The indices aren't checked against the palette here, which would read every page; the paste skips bad ones.
+	std::shared_ptr<MappedSchematic> Map(size_t entry) const {
+		if (entry >= entries.size()) return nullptr;
+		const SchematicInfo& info = entries[entry];
+
+		std::shared_ptr<MappedSchematic> schematic = std::make_shared<MappedSchematic>();
+		if (!schematic->file.Open(dataPath) || info.offset + info.length > schematic->file.size()) return nullptr;
+
+		ByteReader reader(schematic->file.data() + info.offset, size_t(info.length));
+		uint64_t paletteSize = reader.ReadVarint();
+		for (uint64_t i = 0; i < paletteSize && !reader.failed; i++) {
+			schematic->palette.push_back(reader.ReadBlockInfo());
+		}
+		uint8_t bits = reader.ReadU8();
+		if (reader.failed || (bits != 4 && bits != 8 && bits != 16) || paletteSize > (uint64_t(1) << bits)) return nullptr;
+
+		const uint8_t* indices = reader.Skip(Clipboard::GetPackedSize(info.sizeX * info.sizeY * info.sizeZ, bits));
+		if (indices == nullptr) return nullptr;
+
+		schematic->view = ClipboardView(info.sizeX, info.sizeY, info.sizeZ, schematic->palette.data(), schematic->palette.size(), bits, indices, info.orientation);
+		return schematic;
+	}
+
+private:
+	static constexpr uint32_t DataMagic = 0x44504243; // "CBPD"
+	static constexpr uint32_t IndexMagic = 0x49504243; // "CBPI"
+	static constexpr uint32_t FormatVersion = 1;
+
+	std::filesystem::path dataPath;
+	std::filesystem::path indexPath;
+	std::vector<SchematicInfo> entries;
+	bool open = false;
+
+	static void WriteHeader(ByteWriter& writer, uint32_t magic) {
+		writer.WriteU32(magic);
+		writer.WriteVarint(FormatVersion);
+	}
+
+	static bool ReadHeader(ByteReader& reader, uint32_t magic) {
+		uint32_t readMagic = reader.ReadU32();
+		uint64_t version = reader.ReadVarint();
+		return !reader.failed && readMagic == magic && version == FormatVersion;
+	}
+
+	static void WriteInfo(ByteWriter& writer, const SchematicInfo& info) {
+		// Names are written a character per varint, which is the same on every platform whatever the size of wchar_t.
+		writer.WriteVarint(info.name.size());
+		for (wchar_t character : info.name) {
+			writer.WriteVarint(uint64_t(character));
+		}
+		writer.WriteVarint(uint64_t(info.sizeX));
+		writer.WriteVarint(uint64_t(info.sizeY));
+		writer.WriteVarint(uint64_t(info.sizeZ));
+		writer.WriteVarint(info.offset);
+		writer.WriteVarint(info.length);
+		writer.WriteVarint(info.histogram.size());
+		for (const auto& entry : info.histogram) {
+			writer.WriteBlockInfo(entry.first);
+			writer.WriteVarint(uint64_t(entry.second));
+		}
+		writer.WriteU8(info.orientation.id);
+	}
+
+	static SchematicInfo ReadInfo(ByteReader& reader) {
+		SchematicInfo info;
+		uint64_t nameLength = reader.ReadVarint();
+		for (uint64_t i = 0; i < nameLength && !reader.failed; i++) {
+			info.name.push_back(wchar_t(reader.ReadVarint()));
+		}
+		info.sizeX = int64_t(reader.ReadVarint());
+		info.sizeY = int64_t(reader.ReadVarint());
+		info.sizeZ = int64_t(reader.ReadVarint());
+		info.offset = reader.ReadVarint();
+		info.length = reader.ReadVarint();
+		uint64_t histogramSize = reader.ReadVarint();
+		for (uint64_t i = 0; i < histogramSize && !reader.failed; i++) {
+			BlockInfo block = reader.ReadBlockInfo();
+			info.histogram.emplace_back(block, int64_t(reader.ReadVarint()));
+		}
+		// Records are length prefixed, so fields added later are read only when the record has them.
+		if (!reader.AtEnd()) {
+			uint8_t orientationId = reader.ReadU8();
+			if (orientationId >= Orientation::Count) reader.failed = true;
+			info.orientation = Orientation(orientationId % Orientation::Count);
+		}
+		return info;
+	}
+
+	static std::vector<std::pair<BlockInfo, int64_t>> GetHistogram(const Clipboard& source) {
+		std::vector<int64_t> counts(source.palette.size(), 0);
+		for (int64_t i = 0; i < source.GetVolume(); i++) {
+			counts[source.GetPaletteIndex(i)]++;
+		}
+
+		std::vector<std::pair<BlockInfo, int64_t>> histogram;
+		for (size_t i = 0; i < counts.size(); i++) {
+			if (counts[i] > 0) histogram.emplace_back(source.palette[i], counts[i]);
+		}
+		std::stable_sort(histogram.begin(), histogram.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+		if (histogram.size() > MaxHistogramEntries) {
+			histogram.resize(MaxHistogramEntries);
+		}
+		return histogram;
+	}
+
+	static std::vector<uint8_t> ReadFile(const std::filesystem::path& path) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) return {};
+		std::vector<uint8_t> bytes(size_t(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(bytes.data()), std::streamsize(bytes.size()));
+		return file ? bytes : std::vector<uint8_t>();
+	}
+
+	static bool AppendFile(const std::filesystem::path& path, const ByteWriter& writer) {
+		std::ofstream file(path, std::ios::binary | std::ios::app);
+		file.write(reinterpret_cast<const char*>(writer.bytes.data()), std::streamsize(writer.size()));
+		file.flush();
+		return bool(file);
+	}
+};
@@ -0,0 +1,215 @@
+#pragma once
+#include "GameAPI.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <memory>
+
+/************************************************************
+	Shapes inscribed in a box, stored as x spans per (y, z) row of the box. A row is solved once with
+	integer arithmetic, so filling a shape costs one small calculation per row instead of a distance per voxel.
+	All math is done in doubled coordinates, which puts the centre of an even-sized box on a whole number.
+*************************************************************/
+
+enum class ShapeKind : uint8_t {
+	Box,
+	Ellipsoid,
+	Cylinder,
+	Cone
+};
+
+// Up to two x spans of one row, as offsets from the box's min corner. A hollow shape can cut a row in two.
+struct ShapeRow {
+	int32_t start[2] = { 0, 0 };
+	int32_t end[2] = { -1, -1 };
+	uint8_t count = 0;
+};
+
+class ShapeSpanTable {
+public:
+	// Keeps every product of the row solve inside 63 bits.
+	static constexpr int64_t MaxSize = 1024;
+
+	ShapeKind kind = ShapeKind::Box;
+	int64_t sizeX = 0;
+	int64_t sizeY = 0;
+	int64_t sizeZ = 0;
+	bool hollow = false;
+	int64_t volume = 0;
+
+	ShapeSpanTable(ShapeKind shapeKind, int64_t x, int64_t y, int64_t z, bool isHollow) : kind(shapeKind), sizeX(x), sizeY(y), sizeZ(z), hollow(isHollow) {
+		std::vector<ShapeRow> solid(size_t(sizeY * sizeZ));
+		for (int64_t z = 0; z < sizeZ; z++) {
+			for (int64_t y = 0; y < sizeY; y++) {
+				ShapeRow& row = solid[size_t(y + sizeY * z)];
+				if (SolveRow(y, z, row.start[0], row.end[0])) row.count = 1;
+			}
+		}
+		rows = hollow ? Hollow(solid) : std::move(solid);
+
+		for (const ShapeRow& row : rows) {
+			for (uint8_t i = 0; i < row.count; i++) {
+				volume += row.end[i] - row.start[i] + 1;
+			}
+		}
+	}
+
+	const ShapeRow& GetRow(int64_t y, int64_t z) const {
+		return rows[size_t(y + sizeY * z)];
+	}
+
+	size_t GetMemoryBytes() const {
+		return sizeof(ShapeSpanTable) + rows.capacity() * sizeof(ShapeRow);
+	}
+
+	// Floor of the square root, exact for every value the row solve produces.
+	static uint64_t IntegerSqrt(uint64_t value) {
+		uint64_t root = uint64_t(std::sqrt(double(value)));
+		while (root * root > value) root--;
+		while ((root + 1) * (root + 1) <= value) root++;
+		return root;
+	}
+
+private:
+	std::vector<ShapeRow> rows;
+
+	// Finds the x span of row (y, z) in the solid shape. Returns false when the row misses the shape.
+	bool SolveRow(int64_t y, int64_t z, int32_t& start, int32_t& end) const {
+		if (kind == ShapeKind::Box) {
+			start = 0;
+			end = int32_t(sizeX - 1);
+			return true;
+		}
+
+		// Doubled offsets from the centre, and the doubled radii, which are the box sizes.
+		int64_t dy = 2 * y - (sizeY - 1);
+		int64_t dz = 2 * z - (sizeZ - 1);
+		uint64_t rx2 = uint64_t(sizeX * sizeX);
+		uint64_t ry2 = uint64_t(sizeY * sizeY);
+		uint64_t rz2 = uint64_t(sizeZ * sizeZ);
+
+		// The row is inside where dx^2 * denominator <= numerator.
+		uint64_t numerator = 0;
+		uint64_t denominator = 0;
+		if (kind == ShapeKind::Ellipsoid) {
+			// dx^2/rx^2 + dy^2/ry^2 + dz^2/rz^2 <= 1
+			uint64_t across = ry2 * rz2;
+			uint64_t used = uint64_t(dy * dy) * rz2 + uint64_t(dz * dz) * ry2;
+			if (used > across) return false;
+			numerator = rx2 * (across - used);
+			denominator = across;
+		}
+		else {
+			// A cylinder's cross section is the same ellipse on every layer. A cone's shrinks from the full
+			// ellipse at the bottom layer to a point above the top one: scale p/q with p = 2 * (layers above) + 1.
+			uint64_t p = (kind == ShapeKind::Cone) ? uint64_t(2 * (sizeZ - 1 - z) + 1) : 1;
+			uint64_t q = (kind == ShapeKind::Cone) ? uint64_t(2 * sizeZ - 1) : 1;
+			uint64_t across = p * p * ry2;
+			uint64_t used = uint64_t(dy * dy) * q * q;
+			if (used > across) return false;
+			numerator = rx2 * (across - used);
+			denominator = ry2 * q * q;
+		}
+
+		int64_t reach = int64_t(IntegerSqrt(numerator / denominator));
+		// Voxel x is inside when |2x - (sizeX - 1)| <= reach.
+		int64_t first = (sizeX - 1 - reach + 1) / 2;
+		int64_t last = (sizeX - 1 + reach) / 2;
+		first = std::max<int64_t>(first, 0);
+		last = std::min<int64_t>(last, sizeX - 1);
+		if (first > last) return false;
+		start = int32_t(first);
+		end = int32_t(last);
+		return true;
+	}
+
+	// Keeps the voxels of the solid shape that have a face outside it. A voxel is inside when its row
+	// neighbours and the rows next to it all cover it, which per row is one interval to cut out.
+	std::vector<ShapeRow> Hollow(const std::vector<ShapeRow>& solid) const {
+		std::vector<ShapeRow> shell(solid.size());
+		for (int64_t z = 0; z < sizeZ; z++) {
+			for (int64_t y = 0; y < sizeY; y++) {
+				const ShapeRow& row = solid[size_t(y + sizeY * z)];
+				ShapeRow& out = shell[size_t(y + sizeY * z)];
+				if (row.count == 0) continue;
+
+				int64_t innerStart = row.start[0] + 1;
+				int64_t innerEnd = row.end[0] - 1;
+				const int64_t neighbours[4][2] = { { y - 1, z }, { y + 1, z }, { y, z - 1 }, { y, z + 1 } };
+				for (const auto& neighbour : neighbours) {
+					if (neighbour[0] < 0 || neighbour[0] >= sizeY || neighbour[1] < 0 || neighbour[1] >= sizeZ) {
+						innerEnd = innerStart - 1;
+						break;
+					}
+					const ShapeRow& next = solid[size_t(neighbour[0] + sizeY * neighbour[1])];
+					if (next.count == 0) {
+						innerEnd = innerStart - 1;
+						break;
+					}
+					innerStart = std::max<int64_t>(innerStart, next.start[0]);
+					innerEnd = std::min<int64_t>(innerEnd, next.end[0]);
+				}
+
+				if (innerStart > innerEnd) {
+					out = row;
+					continue;
+				}
+				if (innerStart > row.start[0]) {
+					out.start[out.count] = row.start[0];
+					out.end[out.count++] = int32_t(innerStart - 1);
+				}
+				if (innerEnd < row.end[0]) {
+					out.start[out.count] = int32_t(innerEnd + 1);
+					out.end[out.count++] = row.end[0];
+				}
+			}
+		}
+		return shell;
+	}
+};
+
+using ShapeTask = WorkerTask<std::shared_ptr<const ShapeSpanTable>>;
+
+// Recently used span tables, so painting the same shape again, or at another place, skips solving it.
+// A new table is solved on the worker pool; the task it returns is ready once the table is.
+class ShapeSpanCache {
+public:
+	explicit ShapeSpanCache(size_t capacity) : maxEntries(capacity) {}
+
+	std::shared_ptr<ShapeTask> Get(ShapeKind kind, int64_t sizeX, int64_t sizeY, int64_t sizeZ, bool hollow, WorkerPool& pool) {
+		for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+			if (entry->kind == kind && entry->sizeX == sizeX && entry->sizeY == sizeY && entry->sizeZ == sizeZ && entry->hollow == hollow) {
+				entries.splice(entries.begin(), entries, entry);
+				return entries.front().table;
+			}
+		}
+
+		std::shared_ptr<ShapeTask> table = pool.Run<std::shared_ptr<const ShapeSpanTable>>([kind, sizeX, sizeY, sizeZ, hollow]() {
+			return std::make_shared<const ShapeSpanTable>(kind, sizeX, sizeY, sizeZ, hollow);
+		});
+		entries.push_front({ kind, sizeX, sizeY, sizeZ, hollow, std::move(table) });
+		if (entries.size() > maxEntries) {
+			entries.pop_back();
+		}
+		return entries.front().table;
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+private:
+	struct Entry {
+		ShapeKind kind;
+		int64_t sizeX;
+		int64_t sizeY;
+		int64_t sizeZ;
+		bool hollow;
+		std::shared_ptr<ShapeTask> table;
+	};
+
+	size_t maxEntries;
+	std::list<Entry> entries;
+};
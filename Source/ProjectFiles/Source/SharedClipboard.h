@@ -0,0 +1,200 @@
+#pragma once
+#include "GameAPI.h"
+#include "Clipboard.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+/************************************************************
+	The clipboard published under a shared memory key, so other mods (or another copy of this one) can paste
+	it straight from memory. A published buffer is a single allocation that never changes once it is in the
+	slot: a SharedClipboardHeader, then paletteSize SharedPaletteEntry records at paletteOffset, then the
+	packed indices at indicesOffset, laid out like the clipboard's own. Offsets count from the header, so
+	the buffer reads the same wherever it sits.
+
+	The key's slot points at the newest buffer and holds one reference to it. A publisher builds the new
+	buffer first and takes the lock only to swap the pointer; a reader takes the lock only to add a
+	reference. Whoever drops the last reference calls the buffer's own release function, so it is freed by
+	the allocator of the mod that made it.
+*************************************************************/
+
+struct SharedClipboardHeader {
+	static constexpr uint32_t Magic = 0x53504243; // "CBPS"
+	static constexpr uint32_t FormatVersion = 1;
+
+	uint32_t magic = Magic;
+	uint32_t formatVersion = FormatVersion;
+	// One more than the buffer it replaced in the slot.
+	uint64_t version = 1;
+	uint64_t byteSize = 0;
+	std::atomic<int64_t> references{ 1 };
+	void (*release)(SharedClipboardHeader* buffer) = nullptr;
+	// Tells a publisher whether the buffer in the slot is its own.
+	const void* publisher = nullptr;
+
+	// The stored size; orientation says how it is turned when pasted.
+	int64_t sizeX = 0;
+	int64_t sizeY = 0;
+	int64_t sizeZ = 0;
+	uint32_t paletteSize = 0;
+	uint8_t bitsPerBlock = 4;
+	uint8_t orientation = 0;
+	uint16_t reserved = 0;
+	uint64_t paletteOffset = 0;
+	uint64_t indicesOffset = 0;
+	uint64_t indicesBytes = 0;
+
+	const uint8_t* GetBytes() const {
+		return reinterpret_cast<const uint8_t*>(this);
+	}
+};
+
+struct SharedPaletteEntry {
+	uint8_t type;
+	uint8_t rotation;
+	uint16_t reserved;
+	uint32_t customBlockID;
+};
+
+// A reference to a published buffer. The view points into it, so it is valid as long as this is.
+struct SharedClipboard {
+	SharedClipboardHeader* buffer = nullptr;
+	std::vector<BlockInfo> palette;
+	ClipboardView view;
+
+	SharedClipboard() = default;
+	SharedClipboard(const SharedClipboard&) = delete;
+	SharedClipboard& operator=(const SharedClipboard&) = delete;
+
+	~SharedClipboard() {
+		Release(buffer);
+	}
+
+	uint64_t GetVersion() const {
+		return buffer->version;
+	}
+
+	// Copies the clipboard into a new buffer and puts it in the slot under key. Returns the version it was
+	// published as, or 0 when the slot holds something that isn't a clipboard buffer, which is left alone.
+	static uint64_t Publish(const wString& key, const Clipboard& clipboard, const void* publisher) {
+		size_t paletteOffset = AlignUp(sizeof(SharedClipboardHeader));
+		size_t indicesOffset = AlignUp(paletteOffset + clipboard.palette.size() * sizeof(SharedPaletteEntry));
+		size_t indicesBytes = Clipboard::GetPackedSize(clipboard.GetVolume(), clipboard.bitsPerBlock);
+		size_t byteSize = indicesOffset + indicesBytes;
+
+		uint8_t* bytes = static_cast<uint8_t*>(::operator new(byteSize));
+		SharedClipboardHeader* header = new (bytes) SharedClipboardHeader();
+		header->byteSize = byteSize;
+		header->release = Free;
+		header->publisher = publisher;
+		header->sizeX = clipboard.sizeX;
+		header->sizeY = clipboard.sizeY;
+		header->sizeZ = clipboard.sizeZ;
+		header->paletteSize = uint32_t(clipboard.palette.size());
+		header->bitsPerBlock = clipboard.bitsPerBlock;
+		header->orientation = clipboard.orientation.id;
+		header->paletteOffset = paletteOffset;
+		header->indicesOffset = indicesOffset;
+		header->indicesBytes = indicesBytes;
+
+		SharedPaletteEntry* entries = reinterpret_cast<SharedPaletteEntry*>(bytes + paletteOffset);
+		for (size_t i = 0; i < clipboard.palette.size(); i++) {
+			const BlockInfo& info = clipboard.palette[i];
+			entries[i] = SharedPaletteEntry{ uint8_t(info.Type), uint8_t(info.Rotation), 0, uint32_t(info.CustomBlockID) };
+		}
+		if (indicesBytes > 0) std::memcpy(bytes + indicesOffset, clipboard.indices.data(), indicesBytes);
+
+		SharedClipboardHeader* replaced = nullptr;
+		{
+			ScopedSharedMemoryHandle slot = GetSharedMemoryPointer(key, true, false);
+			replaced = static_cast<SharedClipboardHeader*>(slot.Pointer);
+			if (replaced != nullptr && !IsClipboardBuffer(replaced)) {
+				Free(header);
+				return 0;
+			}
+			if (replaced != nullptr) header->version = replaced->version + 1;
+			slot.Pointer = header;
+		}
+		uint64_t version = header->version;
+		Release(replaced);
+		return version;
+	}
+
+	// Empties the slot if it still holds a buffer of publisher's.
+	static void Withdraw(const wString& key, const void* publisher) {
+		SharedClipboardHeader* withdrawn = nullptr;
+		{
+			ScopedSharedMemoryHandle slot = GetSharedMemoryPointer(key, false, false);
+			if (!slot.Valid) return;
+			SharedClipboardHeader* current = static_cast<SharedClipboardHeader*>(slot.Pointer);
+			if (current == nullptr || !IsClipboardBuffer(current) || current->publisher != publisher) return;
+			withdrawn = current;
+			slot.Pointer = nullptr;
+		}
+		Release(withdrawn);
+	}
+
+	// The version in the slot under key, or 0 when there is none.
+	static uint64_t GetPublishedVersion(const wString& key) {
+		ScopedSharedMemoryHandle slot = GetSharedMemoryPointer(key, false, false);
+		if (!slot.Valid) return 0;
+		SharedClipboardHeader* current = static_cast<SharedClipboardHeader*>(slot.Pointer);
+		return (current != nullptr && IsClipboardBuffer(current)) ? current->version : 0;
+	}
+
+	// Takes a reference to the newest buffer under key. Returns nullptr when there is none or it is malformed.
+	static std::shared_ptr<SharedClipboard> Acquire(const wString& key) {
+		std::shared_ptr<SharedClipboard> shared = std::make_shared<SharedClipboard>();
+		{
+			ScopedSharedMemoryHandle slot = GetSharedMemoryPointer(key, false, false);
+			if (!slot.Valid) return nullptr;
+			SharedClipboardHeader* current = static_cast<SharedClipboardHeader*>(slot.Pointer);
+			if (current == nullptr || !IsClipboardBuffer(current)) return nullptr;
+			current->references.fetch_add(1, std::memory_order_relaxed);
+			shared->buffer = current;
+		}
+
+		// Another mod may have written it, so nothing in it is trusted until checked.
+		const SharedClipboardHeader& header = *shared->buffer;
+		uint8_t bits = header.bitsPerBlock;
+		if ((bits != 4 && bits != 8 && bits != 16) || header.paletteSize > (uint32_t(1) << bits) || header.orientation >= Orientation::Count
+			|| header.sizeX < 0 || header.sizeY < 0 || header.sizeZ < 0
+			|| header.paletteOffset + uint64_t(header.paletteSize) * sizeof(SharedPaletteEntry) > header.byteSize
+			|| header.indicesOffset + header.indicesBytes > header.byteSize
+			|| double(header.sizeX) * double(header.sizeY) * double(header.sizeZ) * bits > double(header.indicesBytes) * 8) {
+			return nullptr;
+		}
+
+		const SharedPaletteEntry* entries = reinterpret_cast<const SharedPaletteEntry*>(header.GetBytes() + header.paletteOffset);
+		shared->palette.reserve(header.paletteSize);
+		for (uint32_t i = 0; i < header.paletteSize; i++) {
+			shared->palette.push_back(BlockInfo(EBlockType(entries[i].type), ERotation(entries[i].rotation), UniqueID(entries[i].customBlockID)));
+		}
+		shared->view = ClipboardView(header.sizeX, header.sizeY, header.sizeZ, shared->palette.data(), shared->palette.size(), bits,
+			header.GetBytes() + header.indicesOffset, Orientation(header.orientation));
+		return shared;
+	}
+
+private:
+	static size_t AlignUp(size_t offset) {
+		return (offset + 7) & ~size_t(7);
+	}
+
+	static bool IsClipboardBuffer(const SharedClipboardHeader* buffer) {
+		return buffer->magic == SharedClipboardHeader::Magic && buffer->formatVersion == SharedClipboardHeader::FormatVersion;
+	}
+
+	static void Free(SharedClipboardHeader* buffer) {
+		buffer->~SharedClipboardHeader();
+		::operator delete(static_cast<void*>(buffer));
+	}
+
+	static void Release(SharedClipboardHeader* buffer) {
+		if (buffer != nullptr && buffer->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			buffer->release(buffer);
+		}
+	}
+};
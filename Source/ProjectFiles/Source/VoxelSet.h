@@ -0,0 +1,394 @@
+#pragma once
+#include "GameAPI.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/************************************************************
+	A set of block coordinates stored as one bit per voxel. Space is only allocated for the 32x32x32 chunks
+	that hold at least one voxel, so a million-voxel selection takes about 128 KB instead of 24 bytes a voxel.
+	Bits inside a chunk are ordered x-inner, then y, then z, so an x row of a chunk is half of one word.
+
+	Selections are built from it as well: boxes, polygons extruded over a Z range and whatever a mask accepts
+	are added or taken away a chunk row at a time, and region operations walk only its set bits.
+*************************************************************/
+
+class VoxelSet {
+public:
+	static constexpr int64_t ChunkSize = 32;
+	static constexpr size_t ChunkWords = size_t(ChunkSize * ChunkSize * ChunkSize / 64);
+
+	VoxelSet() = default;
+	VoxelSet(VoxelSet&&) = default;
+	VoxelSet& operator=(VoxelSet&&) = default;
+
+	// Copies every chunk, so a selection can be changed without touching the one a running job holds.
+	VoxelSet(const VoxelSet& other) : count(other.count), minCorner(other.minCorner), maxCorner(other.maxCorner) {
+		chunks.reserve(other.chunks.size());
+		for (const auto& entry : other.chunks) {
+			chunks.emplace(entry.first, std::make_unique<Chunk>(*entry.second));
+		}
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	bool Contains(const CoordinateInBlocks& at) const {
+		const Chunk* chunk = FindChunk(GetChunkKey(at));
+		if (chunk == nullptr) return false;
+		size_t bit = GetBitIndex(at);
+		return (chunk->words[bit >> 6] >> (bit & 63)) & 1;
+	}
+
+	// Returns true when the voxel wasn't in the set yet.
+	bool Insert(const CoordinateInBlocks& at) {
+		Chunk& chunk = GetOrAddChunk(GetChunkKey(at));
+		size_t bit = GetBitIndex(at);
+		uint64_t mask = uint64_t(1) << (bit & 63);
+		if (chunk.words[bit >> 6] & mask) return false;
+
+		chunk.words[bit >> 6] |= mask;
+		count++;
+		if (count == 1) {
+			minCorner = at;
+			maxCorner = at;
+		}
+		else {
+			minCorner = CoordinateInBlocks(std::min(minCorner.X, at.X), std::min(minCorner.Y, at.Y), std::min(minCorner.Z, at.Z));
+			maxCorner = CoordinateInBlocks(std::max(maxCorner.X, at.X), std::max(maxCorner.Y, at.Y), std::max(maxCorner.Z, at.Z));
+		}
+		return true;
+	}
+
+	// Inserts length voxels along +X from start.
+	void InsertRun(CoordinateInBlocks start, int64_t length) {
+		for (int64_t i = 0; i < length; i += 64) {
+			int64_t part = std::min<int64_t>(64, length - i);
+			InsertRowBits(start + CoordinateInBlocks(i, 0, 0), ~uint64_t(0) >> (64 - part));
+		}
+	}
+
+	// Inserts start + (i, 0, 0) for every set bit i.
+	void InsertRowBits(CoordinateInBlocks start, uint64_t bits) {
+		ForEachChunkRow(start, bits, [this](CoordinateInBlocks at, uint32_t rowBits) { SetChunkRow(at, rowBits); });
+	}
+
+	// Removes start + (i, 0, 0) for every set bit i. Call Shrink once done removing.
+	void EraseRowBits(CoordinateInBlocks start, uint64_t bits) {
+		ForEachChunkRow(start, bits, [this](CoordinateInBlocks at, uint32_t rowBits) { ClearChunkRow(at, rowBits); });
+	}
+
+	// Inserts every voxel of the inclusive box between the corners.
+	void InsertBox(CoordinateInBlocks corner1, CoordinateInBlocks corner2) {
+		ForEachBoxRow(corner1, corner2, [this](CoordinateInBlocks at, uint32_t rowBits) { SetChunkRow(at, rowBits); });
+	}
+
+	void EraseBox(CoordinateInBlocks corner1, CoordinateInBlocks corner2) {
+		ForEachBoxRow(corner1, corner2, [this](CoordinateInBlocks at, uint32_t rowBits) { ClearChunkRow(at, rowBits); });
+		Shrink();
+	}
+
+	// Inserts the voxels of other, moved by offset.
+	void InsertSet(const VoxelSet& other, CoordinateInBlocks offset = CoordinateInBlocks(0, 0, 0)) {
+		other.ForEachRow([&](CoordinateInBlocks rowStart, uint32_t rowBits) {
+			InsertRowBits(rowStart + offset, rowBits);
+		});
+	}
+
+	void EraseSet(const VoxelSet& other) {
+		other.ForEachRow([this](CoordinateInBlocks rowStart, uint32_t rowBits) { ClearChunkRow(rowStart, rowBits); });
+		Shrink();
+	}
+
+	// Inserts the columns from minZ to maxZ of the voxels inside the polygon the points outline in the XY plane,
+	// edges included. The points' own Z is ignored.
+	void InsertPrism(const std::vector<CoordinateInBlocks>& points, int16_t minZ, int16_t maxZ) {
+		if (points.empty()) return;
+
+		int64_t minY = points[0].Y;
+		int64_t maxY = points[0].Y;
+		for (const CoordinateInBlocks& point : points) {
+			minY = std::min(minY, point.Y);
+			maxY = std::max(maxY, point.Y);
+		}
+
+		// Each row is filled between pairs of the points where it crosses an edge. An edge counts for the rows
+		// from its lower end up to, but not including, its upper end, so a vertex between two edges counts once.
+		std::vector<double> crossings;
+		for (int64_t y = minY; y <= maxY; y++) {
+			crossings.clear();
+			for (size_t i = 0; i < points.size(); i++) {
+				const CoordinateInBlocks& a = points[i];
+				const CoordinateInBlocks& b = points[(i + 1) % points.size()];
+				if ((a.Y <= y && y < b.Y) || (b.Y <= y && y < a.Y)) {
+					crossings.push_back(double(a.X) + double(y - a.Y) * double(b.X - a.X) / double(b.Y - a.Y));
+				}
+			}
+			std::sort(crossings.begin(), crossings.end());
+			for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+				int64_t first = int64_t(std::ceil(crossings[i] - 1e-9));
+				int64_t last = int64_t(std::floor(crossings[i + 1] + 1e-9));
+				if (first <= last) InsertBox(CoordinateInBlocks(first, y, minZ), CoordinateInBlocks(last, y, maxZ));
+			}
+		}
+
+		// The fill leaves out parts of the outline, like the top edges, so the edges are drawn as well.
+		for (size_t i = 0; i < points.size(); i++) {
+			const CoordinateInBlocks& a = points[i];
+			const CoordinateInBlocks& b = points[(i + 1) % points.size()];
+			int64_t steps = std::max(std::abs(b.X - a.X), std::abs(b.Y - a.Y));
+			for (int64_t step = 0; step <= steps; step++) {
+				double t = steps == 0 ? 0.0 : double(step) / double(steps);
+				int64_t x = a.X + int64_t(std::llround(t * double(b.X - a.X)));
+				int64_t y = a.Y + int64_t(std::llround(t * double(b.Y - a.Y)));
+				InsertBox(CoordinateInBlocks(x, y, minZ), CoordinateInBlocks(x, y, maxZ));
+			}
+		}
+	}
+
+	// The bounding box of the voxels in the set. Only meaningful when the set isn't empty.
+	CoordinateInBlocks GetMinCorner() const {
+		return minCorner;
+	}
+
+	CoordinateInBlocks GetMaxCorner() const {
+		return maxCorner;
+	}
+
+	void clear() {
+		chunks.clear();
+		count = 0;
+		lastKey = InvalidKey;
+		lastChunk = nullptr;
+	}
+
+	size_t GetMemoryBytes() const {
+		return sizeof(VoxelSet) + chunks.size() * (sizeof(Chunk) + sizeof(ChunkMap::value_type) + sizeof(void*));
+	}
+
+	// The corners of the chunks that hold voxels, in chunk-column order (z-inner, then x, then y).
+	std::vector<CoordinateInBlocks> GetChunkCorners() const {
+		std::vector<CoordinateInBlocks> corners;
+		corners.reserve(chunks.size());
+		for (const auto& entry : chunks) {
+			corners.push_back(GetChunkCorner(entry.first));
+		}
+		std::sort(corners.begin(), corners.end(), [](const CoordinateInBlocks& a, const CoordinateInBlocks& b) {
+			if (a.Y != b.Y) return a.Y < b.Y;
+			if (a.X != b.X) return a.X < b.X;
+			return a.Z < b.Z;
+		});
+		return corners;
+	}
+
+	// The bits of the chunk at corner, two x rows a word, or nullptr when it has no voxels.
+	const uint64_t* GetChunkWords(CoordinateInBlocks corner) const {
+		const Chunk* chunk = FindChunk(GetChunkKey(corner));
+		return chunk == nullptr ? nullptr : chunk->words;
+	}
+
+	// Calls visit(rowStart, bits) for every x row of every chunk with a voxel in it, bit i standing for rowStart + (i, 0, 0).
+	template<typename Visitor> void ForEachRow(Visitor&& visit) const {
+		for (const auto& entry : chunks) {
+			CoordinateInBlocks corner = GetChunkCorner(entry.first);
+			for (size_t word = 0; word < ChunkWords; word++) {
+				uint64_t bits = entry.second->words[word];
+				if (bits == 0) continue;
+				for (size_t half = 0; half < 2; half++) {
+					uint32_t rowBits = uint32_t(bits >> (32 * half));
+					if (rowBits == 0) continue;
+					size_t row = word * 2 + half;
+					visit(corner + CoordinateInBlocks(0, int64_t(row % ChunkSize), int16_t(row / ChunkSize)), rowBits);
+				}
+			}
+		}
+	}
+
+	// Calls visit(CoordinateInBlocks) for every voxel of the chunk at corner, in bit order.
+	template<typename Visitor> void ForEachInChunk(CoordinateInBlocks corner, Visitor&& visit) const {
+		const Chunk* chunk = FindChunk(GetChunkKey(corner));
+		if (chunk == nullptr) return;
+
+		for (size_t word = 0; word < ChunkWords; word++) {
+			uint64_t bits = chunk->words[word];
+			while (bits != 0) {
+				size_t bit = word * 64 + size_t(std::countr_zero(bits));
+				visit(corner + CoordinateInBlocks(int64_t(bit % ChunkSize), int64_t((bit / ChunkSize) % ChunkSize), int16_t(bit / (ChunkSize * ChunkSize))));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+private:
+	struct Chunk {
+		uint64_t words[ChunkWords] = {};
+	};
+	using ChunkMap = std::unordered_map<uint64_t, std::unique_ptr<Chunk>>;
+
+	static constexpr uint64_t InvalidKey = ~uint64_t(0);
+
+	ChunkMap chunks;
+	size_t count = 0;
+	CoordinateInBlocks minCorner = CoordinateInBlocks(0, 0, 0);
+	CoordinateInBlocks maxCorner = CoordinateInBlocks(0, 0, 0);
+
+	// Neighbouring lookups nearly always hit the same chunk.
+	mutable uint64_t lastKey = InvalidKey;
+	mutable Chunk* lastChunk = nullptr;
+
+	// 28 bits each for the chunk's x and y, which covers 2^32 blocks either way, and 8 bits for z.
+	static uint64_t GetChunkKey(const CoordinateInBlocks& at) {
+		uint64_t x = uint64_t(at.X >> 5) & 0xFFFFFFF;
+		uint64_t y = uint64_t(at.Y >> 5) & 0xFFFFFFF;
+		uint64_t z = uint64_t(int64_t(at.Z) >> 5) & 0xFF;
+		return x | (y << 28) | (z << 56);
+	}
+
+	static CoordinateInBlocks GetChunkCorner(uint64_t key) {
+		// Sign-extends the 28 bit fields back to chunk coordinates.
+		int64_t x = int64_t((key & 0xFFFFFFF) << 36) >> 36;
+		int64_t y = int64_t(((key >> 28) & 0xFFFFFFF) << 36) >> 36;
+		int64_t z = int64_t(int8_t(uint8_t(key >> 56)));
+		return CoordinateInBlocks(x * ChunkSize, y * ChunkSize, int16_t(z * ChunkSize));
+	}
+
+	static size_t GetBitIndex(const CoordinateInBlocks& at) {
+		return size_t(at.X & (ChunkSize - 1)) + size_t(ChunkSize) * (size_t(at.Y & (ChunkSize - 1)) + size_t(ChunkSize) * size_t(at.Z & (ChunkSize - 1)));
+	}
+
+	// The x row of its chunk that at is on, which is the bit index of the row's first voxel over ChunkSize.
+	static size_t GetRowIndex(const CoordinateInBlocks& at) {
+		return size_t(at.Y & (ChunkSize - 1)) + size_t(ChunkSize) * size_t(at.Z & (ChunkSize - 1));
+	}
+
+	// Splits a row of up to 64 bits starting anywhere into the chunk rows it covers, as visit(at, rowBits) with at
+	// on the row and bit i of rowBits standing for the chunk's x i.
+	template<typename Visitor> static void ForEachChunkRow(CoordinateInBlocks start, uint64_t bits, Visitor&& visit) {
+		int64_t x = start.X;
+		while (bits != 0) {
+			int shift = int(x & (ChunkSize - 1));
+			uint32_t rowBits = uint32_t(bits << shift);
+			if (rowBits != 0) visit(CoordinateInBlocks(x, start.Y, start.Z), rowBits);
+			int taken = int(ChunkSize) - shift;
+			bits = bits >> taken;
+			x += taken;
+		}
+	}
+
+	template<typename Visitor> static void ForEachBoxRow(CoordinateInBlocks corner1, CoordinateInBlocks corner2, Visitor&& visit) {
+		CoordinateInBlocks start = CoordinateInBlocks(std::min(corner1.X, corner2.X), std::min(corner1.Y, corner2.Y), std::min(corner1.Z, corner2.Z));
+		CoordinateInBlocks end = CoordinateInBlocks(std::max(corner1.X, corner2.X), std::max(corner1.Y, corner2.Y), std::max(corner1.Z, corner2.Z));
+		for (int64_t z = start.Z; z <= end.Z; z++) {
+			for (int64_t y = start.Y; y <= end.Y; y++) {
+				for (int64_t x = start.X; x <= end.X;) {
+					int64_t chunkEnd = (x & ~(ChunkSize - 1)) + ChunkSize - 1;
+					int64_t last = std::min(chunkEnd, end.X);
+					int width = int(last - x + 1);
+					uint32_t rowBits = uint32_t((~uint64_t(0) >> (64 - width)) << (x & (ChunkSize - 1)));
+					visit(CoordinateInBlocks(x, y, int16_t(z)), rowBits);
+					x = last + 1;
+				}
+			}
+		}
+	}
+
+	void SetChunkRow(CoordinateInBlocks at, uint32_t rowBits) {
+		Chunk& chunk = GetOrAddChunk(GetChunkKey(at));
+		size_t row = GetRowIndex(at);
+		uint64_t mask = uint64_t(rowBits) << (32 * (row & 1));
+		uint64_t& word = chunk.words[row >> 1];
+		int added = std::popcount(mask & ~word);
+		if (added == 0) return;
+		word |= mask;
+
+		// The row's lowest and highest new voxels are enough to grow the bounds by.
+		int64_t chunkX = at.X & ~(ChunkSize - 1);
+		CoordinateInBlocks first = CoordinateInBlocks(chunkX + std::countr_zero(rowBits), at.Y, at.Z);
+		CoordinateInBlocks last = CoordinateInBlocks(chunkX + 31 - std::countl_zero(rowBits), at.Y, at.Z);
+		if (count == 0) {
+			minCorner = first;
+			maxCorner = last;
+		}
+		else {
+			minCorner = CoordinateInBlocks(std::min(minCorner.X, first.X), std::min(minCorner.Y, at.Y), std::min(minCorner.Z, at.Z));
+			maxCorner = CoordinateInBlocks(std::max(maxCorner.X, last.X), std::max(maxCorner.Y, at.Y), std::max(maxCorner.Z, at.Z));
+		}
+		count += size_t(added);
+	}
+
+	void ClearChunkRow(CoordinateInBlocks at, uint32_t rowBits) {
+		uint64_t key = GetChunkKey(at);
+		if (FindChunk(key) == nullptr) return;
+		size_t row = GetRowIndex(at);
+		uint64_t mask = uint64_t(rowBits) << (32 * (row & 1));
+		uint64_t& word = GetOrAddChunk(key).words[row >> 1];
+		count -= size_t(std::popcount(mask & word));
+		word &= ~mask;
+	}
+
+	// Drops the chunks removing left empty and fits the bounds to what is left.
+	void Shrink() {
+		lastKey = InvalidKey;
+		lastChunk = nullptr;
+		bool first = true;
+		for (auto entry = chunks.begin(); entry != chunks.end();) {
+			const Chunk& chunk = *entry->second;
+			CoordinateInBlocks corner = GetChunkCorner(entry->first);
+			bool any = false;
+			for (size_t word = 0; word < ChunkWords; word++) {
+				uint64_t bits = chunk.words[word];
+				if (bits == 0) continue;
+				any = true;
+				for (size_t half = 0; half < 2; half++) {
+					uint32_t rowBits = uint32_t(bits >> (32 * half));
+					if (rowBits == 0) continue;
+					size_t row = word * 2 + half;
+					CoordinateInBlocks low = corner + CoordinateInBlocks(std::countr_zero(rowBits), int64_t(row % ChunkSize), int16_t(row / ChunkSize));
+					CoordinateInBlocks high = CoordinateInBlocks(corner.X + 31 - std::countl_zero(rowBits), low.Y, low.Z);
+					if (first) {
+						minCorner = low;
+						maxCorner = high;
+						first = false;
+					}
+					else {
+						minCorner = CoordinateInBlocks(std::min(minCorner.X, low.X), std::min(minCorner.Y, low.Y), std::min(minCorner.Z, low.Z));
+						maxCorner = CoordinateInBlocks(std::max(maxCorner.X, high.X), std::max(maxCorner.Y, high.Y), std::max(maxCorner.Z, high.Z));
+					}
+				}
+			}
+			if (any) ++entry;
+			else entry = chunks.erase(entry);
+		}
+	}
+
+	const Chunk* FindChunk(uint64_t key) const {
+		if (key == lastKey) return lastChunk;
+
+		auto found = chunks.find(key);
+		if (found == chunks.end()) return nullptr;
+		lastKey = key;
+		lastChunk = found->second.get();
+		return lastChunk;
+	}
+
+	Chunk& GetOrAddChunk(uint64_t key) {
+		if (key == lastKey) return *lastChunk;
+
+		std::unique_ptr<Chunk>& chunk = chunks[key];
+		if (chunk == nullptr) {
+			chunk = std::make_unique<Chunk>();
+		}
+		lastKey = key;
+		lastChunk = chunk.get();
+		return *chunk;
+	}
+};
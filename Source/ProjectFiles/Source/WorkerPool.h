@@ -0,0 +1,252 @@
+#pragma once
+#include "GameAPI.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/************************************************************
+	A few worker threads for the stages that don't touch the world: encoding undo entries, solving shape
+	tables and encoding save blobs. Only the game thread may call the game's functions, so a worker never
+	does; it hands its result back through a lock-free single-producer/single-consumer queue of its own,
+	which the game thread drains from Event_Tick.
+
+	Each worker runs tasks from the front of its own deque and, when that is empty, steals from the back of
+	the others'. Without threads (before Start or after Shutdown) tasks run inline on the calling thread.
+*************************************************************/
+
+// A fixed-size ring of one writer thread and one reader thread. Neither side ever takes a lock.
+template<typename T, size_t Capacity> class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Writer side. Returns false when the ring is full.
+	bool TryPush(T&& value) {
+		size_t tail = tailIndex.load(std::memory_order_relaxed);
+		if (tail - headIndex.load(std::memory_order_acquire) == Capacity) return false;
+		slots[tail & (Capacity - 1)] = std::move(value);
+		tailIndex.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Reader side. Returns false when the ring is empty.
+	bool TryPop(T& value) {
+		size_t head = headIndex.load(std::memory_order_relaxed);
+		if (head == tailIndex.load(std::memory_order_acquire)) return false;
+		value = std::move(slots[head & (Capacity - 1)]);
+		headIndex.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T slots[Capacity];
+	// On separate cache lines, so the two threads don't share one.
+	alignas(64) std::atomic<size_t> headIndex{ 0 };
+	alignas(64) std::atomic<size_t> tailIndex{ 0 };
+};
+
+// The result of a task run on the pool. It counts as ready once the game thread has drained its hand-off,
+// so code on the game thread can check IsReady each tick without any locking.
+template<typename T> class WorkerTask {
+public:
+	bool IsReady() const {
+		return delivered;
+	}
+
+	// Blocks until the worker is done, for the few places that can't wait for a tick, like leaving the world.
+	T& Wait() {
+		while (!computed.load(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+		delivered = true;
+		return value;
+	}
+
+	T& Get() {
+		return value;
+	}
+
+private:
+	friend class WorkerPool;
+	T value{};
+	std::atomic<bool> computed{ false };
+	bool delivered = false;
+};
+
+class WorkerPool {
+public:
+	// Hand-offs a worker can have waiting for the game thread before it stalls.
+	static constexpr size_t CompletionCapacity = 256;
+
+	~WorkerPool() {
+		Shutdown();
+	}
+
+	bool IsRunning() const {
+		return !workers.empty();
+	}
+
+	size_t GetThreadCount() const {
+		return workers.size();
+	}
+
+	void Start(size_t threadCount) {
+		if (IsRunning()) return;
+
+		stopping = false;
+		for (size_t i = 0; i < threadCount; i++) {
+			workers.push_back(std::make_unique<Worker>());
+		}
+		runningWorkers = threadCount;
+		for (size_t i = 0; i < threadCount; i++) {
+			workers[i]->thread = std::thread([this, i]() { WorkerLoop(i); });
+		}
+	}
+
+	// Lets the workers finish what is queued, joins them and runs their last hand-offs.
+	void Shutdown() {
+		if (!IsRunning()) return;
+
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			stopping = true;
+		}
+		wake.notify_all();
+		// A worker with a full hand-off queue waits for the game thread, so keep draining while they finish.
+		while (runningWorkers.load(std::memory_order_acquire) > 0) {
+			DrainCompletions();
+			std::this_thread::yield();
+		}
+		for (auto& worker : workers) {
+			worker->thread.join();
+		}
+		DrainCompletions();
+		workers.clear();
+	}
+
+	// Queues a task. A worker that submits keeps the task on its own deque; the game thread spreads them round robin.
+	void Submit(std::function<void()> task) {
+		if (!IsRunning()) {
+			task();
+			return;
+		}
+
+		size_t target = (currentWorker >= 0 && currentPool == this) ? size_t(currentWorker) : (nextWorker++ % workers.size());
+		{
+			std::lock_guard<std::mutex> guard(workers[target]->lock);
+			workers[target]->tasks.push_front(std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			queuedTasks++;
+		}
+		wake.notify_one();
+	}
+
+	// Hands a function from a worker to the game thread, which runs it from DrainCompletions.
+	// Called on any other thread, it runs the function right away.
+	void Post(std::function<void()> onGameThread) {
+		if (currentWorker < 0 || currentPool != this) {
+			onGameThread();
+			return;
+		}
+		Worker& worker = *workers[size_t(currentWorker)];
+		while (!worker.completions.TryPush(std::move(onGameThread))) {
+			std::this_thread::yield();
+		}
+	}
+
+	// Runs compute on a worker and returns its task, which becomes ready once the game thread has drained it.
+	template<typename T> std::shared_ptr<WorkerTask<T>> Run(std::function<T()> compute) {
+		auto task = std::make_shared<WorkerTask<T>>();
+		Submit([this, task, compute = std::move(compute)]() {
+			task->value = compute();
+			task->computed.store(true, std::memory_order_release);
+			Post([task]() { task->delivered = true; });
+		});
+		return task;
+	}
+
+	// Game thread only. Returns how many hand-offs ran.
+	size_t DrainCompletions() {
+		size_t drained = 0;
+		std::function<void()> onGameThread;
+		for (auto& worker : workers) {
+			while (worker->completions.TryPop(onGameThread)) {
+				onGameThread();
+				drained++;
+			}
+		}
+		return drained;
+	}
+
+private:
+	struct Worker {
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+		SpscQueue<std::function<void()>, CompletionCapacity> completions;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	size_t nextWorker = 0;
+	std::atomic<size_t> runningWorkers{ 0 };
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	size_t queuedTasks = 0;
+	bool stopping = false;
+
+	// Which worker, of which pool, the current thread is. -1 on the game thread.
+	static inline thread_local int currentWorker = -1;
+	static inline thread_local WorkerPool* currentPool = nullptr;
+
+	bool TakeTask(size_t self, std::function<void()>& task) {
+		// Newest first from our own deque, oldest first from the others', so a thief takes the work its owner would reach last.
+		for (size_t i = 0; i < workers.size(); i++) {
+			Worker& worker = *workers[(self + i) % workers.size()];
+			std::lock_guard<std::mutex> guard(worker.lock);
+			if (worker.tasks.empty()) continue;
+			if (i == 0) {
+				task = std::move(worker.tasks.front());
+				worker.tasks.pop_front();
+			}
+			else {
+				task = std::move(worker.tasks.back());
+				worker.tasks.pop_back();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	void WorkerLoop(size_t self) {
+		currentWorker = int(self);
+		currentPool = this;
+
+		while (true) {
+			{
+				std::unique_lock<std::mutex> guard(sleepLock);
+				wake.wait(guard, [this]() { return queuedTasks > 0 || stopping; });
+				if (queuedTasks == 0 && stopping) break;
+				queuedTasks--;
+			}
+
+			// The count was taken, so a task is on some deque until it's run; keep looking until it turns up.
+			std::function<void()> task;
+			while (!TakeTask(self, task)) {
+				std::this_thread::yield();
+			}
+			task();
+		}
+
+		currentWorker = -1;
+		currentPool = nullptr;
+		runningWorkers.fetch_sub(1, std::memory_order_release);
+	}
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include "GameAPI.h"
+#include "BlockPalette.h"
+#include "OperationHistory.h"
+#include "OperationJournal.h"
+#include "DeferredWrites.h"
+#include "MaterialHistogram.h"
+
+/************************************************************
+	Every region operation decides per voxel what it wants the block to be, then hands that to a WritePlanner.
+	The planner drops writes that would not change anything, so only real changes reach the world and the
+	undo entry. In a dry run nothing is written and the planner only counts. Given a journal, every write is
+	logged there with the block it replaces before it reaches the world. Given a deferred write queue, writes
+	into chunks that aren't loaded wait there; they aren't part of the undo entry, since what they replace
+	can't be read yet, but they carry its tag so undoing it drops the ones still waiting. Every change is also
+	counted in two histograms, of the blocks placed and the blocks replaced, which is the operation's bill of
+	materials. Undo and redo settle their entry's bill instead, so their changes aren't counted.
+*************************************************************/
+
+struct WritePlanner {
+	OperationRecorder recorder;
+	bool dryRun = false;
+	OperationJournal* journal = nullptr;
+	DeferredWriteQueue* deferred = nullptr;
+
+	// Voxels the operation targeted, and how many of those actually differ from the wanted block.
+	int64_t affectedBlocks = 0;
+	int64_t changedBlocks = 0;
+	// Writes into unloaded chunks that were queued, and ones the full queue refused.
+	int64_t deferredBlocks = 0;
+	int64_t droppedBlocks = 0;
+	// Tags the queued writes, and the undo entry with them. 0 until the first write is queued.
+	uint32_t deferredTag = 0;
+	// Set for writes whose materials are settled up front, by undo and redo, which leaves them out of the bill.
+	bool settledUpFront = false;
+	// Kept apart rather than netted, so each keeps hitting its palette's last-lookup cache.
+	MaterialHistogram placedMaterials;
+	MaterialHistogram removedMaterials;
+
+	void Begin(CoordinateInBlocks minCorner, CoordinateInBlocks maxCorner, bool isDryRun, OperationJournal* operationJournal = nullptr, DeferredWriteQueue* deferredQueue = nullptr) {
+		recorder.Begin(minCorner, maxCorner);
+		dryRun = isDryRun;
+		journal = isDryRun ? nullptr : operationJournal;
+		deferred = deferredQueue;
+		affectedBlocks = 0;
+		changedBlocks = 0;
+		deferredBlocks = 0;
+		droppedBlocks = 0;
+		deferredTag = 0;
+		settledUpFront = false;
+		placedMaterials.clear();
+		removedMaterials.clear();
+	}
+
+	// Returns whether the voxel changes (or would, in a dry run). A queued write doesn't count as a change yet.
+	bool Plan(CoordinateInBlocks at, const BlockInfo& current, const BlockInfo& wanted) {
+		affectedBlocks++;
+		if (current.Type == EBlockType::Invalid) {
+			if (deferred == nullptr || wanted.Type == EBlockType::Invalid || !DeferredWriteQueue::CanQueue(at)) return false;
+			if (!dryRun && deferredTag == 0) deferredTag = deferred->NewOperationTag(settledUpFront);
+			if (dryRun || deferred->Add(at, wanted, deferredTag)) deferredBlocks++;
+			else droppedBlocks++;
+			return false;
+		}
+		if (SameBlock(current, wanted)) return false;
+
+		changedBlocks++;
+		recorder.Record(at, current);
+		if (!settledUpFront) {
+			placedMaterials.Add(wanted);
+			removedMaterials.Add(current);
+		}
+		if (!dryRun) {
+			if (journal != nullptr) journal->Record(at, current);
+			SetBlock(at, wanted);
+		}
+		return true;
+	}
+
+	// Encodes the undo entry, or what it would be in a dry run, on the worker pool. Returns true once it's done.
+	bool FinishInBackground(WorkerPool& pool) {
+		return recorder.FinishInBackground(pool);
+	}
+
+	// What the changes take from the inventory, with what they free up as negative counts.
+	MaterialHistogram GetMaterialBill() const {
+		MaterialHistogram bill = placedMaterials;
+		bill.Add(removedMaterials, -1);
+		return bill;
+	}
+
+	// Encodes what the undo entry would be and reports its size, then throws it away.
+	wString GetDryRunSummary() {
+		size_t undoBytes = recorder.empty() ? 0 : recorder.Finish().GetMemoryBytes();
+		return L"Dry run: " + std::to_wstring(affectedBlocks) + L" blocks affected\n"
+			+ std::to_wstring(changedBlocks) + L" would change"
+			+ (deferredBlocks > 0 ? L", " + std::to_wstring(deferredBlocks) + L" would wait for their chunks to load\n" : L"\n")
+			+ L"Undo size: " + std::to_wstring((undoBytes + 1023) / 1024) + L" KB\n"
+			+ GetMaterialBill().GetSummary(4);
+	}
+};